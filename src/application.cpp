@@ -15,6 +15,10 @@
 #include "decorator.h"
 #include "filemanager.h"
 #include "console.h"
+#include "profiler.h"
+#include "trace.h"
+#include "player.h"
+#include "headless.h"
 
 #include <iostream>
 #include <sstream>
@@ -52,10 +56,22 @@ Application::Application(int argc, char **argv)
 
   _quit = _windowSettingsChanged = false;
 
+  _headless = false;
+  _quiet = false;
+  _battles = 10;
+  _teamSize = 4;
+  _benchmarkAircraft = 0;
+  _scaling = false;
+  _replayCheck = false;
+
   _surface = NULL;
   _joystick = NULL;
   _joystickDevice = 0;
 
+  _profiler = new Profiler;
+
+  _trace = new Trace;
+
   _settings = new Settings;
 
   _bindingManager = new BindingManager;
@@ -96,6 +112,12 @@ Application::~Application()
   delete _settings;
   _settings = NULL;
 
+  delete _trace;
+  _trace = NULL;
+
+  delete _profiler;
+  _profiler = NULL;
+
   _instance = NULL;
 }
 
@@ -144,7 +166,7 @@ void Application::parseArgs()
     }
     else if (stream.str() == "-h")
     {
-      cout << "Usage: " << _argv[0] << " [-size widthXheight -b bpp (-fs|-nfs)]" << endl;
+      cout << "Usage: " << _argv[0] << " [-size widthXheight -b bpp (-fs|-nfs)] [-replay file] [-headless [-battles count -team size | -benchmark aircraft | -scaling | -replay-check]]" << endl;
       quit(0);
       return;
     }
@@ -203,6 +225,60 @@ void Application::parseArgs()
 
       skip = true;
     }
+    else if (stream.str() == "-replay")
+    {
+      if (i >= _argc - 1)
+      {
+        cout << "Missing argument for -replay!" << endl;
+        quit(1);
+        return;
+      }
+
+      _replayFile = _argv[i + 1];
+
+      skip = true;
+    }
+    else if (stream.str() == "-headless")
+    {
+      _headless = true;
+    }
+    else if (stream.str() == "-scaling")
+    {
+      _scaling = true;
+    }
+    else if (stream.str() == "-replay-check")
+    {
+      _replayCheck = true;
+    }
+    else if ((stream.str() == "-battles") || (stream.str() == "-team") ||
+             (stream.str() == "-benchmark"))
+    {
+      if (i >= _argc - 1)
+      {
+        cout << "Missing argument for " << stream.str() << "!" << endl;
+        quit(1);
+        return;
+      }
+
+      bool ok = false;
+      int value = fromString<int>(_argv[i + 1], &ok);
+
+      if ((!ok) || (value <= 0))
+      {
+        cout << "Invalid argument for " << stream.str() << "!" << endl;
+        quit(1);
+        return;
+      }
+
+      if (stream.str() == "-battles")
+        _battles = value;
+      else if (stream.str() == "-team")
+        _teamSize = value;
+      else
+        _benchmarkAircraft = value;
+
+      skip = true;
+    }
     else
     {
       cout << "Invalid argument: " << stream.str() << endl;
@@ -212,6 +288,39 @@ void Application::parseArgs()
   }
 }
 
+int Application::executeHeadless()
+{
+  // Only for the threads and timers
+  if (SDL_Init(0) < 0)
+  {
+    Object::print("Error in SDL_Init(): " + string(SDL_GetError()));
+    return 1;
+  }
+
+  Player::initModel(false);
+
+  if (!_quit)
+  {
+    Headless headless;
+    if (!_replayFile.empty())
+      _quitCode = headless.replay(_replayFile);
+    else if (_benchmarkAircraft > 0)
+      _quitCode = headless.benchmark(_benchmarkAircraft);
+    else if (_scaling)
+      _quitCode = headless.scaling();
+    else if (_replayCheck)
+      _quitCode = headless.replayCheck();
+    else
+      _quitCode = headless.battles(_battles, _teamSize);
+  }
+
+  Player::destroyModel();
+
+  SDL_Quit();
+
+  return _quitCode;
+}
+
 void Application::quit(int code)
 {
   _quit = true;
@@ -221,6 +330,9 @@ void Application::quit(int code)
 void Application::print(const std::string &module,
                         const std::string &message) const
 {
+  if (_quiet)
+    return;
+
   cout << module << ":: " << message << endl;
   if (Console::instance() != NULL)
   {
@@ -378,6 +490,9 @@ int Application::execute()
   if (_quit)
     return _quitCode;
 
+  if (_headless)
+    return executeHeadless();
+
   init();
 
   if (!_quit)
@@ -392,13 +507,19 @@ int Application::execute()
 
     WindowResizeEvent firstResize(Size(0, 0), _windowSettings.size);
     _render->sendEvent(&firstResize);
+
+    if ((!_replayFile.empty()) && (!_render->replay(_replayFile)))
+      quit(1);
   }
 
   SDL_Event event;
 
+  Trace::setThreadName("Main");
+
   while (!_quit)
   {
     // Event handling
+    _profiler->begin("Events");
     while (SDL_PollEvent(&event))
     {
       switch (event.type)
@@ -486,6 +607,7 @@ int Application::execute()
           break;
       }
     }
+    _profiler->end();
 
     if (_settings->settingsChanged())
     {
@@ -500,14 +622,25 @@ int Application::execute()
     if (_quit)
       break;
 
-    _render->render();
+    {
+      ProfileScope scope("Render::render");
+      _render->render();
+    }
 
-    SDL_GL_SwapBuffers();
+    {
+      ProfileScope scope("SwapBuffers");
+      SDL_GL_SwapBuffers();
+    }
 
     if (_quit)
       break;
 
-    _render->update();
+    {
+      ProfileScope scope("Render::update");
+      _render->update();
+    }
+
+    _profiler->endFrame();
 
     if (_quit)
       break;
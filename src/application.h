@@ -19,6 +19,8 @@ class BindingManager;
 class FontManager;
 class Decorator;
 class Render;
+class Profiler;
+class Trace;
 
 struct WindowSettings
 {
@@ -66,6 +68,12 @@ class Application : public Object
 
     void print(const std::string &module, const std::string &message) const;
 
+    // Drops the printed messages, e.g. during headless runs
+    inline void setQuiet(bool pQuiet)
+      { _quiet = pQuiet; }
+    inline bool quiet() const
+      { return _quiet; }
+
   private:
     static Application *_instance;
 
@@ -78,6 +86,18 @@ class Application : public Object
 
     bool _quit;
     bool _windowSettingsChanged;
+    bool _quiet;
+
+    /* Recording to replay (-replay) and whether to do it without a window (-headless);
+       without a recording, the headless mode runs battles of AI players (-battles, -team),
+       the benchmark of the given count of aircraft (-benchmark) or for 10 to 1000 (-scaling),
+       or checks a replay with planes far from the player (-replay-check) */
+    std::string _replayFile;
+    bool _headless;
+    bool _replayCheck;
+    int _battles, _teamSize;
+    int _benchmarkAircraft;
+    bool _scaling;
 
     int _videoFlags;
     SDL_Surface *_surface;
@@ -89,8 +109,11 @@ class Application : public Object
     FontManager *_fontManager;
     Decorator *_decorator;
     Render *_render;
+    Profiler *_profiler;
+    Trace *_trace;
 
     void parseArgs();
     void init();
     void changeWindowSettings();
+    int executeHeadless();
 };
@@ -0,0 +1,42 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* atomic.h
+    Contains the atomic loads and stores of values shared between threads
+    without locking. */
+
+#pragma once
+
+#include "config.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Loads and stores with full (sequentially consistent) ordering
+template<typename T>
+inline T atomicLoad(T *p)
+{
+#if defined(__GNUC__)
+  return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#else
+  _ReadWriteBarrier();
+  T result = *(volatile T*)(p);
+  _ReadWriteBarrier();
+  return result;
+#endif
+}
+
+template<typename T>
+inline void atomicStore(T *p, T value)
+{
+#if defined(__GNUC__)
+  __atomic_store_n(p, value, __ATOMIC_SEQ_CST);
+#else
+  _ReadWriteBarrier();
+  *(volatile T*)(p) = value;
+  _mm_mfence();
+#endif
+}
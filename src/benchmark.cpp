@@ -0,0 +1,768 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* benchmark.cpp
+    Standalone benchmark of the terrain generation code. Besides the tables
+    on the standard output, the measurements may be written to a CSV file
+    given as the argument, to be compared between versions. */
+
+#include "config.h"
+
+#include "fractal.h"
+#include "normals.h"
+#include "occlusion.h"
+#include "quadtable.h"
+#include "terrain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <SDL/SDL_thread.h>
+#include <SDL/SDL_mutex.h>
+
+#if defined(__linux__)
+#include <time.h>
+#endif
+
+using namespace std;
+
+// Current time in seconds
+double now()
+{
+#if defined(__linux__)
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+#else
+  return ((double)clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+// Measurements as lines of "name,value,unit"
+vector<string> results;
+
+void record(const string &name, double value, const string &unit)
+{
+  ostringstream line;
+  line << name << "," << setprecision(6) << value << "," << unit;
+  results.push_back(line.str());
+}
+
+bool saveResults(const string &fileName)
+{
+  ofstream file(fileName.c_str());
+  if (!file)
+    return false;
+
+  file << "name,value,unit" << endl;
+  for (unsigned int i = 0; i < results.size(); ++i)
+    file << results[i] << endl;
+
+  return !file.fail();
+}
+
+// Number of runs so that each measurement takes a comparable amount of time
+int runCount(int size)
+{
+  int runs = 1 << (2 * (11 - size));
+  if (runs > 1000)
+    runs = 1000;
+  return runs;
+}
+
+bool benchmarkFractal()
+{
+  cout << "Fractal::generate vs Fractal::generateReference" << endl;
+  cout << setw(6) << "size" << setw(8) << "runs"
+       << setw(16) << "recursive [ms]" << setw(16) << "iterative [ms]"
+       << setw(10) << "speedup" << setw(12) << "identical" << endl;
+
+  bool allIdentical = true;
+
+  for (int size = 3; size <= 11; ++size)
+  {
+    Fractal fractal;
+
+    FractalOptions options = fractal.options();
+    options.size = size;
+    fractal.setOptions(options);
+
+    int valuesSize = fractal.size();
+    float *reference = new float[valuesSize * valuesSize];
+
+    int runs = runCount(size);
+
+    double recursiveTime = 0.0, iterativeTime = 0.0;
+    bool identical = true;
+
+    for (int run = 0; run < runs; ++run)
+    {
+      int seed = 1000 + run;
+
+      fractal.clear();
+      double t = now();
+      fractal.generateReference(seed);
+      recursiveTime += now() - t;
+
+      for (int x = 0; x < valuesSize; ++x)
+      {
+        for (int y = 0; y < valuesSize; ++y)
+          reference[x * valuesSize + y] = fractal.value(x, y);
+      }
+
+      fractal.clear();
+      t = now();
+      fractal.generate(seed);
+      iterativeTime += now() - t;
+
+      for (int x = 0; x < valuesSize; ++x)
+      {
+        for (int y = 0; y < valuesSize; ++y)
+        {
+          float v = fractal.value(x, y);
+          if (memcmp(&v, &reference[x * valuesSize + y], sizeof(float)) != 0)
+            identical = false;
+        }
+      }
+    }
+
+    delete[] reference;
+
+    cout << setw(6) << size << setw(8) << runs << fixed << setprecision(4)
+         << setw(16) << 1000.0 * recursiveTime / runs
+         << setw(16) << 1000.0 * iterativeTime / runs
+         << setw(10) << setprecision(2) << recursiveTime / iterativeTime
+         << setw(12) << (identical ? "yes" : "NO") << endl;
+
+    ostringstream name;
+    name << "fractal/size" << size << "/iterative";
+    record(name.str(), 1000.0 * iterativeTime / runs, "ms");
+
+    allIdentical = allIdentical && identical;
+  }
+
+  return allIdentical;
+}
+
+// Largest difference of packed normal components
+int normalsDifference(const PackedNormal *n1, const PackedNormal *n2, int count)
+{
+  int result = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    result = max(result, abs(n1[i].x - n2[i].x));
+    result = max(result, abs(n1[i].y - n2[i].y));
+    result = max(result, abs(n1[i].z - n2[i].z));
+  }
+  return result;
+}
+
+bool benchmarkNormals()
+{
+  // Same as a single quad of Map
+  const int size = 129;
+  const int runs = 1000;
+
+  Fractal fractal;
+  FractalOptions options = fractal.options();
+  options.size = 8;
+  fractal.setOptions(options);
+  fractal.clear();
+  fractal.generate(1234);
+
+  float *heights = new float[(size+2) * (size+2)];
+  for (int x = 0; x < size+2; ++x)
+  {
+    for (int z = 0; z < size+2; ++z)
+      heights[x * (size+2) + z] = fractal.value(x, z);
+  }
+
+  PackedNormal *reference = new PackedNormal[size * size];
+  PackedNormal *scalar = new PackedNormal[size * size];
+  PackedNormal *vector = new PackedNormal[size * size];
+
+  double t = now();
+  for (int run = 0; run < runs; ++run)
+    calculateNormalsReference(heights, size, 10.0f, 10.0f, 10.0f, reference);
+  double referenceTime = (now() - t) / runs;
+
+  t = now();
+  for (int run = 0; run < runs; ++run)
+    calculateNormalsScalar(heights, size, 10.0f, 10.0f, 10.0f, scalar);
+  double scalarTime = (now() - t) / runs;
+
+  t = now();
+  for (int run = 0; run < runs; ++run)
+    calculateNormals(heights, size, 10.0f, 10.0f, 10.0f, vector);
+  double vectorTime = (now() - t) / runs;
+
+  int scalarDifference = normalsDifference(reference, scalar, size * size);
+  int vectorDifference = normalsDifference(reference, vector, size * size);
+
+  cout << endl << "Normals of a " << size << "x" << size << " quad ("
+       << normalsInstructionSet() << ")" << endl;
+  cout << setw(12) << "kernel" << setw(16) << "per quad [us]"
+       << setw(10) << "speedup" << setw(24) << "max difference [1/127]" << endl;
+  cout << fixed << setprecision(2);
+  cout << setw(12) << "reference" << setw(16) << 1e6 * referenceTime
+       << setw(10) << 1.0 << setw(24) << 0 << endl;
+  cout << setw(12) << "scalar" << setw(16) << 1e6 * scalarTime
+       << setw(10) << referenceTime / scalarTime << setw(24) << scalarDifference << endl;
+  cout << setw(12) << "vector" << setw(16) << 1e6 * vectorTime
+       << setw(10) << referenceTime / vectorTime << setw(24) << vectorDifference << endl;
+
+  record("normals/reference", 1e6 * referenceTime, "us");
+  record("normals/scalar", 1e6 * scalarTime, "us");
+  record("normals/vector", 1e6 * vectorTime, "us");
+
+  delete[] heights;
+  delete[] reference;
+  delete[] scalar;
+  delete[] vector;
+
+  // The sums are equal up to rounding, which may flip the last bit of a component
+  return (scalarDifference <= 1) && (vectorDifference <= 1);
+}
+
+const char *DISTRIBUTION_NAMES[3] = { "uniform", "normal", "weibull" };
+const char *MIXING_NAMES[2] = { "gauss", "linear" };
+
+// Whether all heights of the quad are finite numbers
+bool finiteHeights(const TerrainQuad *quad)
+{
+  for (int x = 0; x <= TerrainQuad::SIZE; ++x)
+  {
+    for (int z = 0; z <= TerrainQuad::SIZE; ++z)
+    {
+      float v = quad->value(x, z);
+      if (!(v == v) || (fabs(v) > 1e30f))
+        return false;
+    }
+  }
+  return true;
+}
+
+/* Quads of the map (generation, normals and patch errors, as done by the
+   worker threads), and Fractal::generate alone at other sizes, for each
+   distribution and mixing mode */
+bool benchmarkQuads()
+{
+  // Quads are created row by row, each next to the previous ones, as when flying over the map
+  const int grid = 6;
+  const int samples = (1+TerrainQuad::SIZE) * (1+TerrainQuad::SIZE);
+  const Vector3D scale(10.0f, 10.0f, 10.0f);
+
+  cout << endl << "Quads of " << (1+TerrainQuad::SIZE) << "x" << (1+TerrainQuad::SIZE) << " vertices ("
+       << grid * grid << " per mode)" << endl;
+  cout << setw(10) << "distrib." << setw(8) << "mixing" << setw(10) << "quads/s"
+       << setw(16) << "generate [ns]" << setw(16) << "normals [ns]" << setw(16) << "errors [ns]"
+       << setw(14) << "memory [KB]" << endl;
+
+  bool ok = true;
+
+  vector<TerrainQuad*> quads(grid * grid, (TerrainQuad*)NULL);
+
+  for (int d = 0; d < 3; ++d)
+  {
+    for (int m = 0; m < 2; ++m)
+    {
+      Fractal fractal;
+      FractalOptions options = fractal.options();
+      options.size = TerrainQuad::SIZE_POW;
+      options.distribution = (DistributionType)d;
+      options.mixing = (MixingMode)m;
+      fractal.setOptions(options);
+
+      double generateTime = 0.0, normalsTime = 0.0, errorsTime = 0.0;
+
+      for (int x = 0; x < grid; ++x)
+      {
+        for (int z = 0; z < grid; ++z)
+        {
+          TerrainQuad *quad = new TerrainQuad(x, z);
+          quads[x * grid + z] = quad;
+
+          TerrainQuad* neighbors[4] = { NULL };
+          if (z > 0)
+            neighbors[0] = quads[x * grid + z-1];
+          if (x > 0)
+            neighbors[3] = quads[(x-1) * grid + z];
+
+          double t = now();
+          quad->generate(scale, &fractal);
+          double t2 = now();
+          quad->calculateNormals(neighbors, scale);
+          double t3 = now();
+          quad->calculatePatchErrors();
+          double t4 = now();
+
+          generateTime += t2 - t;
+          normalsTime += t3 - t2;
+          errorsTime += t4 - t3;
+
+          ok = ok && finiteHeights(quad);
+        }
+      }
+
+      const int count = grid * grid;
+      double quadsPerSecond = count / (generateTime + normalsTime + errorsTime);
+      double generateNs = 1e9 * generateTime / (count * samples);
+      double normalsNs = 1e9 * normalsTime / (count * samples);
+      double errorsNs = 1e9 * errorsTime / (count * samples);
+      double memory = quads[0]->memoryUsage() / 1024.0;
+
+      cout << setw(10) << DISTRIBUTION_NAMES[d] << setw(8) << MIXING_NAMES[m]
+           << fixed << setprecision(1) << setw(10) << quadsPerSecond
+           << setprecision(2) << setw(16) << generateNs << setw(16) << normalsNs
+           << setw(16) << errorsNs << setprecision(1) << setw(14) << memory << endl;
+
+      string name = string("quad/") + DISTRIBUTION_NAMES[d] + "/" + MIXING_NAMES[m];
+      record(name + "/rate", quadsPerSecond, "quads/s");
+      record(name + "/generate", generateNs, "ns/sample");
+      record(name + "/normals", normalsNs, "ns/sample");
+      record(name + "/errors", errorsNs, "ns/sample");
+      record(name + "/memory", quads[0]->memoryUsage(), "bytes/quad");
+
+      for (unsigned int i = 0; i < quads.size(); ++i)
+      {
+        delete quads[i];
+        quads[i] = NULL;
+      }
+    }
+  }
+
+  const int SIZES[4] = { 5, 7, 9, 11 };
+
+  cout << endl << "Fractal::generate per sample [ns]" << endl;
+  cout << setw(10) << "distrib." << setw(8) << "mixing";
+  for (int s = 0; s < 4; ++s)
+    cout << setw(8) << "size " << setw(2) << SIZES[s];
+  cout << endl;
+
+  for (int d = 0; d < 3; ++d)
+  {
+    for (int m = 0; m < 2; ++m)
+    {
+      cout << setw(10) << DISTRIBUTION_NAMES[d] << setw(8) << MIXING_NAMES[m];
+
+      for (int s = 0; s < 4; ++s)
+      {
+        Fractal fractal;
+        FractalOptions options = fractal.options();
+        options.size = SIZES[s];
+        options.distribution = (DistributionType)d;
+        options.mixing = (MixingMode)m;
+        fractal.setOptions(options);
+
+        int runs = runCount(SIZES[s]);
+        double time = 0.0;
+        for (int run = 0; run < runs; ++run)
+        {
+          fractal.clear();
+          double t = now();
+          fractal.generate(1000 + run);
+          time += now() - t;
+        }
+
+        double ns = 1e9 * time / ((double)runs * fractal.size() * fractal.size());
+        cout << fixed << setprecision(2) << setw(10) << ns;
+
+        ostringstream name;
+        name << "fractal/" << DISTRIBUTION_NAMES[d] << "/" << MIXING_NAMES[m] << "/size" << SIZES[s];
+        record(name.str(), ns, "ns/sample");
+      }
+
+      cout << endl;
+    }
+  }
+
+  return ok;
+}
+
+// Stands for Map::Quad in the lookup benchmark
+struct LookupItem
+{
+  int x, z;
+};
+
+typedef map< pair<int, int>, LookupItem* > LookupMap;
+
+// Shared by the lookup threads
+struct LookupState
+{
+  // 0: map and SDL_mutex, 1: QuadTable
+  int mode;
+  int stop;
+  int gridSize;
+
+  LookupMap map;
+  SDL_mutex *mutex;
+  QuadTable<LookupItem> table;
+  vector<int> readers;
+};
+
+struct LookupThread
+{
+  LookupState *state;
+  int reader;
+  unsigned int seed;
+  long long lookups;
+  long long found;
+};
+
+// Lookups made between QuadTable::beginRead() and endRead(), like in a single task of Map
+const int LOOKUPS_PER_READ = 64;
+
+int lookupThread(void *data)
+{
+  LookupThread *thread = (LookupThread*)(data);
+  LookupState *state = thread->state;
+
+  unsigned int seed = thread->seed;
+  long long lookups = 0, found = 0;
+
+  while (!atomicLoad(&state->stop))
+  {
+    if (state->mode == 1)
+      state->table.beginRead(thread->reader);
+
+    for (int i = 0; i < LOOKUPS_PER_READ; ++i)
+    {
+      seed = seed * 1103515245 + 12345;
+      int x = (seed >> 8) % state->gridSize;
+      int z = (seed >> 20) % state->gridSize;
+
+      LookupItem *item = NULL;
+      if (state->mode == 0)
+      {
+        SDL_mutexP(state->mutex);
+        LookupMap::iterator it = state->map.find(make_pair(x, z));
+        if (it != state->map.end())
+          item = (*it).second;
+        SDL_mutexV(state->mutex);
+      }
+      else
+      {
+        item = state->table.find(x, z);
+      }
+
+      if (item != NULL)
+        ++found;
+    }
+
+    if (state->mode == 1)
+      state->table.endRead(thread->reader);
+
+    lookups += LOOKUPS_PER_READ;
+  }
+
+  thread->lookups = lookups;
+  thread->found = found;
+
+  return 0;
+}
+
+// Lookups per second of readerCount threads, while the main thread keeps replacing quads
+double runLookups(LookupState &state, vector<LookupItem> &items, int readerCount)
+{
+  const double duration = 0.5;
+
+  atomicStore(&state.stop, 0);
+
+  vector<LookupThread> threads(readerCount);
+  vector<SDL_Thread*> handles(readerCount);
+  for (int i = 0; i < readerCount; ++i)
+  {
+    threads[i].state = &state;
+    threads[i].reader = state.readers[i];
+    threads[i].seed = 1234 + 77 * i;
+    threads[i].lookups = threads[i].found = 0;
+    handles[i] = SDL_CreateThread(lookupThread, &threads[i]);
+  }
+
+  // Each update removes a quad and adds it back, as Map::update does with evicted ones
+  double start = now();
+  int updates = 0;
+  while (now() - start < duration)
+  {
+    LookupItem *item = &items[updates % items.size()];
+
+    if (state.mode == 0)
+    {
+      SDL_mutexP(state.mutex);
+      state.map.erase(make_pair(item->x, item->z));
+      state.map[make_pair(item->x, item->z)] = item;
+      SDL_mutexV(state.mutex);
+    }
+    else
+    {
+      state.table.erase(item->x, item->z);
+      state.table.insert(item->x, item->z, item);
+    }
+
+    ++updates;
+  }
+
+  atomicStore(&state.stop, 1);
+  double elapsed = now() - start;
+
+  long long lookups = 0;
+  for (int i = 0; i < readerCount; ++i)
+  {
+    SDL_WaitThread(handles[i], NULL);
+    lookups += threads[i].lookups;
+  }
+
+  return lookups / elapsed;
+}
+
+bool benchmarkLookup()
+{
+  LookupState state;
+  state.gridSize = 10;
+  state.mutex = SDL_CreateMutex();
+
+  // The 100 quads kept by Map
+  vector<LookupItem> items(state.gridSize * state.gridSize);
+  for (int x = 0; x < state.gridSize; ++x)
+  {
+    for (int z = 0; z < state.gridSize; ++z)
+    {
+      LookupItem *item = &items[x * state.gridSize + z];
+      item->x = x;
+      item->z = z;
+      state.map[make_pair(x, z)] = item;
+      state.table.insert(x, z, item);
+    }
+  }
+
+  const int READER_COUNTS[] = { 1, 2, 4, 8 };
+
+  for (int i = 0; i < 8; ++i)
+    state.readers.push_back(state.table.registerReader());
+
+  cout << endl << "Quad lookups with the main thread replacing quads" << endl;
+  cout << setw(10) << "readers" << setw(20) << "map+mutex [M/s]"
+       << setw(20) << "QuadTable [M/s]" << setw(10) << "speedup" << endl;
+
+  for (int i = 0; i < 4; ++i)
+  {
+    state.mode = 0;
+    double locked = runLookups(state, items, READER_COUNTS[i]);
+    state.mode = 1;
+    double lockFree = runLookups(state, items, READER_COUNTS[i]);
+
+    cout << setw(10) << READER_COUNTS[i] << fixed << setprecision(2)
+         << setw(20) << locked * 1e-6 << setw(20) << lockFree * 1e-6
+         << setw(10) << lockFree / locked << endl;
+
+    ostringstream name;
+    name << "lookup/readers" << READER_COUNTS[i];
+    record(name.str() + "/locked", locked * 1e-6, "M/s");
+    record(name.str() + "/lockfree", lockFree * 1e-6, "M/s");
+  }
+
+  bool ok = state.table.size() == (int)items.size();
+  for (unsigned int i = 0; i < items.size(); ++i)
+    ok = ok && (state.table.find(items[i].x, items[i].z) == &items[i]);
+
+  SDL_DestroyMutex(state.mutex);
+
+  return ok;
+}
+
+// Synthetic height field for the occlusion test: a valley, a ridge across it and hills behind
+struct OcclusionField
+{
+  int size;
+  float tile;
+  vector<float> values;
+
+  inline float vertex(int x, int z) const
+    { return values[x * (size+1) + z]; }
+
+  // Height at (x, z) [world units], on the same triangles as Map draws
+  float height(float x, float z) const
+  {
+    x /= tile;
+    z /= tile;
+    int cx = min(max((int)floor(x), 0), size - 1);
+    int cz = min(max((int)floor(z), 0), size - 1);
+    float u = x - cx, v = z - cz;
+
+    float h00 = vertex(cx, cz), h10 = vertex(cx+1, cz);
+    float h11 = vertex(cx+1, cz+1), h01 = vertex(cx, cz+1);
+
+    if (u >= v)
+      return h00 + u * (h10 - h00) + v * (h11 - h10);
+    return h00 + v * (h01 - h00) + u * (h11 - h01);
+  }
+
+  // Whether the segment from eye to point passes below the terrain somewhere
+  bool hidden(const Vector3D &eye, const Vector3D &point) const
+  {
+    const int STEPS = 2000;
+    for (int i = 1; i < STEPS; ++i)
+    {
+      float t = (float)i / STEPS;
+      float x = eye.x + t * (point.x - eye.x);
+      float y = eye.y + t * (point.y - eye.y);
+      float z = eye.z + t * (point.z - eye.z);
+      if (height(x, z) > y)
+        return true;
+    }
+    return false;
+  }
+};
+
+struct OcclusionPatch
+{
+  float distance;
+  int px, pz;
+
+  inline bool operator<(const OcclusionPatch &other) const
+    { return distance < other.distance; }
+};
+
+bool benchmarkOcclusion()
+{
+  const int PATCH_SIZE = 32, CELL_SIZE = 8, PATCH_LEVEL = 2;
+
+  OcclusionField field;
+  field.size = 256;
+  field.tile = 10.0f;
+  field.values.resize((field.size+1) * (field.size+1));
+
+  srand(1);
+  for (int x = 0; x <= field.size; ++x)
+  {
+    for (int z = 0; z <= field.size; ++z)
+    {
+      float ridge = 300.0f * exp(-0.01f * (x - 80) * (x - 80));
+      float hills = 100.0f + 80.0f * sin(0.05f * x) * cos(0.07f * z);
+      float noise = 5.0f * rand() / RAND_MAX;
+      field.values[x * (field.size+1) + z] = ridge + ((x > 80) ? hills : 0.0f) + noise;
+    }
+  }
+
+  HeightPyramid pyramid;
+  pyramid.build(&field.values[0], field.size, CELL_SIZE, 1.0f);
+
+  const int patches = field.size / PATCH_SIZE;
+  const float patchWorld = PATCH_SIZE * field.tile;
+  const Vector3D eye(200.0f, 120.0f, 0.5f * field.size * field.tile);
+
+  vector<OcclusionPatch> order;
+  for (int px = 0; px < patches; ++px)
+  {
+    for (int pz = 0; pz < patches; ++pz)
+    {
+      float dx = max(0.0f, max(px * patchWorld - eye.x, eye.x - (px+1) * patchWorld));
+      float dz = max(0.0f, max(pz * patchWorld - eye.z, eye.z - (pz+1) * patchWorld));
+
+      OcclusionPatch patch;
+      patch.distance = sqrt(dx * dx + dz * dz);
+      patch.px = px;
+      patch.pz = pz;
+      order.push_back(patch);
+    }
+  }
+  sort(order.begin(), order.end());
+
+  HorizonCuller culler;
+  vector<bool> occluded(order.size());
+  int occludedCount = 0;
+
+  const int runs = 100;
+  double start = now();
+  for (int run = 0; run < runs; ++run)
+  {
+    culler.reset(eye);
+    occludedCount = 0;
+
+    for (unsigned int i = 0; i < order.size(); ++i)
+    {
+      int px = order[i].px, pz = order[i].pz;
+
+      Vector3D minValues(px * patchWorld, pyramid.minHeight(PATCH_LEVEL, px, pz), pz * patchWorld);
+      Vector3D maxValues((px+1) * patchWorld, pyramid.maxHeight(PATCH_LEVEL, px, pz), (pz+1) * patchWorld);
+
+      occluded[i] = culler.occluded(minValues, maxValues);
+      if (occluded[i])
+        ++occludedCount;
+
+      const int cells = PATCH_SIZE / CELL_SIZE;
+      const float cellWorld = CELL_SIZE * field.tile;
+      for (int cx = px * cells; cx < (px+1) * cells; ++cx)
+      {
+        for (int cz = pz * cells; cz < (pz+1) * cells; ++cz)
+        {
+          culler.addOccluder(cx * cellWorld, cz * cellWorld, (cx+1) * cellWorld, (cz+1) * cellWorld,
+                             pyramid.minHeight(0, cx, cz));
+        }
+      }
+    }
+  }
+  double elapsed = (now() - start) / runs;
+
+  // Every vertex of an occluded patch must really be hidden behind the terrain
+  int wrong = 0;
+  for (unsigned int i = 0; i < order.size(); ++i)
+  {
+    if (!occluded[i])
+      continue;
+
+    int x0 = order[i].px * PATCH_SIZE, z0 = order[i].pz * PATCH_SIZE;
+    bool visible = false;
+    for (int x = x0; (x <= x0 + PATCH_SIZE) && (!visible); ++x)
+    {
+      for (int z = z0; (z <= z0 + PATCH_SIZE) && (!visible); ++z)
+      {
+        Vector3D point(x * field.tile, field.vertex(x, z), z * field.tile);
+        visible = !field.hidden(eye, point);
+      }
+    }
+
+    if (visible)
+      ++wrong;
+  }
+
+  cout << endl << "Horizon occlusion culling of " << order.size() << " patches behind a ridge" << endl;
+  cout << "  occluded: " << occludedCount << ", wrongly occluded: " << wrong
+       << ", time: " << fixed << setprecision(3) << elapsed * 1e3 << " ms" << endl;
+
+  record("occlusion/occluded", occludedCount, "patches");
+  record("occlusion/wrong", wrong, "patches");
+  record("occlusion/time", elapsed * 1e3, "ms");
+
+  return (wrong == 0) && (occludedCount > 0);
+}
+
+int main(int argc, char **argv)
+{
+  bool ok = benchmarkFractal();
+  ok = benchmarkNormals() && ok;
+  ok = benchmarkQuads() && ok;
+  ok = benchmarkLookup() && ok;
+  ok = benchmarkOcclusion() && ok;
+
+  if ((argc > 1) && (!saveResults(argv[1])))
+  {
+    cerr << "Could not write " << argv[1] << endl;
+    ok = false;
+  }
+
+  return ok ? 0 : 1;
+}
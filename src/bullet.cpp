@@ -15,18 +15,14 @@ const float Bullet::BULLET_DECAY_DISTANCE = 10000.0f;
 Bullet::Bullet(const Vector3D& pPosition, const Vector3D& pVelocity,
                const Vector3D& pSide, const Vector3D& pUp)
 {
-  _startPosition = _position = pPosition;
+  _position = pPosition;
   _velocity = pVelocity;
   _side = pSide;
   _up = pUp;
-  _decayed = false;
 }
 
 void Bullet::render()
 {
-  if (_decayed)
-    return;
-
   glColor3f(0.87f, 0.66f, 0.18f);
 
   Vector3D v1 = _position;
@@ -55,14 +51,3 @@ void Bullet::render()
   }
   glEnd();
 }
-
-void Bullet::update(float deltaT)
-{
-  if (_decayed)
-    return;
-
-  _position += _velocity * deltaT;
-
-  if ((_position - _startPosition).length() > BULLET_DECAY_DISTANCE)
-    _decayed = true;
-}
@@ -10,26 +10,29 @@
 
 #include "common.h"
 
+/* A new bullet, or a copy of one to render; the bullets in flight are
+   moved by the EntityStore of the World */
 class Bullet
 {
+  public:
+    // Distance after which a bullet decays
+    static const float BULLET_DECAY_DISTANCE;
+
   public:
     Bullet(const Vector3D &pPosition, const Vector3D &pVelocity,
            const Vector3D &pSide, const Vector3D &pUp);
 
-    inline void setDecayed()
-      { _decayed = true; }
-    inline bool decayed() const
-      { return _decayed; }
     const Vector3D position() const
       { return _position; }
+    const Vector3D velocity() const
+      { return _velocity; }
+    const Vector3D side() const
+      { return _side; }
+    const Vector3D up() const
+      { return _up; }
 
     void render();
 
-    void update(float deltaT);
-
   private:
-    bool _decayed;
     Vector3D _position, _velocity, _side, _up;
-    Vector3D _startPosition;
-    static const float BULLET_DECAY_DISTANCE;
 };
@@ -357,6 +357,27 @@ Time* Time::currentTime()
   return result;
 }
 
+long long Time::nanoseconds()
+{
+  #if defined(__linux__)
+
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_nsec + 1000000000ll * t.tv_sec;
+
+  #elif defined(WIN32) || defined(_WIN32)
+
+  FILETIME t;
+  GetSystemTimeAsFileTime(&t);
+  return 100 * (((long long)t.dwHighDateTime << 32) + t.dwLowDateTime);
+
+  #else
+
+  return 1000000ll * SDL_GetTicks();
+
+  #endif
+}
+
 int Time::resolution()
 {
   #if defined(__linux__)
@@ -400,6 +421,42 @@ long long Time::difference(Time *other)
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 
+#if defined(__linux__)
+
+#include <unistd.h>
+
+int processorCount()
+{
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  if (count < 1)
+    return 1;
+  return (int)count;
+}
+
+#elif defined(WIN32) || defined(_WIN32)
+
+int processorCount()
+{
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  if (info.dwNumberOfProcessors < 1)
+    return 1;
+  return (int)info.dwNumberOfProcessors;
+}
+
+#else
+
+int processorCount()
+{
+  return 1;
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+
 Timer::Timer(unsigned long long pInterval)
 {
   _intervalBeginTime = _intervalEndTime = NULL;
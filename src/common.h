@@ -225,6 +225,9 @@ class Time
 
     static Time* currentTime();
 
+    // Current time [ns] of the same clock, without creating a Time object
+    static long long nanoseconds();
+
     // Result in nanoseconds
     long long difference(Time *other);
 
@@ -232,6 +235,9 @@ class Time
     TimePrivate *_private;
 };
 
+// Returns the number of processors available to the program (at least 1)
+int processorCount();
+
 // Tells whether a given time interval has passed
 class Timer
 {
@@ -276,6 +282,93 @@ class Timer
     bool _enabled;
 };
 
+/* Tells whether a given interval of simulated time has passed; unlike
+   Timer, it is advanced by the steps of the simulation, not by the clock */
+class StepTimer
+{
+  public:
+    explicit StepTimer(float pInterval = 0.0f) : _interval(pInterval), _elapsed(0.0f) {}
+
+    inline void reset()
+      { _elapsed = 0.0f; }
+
+    // Interval [s]
+    inline float interval() const
+      { return _interval; }
+    inline void setInterval(float pInterval)
+      { _interval = pInterval; }
+    inline void setIntervalMsec(unsigned int pInterval)
+      { _interval = pInterval / 1000.0f; }
+
+    /* Adds a step of delta [s]; returns true (and starts again) on the step
+       nearest to the end of the interval */
+    inline bool checkTimeout(float delta)
+    {
+      _elapsed += delta;
+      if (_elapsed < _interval - 0.5f * delta)
+        return false;
+      _elapsed = 0.0f;
+      return true;
+    }
+
+  private:
+    float _interval, _elapsed;
+};
+
+// FNV-1a hash of the bytes of the added values
+class Hash
+{
+  public:
+    Hash() : _value(14695981039346656037ULL) {}
+
+    template<typename T>
+    void add(const T &data)
+    {
+      const unsigned char *bytes = (const unsigned char*)(&data);
+      for (unsigned int i = 0; i < sizeof(T); ++i)
+      {
+        _value ^= bytes[i];
+        _value *= 1099511628211ULL;
+      }
+    }
+
+    inline unsigned long long value() const
+      { return _value; }
+
+  private:
+    unsigned long long _value;
+};
+
+/* Pseudo-random numbers (xorshift) of a given seed; unlike rand(), the
+   sequence is the same on every platform and is not shared with others */
+class Random
+{
+  public:
+    explicit Random(unsigned int pSeed = 1)
+      { seed(pSeed); }
+
+    inline void seed(unsigned int pSeed)
+      { _state = (pSeed != 0) ? pSeed : 0x9e3779b9u; }
+
+    inline unsigned int state() const
+      { return _state; }
+
+    inline unsigned int next()
+    {
+      _state ^= _state << 13;
+      _state ^= _state >> 17;
+      _state ^= _state << 5;
+      return _state;
+    }
+
+    // Integer from 0 to n-1
+    inline int integer(int n)
+      { return (int)(next() % (unsigned int)n); }
+
+  private:
+    unsigned int _state;
+};
+
 template<class T>
 std::string toString(T value, bool *ok = NULL)
 {
@@ -0,0 +1,283 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* entitystore.cpp
+    Contains the implementation of the EntityStore class. */
+
+#include "entitystore.h"
+
+#include "player.h"
+
+#include <algorithm>
+
+using namespace std;
+
+
+void HandleTable::clear()
+{
+  // Handles given before stay invalid: the slots get new generations
+  while (_count > 0)
+    removeAt(_count - 1);
+
+  _indexSlot.clear();
+}
+
+void HandleTable::reserve(unsigned int count)
+{
+  _slotIndex.reserve(count);
+  _slotGeneration.reserve(count);
+  _indexSlot.reserve(count);
+  _freeSlots.reserve(count);
+}
+
+EntityHandle HandleTable::add()
+{
+  unsigned int slot = 0;
+  if (!_freeSlots.empty())
+  {
+    slot = _freeSlots.back();
+    _freeSlots.pop_back();
+  }
+  else
+  {
+    slot = _slotIndex.size();
+    _slotIndex.push_back(0);
+    _slotGeneration.push_back(1);
+  }
+
+  _slotIndex[slot] = _count;
+  if (_indexSlot.size() <= _count)
+    _indexSlot.push_back(slot);
+  else
+    _indexSlot[_count] = slot;
+  ++_count;
+
+  EntityHandle handle;
+  handle.slot = slot;
+  handle.generation = _slotGeneration[slot];
+  return handle;
+}
+
+void HandleTable::removeAt(unsigned int index)
+{
+  unsigned int slot = _indexSlot[index];
+  unsigned int last = _count - 1;
+
+  // The last entity takes the place of the removed one
+  _indexSlot[index] = _indexSlot[last];
+  _slotIndex[_indexSlot[index]] = index;
+  --_count;
+
+  ++_slotGeneration[slot];
+  if (_slotGeneration[slot] == 0)
+    _slotGeneration[slot] = 1;
+  _freeSlots.push_back(slot);
+}
+
+int HandleTable::index(const EntityHandle &handle) const
+{
+  if ((handle.slot >= _slotIndex.size()) || (_slotGeneration[handle.slot] != handle.generation))
+    return -1;
+
+  return _slotIndex[handle.slot];
+}
+
+EntityHandle HandleTable::handle(unsigned int index) const
+{
+  EntityHandle handle;
+  handle.slot = _indexSlot[index];
+  handle.generation = _slotGeneration[handle.slot];
+  return handle;
+}
+
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+
+EntityStore::EntityStore()
+{
+  setBulletCapacity(DEFAULT_BULLET_CAPACITY);
+}
+
+void EntityStore::clear()
+{
+  _aircraft.clear();
+  _aircraftPlayer.clear();
+  _aircraftPosition.clear();
+  _aircraftVelocity.clear();
+  _aircraftDirection.clear();
+  _aircraftHp.clear();
+  _aircraftTeam.clear();
+
+  // The pool stays allocated
+  _bullets.clear();
+}
+
+template<class T>
+void EntityStore::moveLast(std::vector<T> &array, unsigned int index)
+{
+  array[index] = array.back();
+  array.pop_back();
+}
+
+EntityHandle EntityStore::addAircraft(Player *player)
+{
+  EntityHandle handle = _aircraft.add();
+
+  _aircraftPlayer.push_back(player);
+  _aircraftPosition.push_back(player->actualPosition());
+  _aircraftVelocity.push_back(player->velocityVector());
+  _aircraftDirection.push_back(player->rotation().mainAxis());
+  _aircraftHp.push_back(player->hp());
+  _aircraftTeam.push_back(player->team());
+
+  return handle;
+}
+
+void EntityStore::removeAircraft(const EntityHandle &handle)
+{
+  int index = _aircraft.index(handle);
+  if (index < 0)
+    return;
+
+  _aircraft.removeAt(index);
+  moveLast(_aircraftPlayer, index);
+  moveLast(_aircraftPosition, index);
+  moveLast(_aircraftVelocity, index);
+  moveLast(_aircraftDirection, index);
+  moveLast(_aircraftHp, index);
+  moveLast(_aircraftTeam, index);
+}
+
+void EntityStore::syncAircraft()
+{
+  for (unsigned int i = 0; i < _aircraft.count(); ++i)
+  {
+    const Player *p = _aircraftPlayer[i];
+    _aircraftPosition[i] = p->actualPosition();
+    _aircraftVelocity[i] = p->velocityVector();
+    _aircraftDirection[i] = p->rotation().mainAxis();
+    _aircraftHp[i] = p->hp();
+    _aircraftTeam[i] = p->team();
+  }
+}
+
+void EntityStore::setBulletCapacity(unsigned int capacity)
+{
+  _bullets = HandleTable();
+  _bullets.reserve(capacity);
+  _bulletCapacity = capacity;
+
+  _bulletPosition.assign(capacity, Vector3D());
+  _bulletVelocity.assign(capacity, Vector3D());
+  _bulletStart.assign(capacity, Vector3D());
+  _bulletSide.assign(capacity, Vector3D());
+  _bulletUp.assign(capacity, Vector3D());
+  _bulletDecayed.assign(capacity, 0);
+
+  _bulletHighWater = 0;
+  _bulletAllocations = _bulletDrops = 0;
+}
+
+EntityHandle EntityStore::addBullet(const Bullet &bullet)
+{
+  if (_bullets.count() >= _bulletCapacity)
+  {
+    ++_bulletDrops;
+    return EntityHandle();
+  }
+
+  EntityHandle handle = _bullets.add();
+  unsigned int i = _bullets.count() - 1;
+
+  _bulletPosition[i] = bullet.position();
+  _bulletVelocity[i] = bullet.velocity();
+  _bulletStart[i] = bullet.position();
+  _bulletSide[i] = bullet.side();
+  _bulletUp[i] = bullet.up();
+  _bulletDecayed[i] = 0;
+
+  ++_bulletAllocations;
+  _bulletHighWater = max(_bulletHighWater, _bullets.count());
+
+  return handle;
+}
+
+unsigned int EntityStore::addBullets(const std::vector<Bullet> &bullets)
+{
+  unsigned int added = 0;
+  for (unsigned int i = 0; i < bullets.size(); ++i)
+  {
+    if (addBullet(bullets[i]).valid())
+      ++added;
+  }
+  return added;
+}
+
+void EntityStore::updateBullets(float delta)
+{
+  const float decay2 = Bullet::BULLET_DECAY_DISTANCE * Bullet::BULLET_DECAY_DISTANCE;
+
+  for (unsigned int i = 0; i < _bullets.count(); ++i)
+  {
+    Vector3D &pos = _bulletPosition[i];
+    const Vector3D &vel = _bulletVelocity[i];
+    pos.x += vel.x * delta;
+    pos.y += vel.y * delta;
+    pos.z += vel.z * delta;
+
+    const Vector3D &start = _bulletStart[i];
+    float dx = pos.x - start.x, dy = pos.y - start.y, dz = pos.z - start.z;
+    if (dx * dx + dy * dy + dz * dz > decay2)
+      _bulletDecayed[i] = 1;
+  }
+}
+
+void EntityStore::removeBulletAt(unsigned int index)
+{
+  unsigned int last = _bullets.count() - 1;
+  _bullets.removeAt(index);
+
+  _bulletPosition[index] = _bulletPosition[last];
+  _bulletVelocity[index] = _bulletVelocity[last];
+  _bulletStart[index] = _bulletStart[last];
+  _bulletSide[index] = _bulletSide[last];
+  _bulletUp[index] = _bulletUp[last];
+  _bulletDecayed[index] = _bulletDecayed[last];
+}
+
+unsigned int EntityStore::removeDecayedBullets()
+{
+  unsigned int removed = 0;
+
+  // From the end, so that the bullets moved in place were already checked
+  for (unsigned int i = _bullets.count(); i > 0; --i)
+  {
+    if (_bulletDecayed[i - 1] != 0)
+    {
+      removeBulletAt(i - 1);
+      ++removed;
+    }
+  }
+
+  return removed;
+}
+
+Bullet EntityStore::bullet(unsigned int i) const
+{
+  return Bullet(_bulletPosition[i], _bulletVelocity[i], _bulletSide[i], _bulletUp[i]);
+}
+
+EntityStore::BulletPoolStats EntityStore::bulletPoolStats() const
+{
+  BulletPoolStats stats;
+  stats.capacity = _bulletCapacity;
+  stats.live = _bullets.count();
+  stats.highWater = _bulletHighWater;
+  stats.allocations = _bulletAllocations;
+  stats.recycled = _bulletAllocations - _bullets.slotCount();
+  stats.dropped = _bulletDrops;
+  return stats;
+}
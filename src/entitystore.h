@@ -0,0 +1,188 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* entitystore.h
+    Contains the EntityStore class, which keeps the aircraft and bullets
+    of the World in packed arrays. */
+
+#pragma once
+
+#include "config.h"
+
+#include "common.h"
+#include "bullet.h"
+
+#include <vector>
+
+class Player;
+
+// Refers to an entity of an EntityStore, wherever it is moved in the arrays
+struct EntityHandle
+{
+  unsigned int slot, generation;
+
+  EntityHandle() : slot(0), generation(0) {}
+
+  // Generations start from 1, so a default handle refers to nothing
+  inline bool valid() const
+    { return generation != 0; }
+
+  inline bool operator==(const EntityHandle &h) const
+    { return (slot == h.slot) && (generation == h.generation); }
+};
+
+/* Maps handles to indexes of entities in packed arrays. A removed entity
+   is replaced by the last one, so the arrays have no holes; the slot of its
+   handle gets a new generation, so old handles no longer find anything. */
+class HandleTable
+{
+  public:
+    HandleTable() : _count(0) {}
+
+    void clear();
+
+    // Makes room for the given count of entities at once
+    void reserve(unsigned int count);
+
+    inline unsigned int count() const
+      { return _count; }
+
+    // Slots made so far; the rest of the handles reuse freed ones
+    inline unsigned int slotCount() const
+      { return _slotIndex.size(); }
+
+    // Handle of a new entity, which is to be put at index count() - 1
+    EntityHandle add();
+
+    /* Frees the handle of the entity at the index; the owner of the arrays
+       moves the last entity there */
+    void removeAt(unsigned int index);
+
+    // Index of the entity, or -1 if it was removed
+    int index(const EntityHandle &handle) const;
+
+    EntityHandle handle(unsigned int index) const;
+
+  private:
+    unsigned int _count;
+    std::vector<unsigned int> _slotIndex, _slotGeneration;
+    std::vector<unsigned int> _indexSlot;
+    std::vector<unsigned int> _freeSlots;
+};
+
+/* Structure of arrays: the state of the aircraft (copied from their
+   Players after each step) and of the bullets (kept only here) lies in
+   separate contiguous arrays, so the sweeps of a step (moving bullets,
+   hit tests, aiming) read memory in order instead of following pointers.
+   Bullets form a pool of fixed capacity: its arrays are allocated once,
+   and the slots of decayed bullets are reused through a free list. */
+class EntityStore
+{
+  public:
+    static const unsigned int DEFAULT_BULLET_CAPACITY = 16384;
+
+    // State of the bullet pool, for monitoring
+    struct BulletPoolStats
+    {
+      unsigned int capacity, live, highWater;
+      // Bullets added since setBulletCapacity(), those in reused slots and those not fitting
+      unsigned long long allocations, recycled, dropped;
+    };
+
+  public:
+    EntityStore();
+
+    // Removes all aircraft and bullets
+    void clear();
+
+    // Aircraft
+
+    EntityHandle addAircraft(Player *player);
+    void removeAircraft(const EntityHandle &handle);
+
+    // Copies the position, velocity, direction, HP and team of every player
+    void syncAircraft();
+
+    inline unsigned int aircraftCount() const
+      { return _aircraft.count(); }
+    inline int aircraftIndex(const EntityHandle &handle) const
+      { return _aircraft.index(handle); }
+
+    inline Player* aircraftPlayer(unsigned int i) const
+      { return _aircraftPlayer[i]; }
+    // Position in the world, not in the quad
+    inline const Vector3D& aircraftPosition(unsigned int i) const
+      { return _aircraftPosition[i]; }
+    inline const Vector3D& aircraftVelocity(unsigned int i) const
+      { return _aircraftVelocity[i]; }
+    // Main axis of the rotation
+    inline const Vector3D& aircraftDirection(unsigned int i) const
+      { return _aircraftDirection[i]; }
+    inline int aircraftHp(unsigned int i) const
+      { return _aircraftHp[i]; }
+    inline int aircraftTeam(unsigned int i) const
+      { return _aircraftTeam[i]; }
+
+    // Lowers the HP kept here after a hit, until the next syncAircraft()
+    inline void damageAircraft(unsigned int i)
+      { --_aircraftHp[i]; }
+
+    // Bullets
+
+    // Allocates the pool; removes all bullets and starts the statistics again
+    void setBulletCapacity(unsigned int capacity);
+    inline unsigned int bulletCapacity() const
+      { return _bulletCapacity; }
+
+    // Adds a bullet; the handle is not valid if the pool is full
+    EntityHandle addBullet(const Bullet &bullet);
+
+    // Adds a batch of bullets; returns the count of those which fitted
+    unsigned int addBullets(const std::vector<Bullet> &bullets);
+
+    // Moves the bullets by delta [s]; those which flew too far decay
+    void updateBullets(float delta);
+
+    inline void decayBullet(unsigned int i)
+      { _bulletDecayed[i] = 1; }
+
+    // Removes the decayed bullets; returns their count
+    unsigned int removeDecayedBullets();
+
+    inline unsigned int bulletCount() const
+      { return _bullets.count(); }
+    inline int bulletIndex(const EntityHandle &handle) const
+      { return _bullets.index(handle); }
+
+    inline const Vector3D& bulletPosition(unsigned int i) const
+      { return _bulletPosition[i]; }
+    inline bool bulletDecayed(unsigned int i) const
+      { return _bulletDecayed[i] != 0; }
+
+    // Copy of the bullet, e.g. to render it
+    Bullet bullet(unsigned int i) const;
+
+    BulletPoolStats bulletPoolStats() const;
+
+  private:
+    HandleTable _aircraft;
+    std::vector<Player*> _aircraftPlayer;
+    std::vector<Vector3D> _aircraftPosition, _aircraftVelocity, _aircraftDirection;
+    std::vector<int> _aircraftHp, _aircraftTeam;
+
+    // The arrays of bullets have the size of the pool; the first count() are used
+    HandleTable _bullets;
+    unsigned int _bulletCapacity;
+    std::vector<Vector3D> _bulletPosition, _bulletVelocity, _bulletStart;
+    std::vector<Vector3D> _bulletSide, _bulletUp;
+    std::vector<unsigned char> _bulletDecayed;
+    unsigned int _bulletHighWater;
+    unsigned long long _bulletAllocations, _bulletDrops;
+
+    template<class T>
+    static void moveLast(std::vector<T> &array, unsigned int index);
+
+    void removeBulletAt(unsigned int index);
+};
@@ -11,6 +11,7 @@
 #include "application.h"
 #include "render.h"
 #include "events.h"
+#include "profiler.h"
 
 #include <GL/gl.h>
 #include <GL/glu.h>
@@ -164,6 +165,8 @@ void Font::changeOptions(const FontOptions &newOptions)
 
 void Font::renderText(const string &text, const Point &location)
 {
+  ProfileScope scope("Text");
+
   if ((text.empty()) || (_font == NULL))
     return;
 
@@ -217,6 +220,8 @@ void Font::renderText(const string &text, const Point &location)
 
 void Font::renderTextUTF8(const string &text, const Point &location)
 {
+  ProfileScope scope("Text");
+
   if ((text.empty()) || (_font == NULL))
     return;
 
@@ -341,6 +346,8 @@ Size Font::staticTextMetrics(int id)
 
 void Font::renderStaticText(int id, const Point &location)
 {
+  ProfileScope scope("Text");
+
   if (_font == NULL)
     return;
 
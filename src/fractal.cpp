@@ -66,20 +66,24 @@ Fractal::~Fractal()
 
 void Fractal::newValues()
 {
-  _values = new float*[_valuesSize];
-  for (int i = 0; i < _valuesSize; ++i)
-    _values[i] = new float[_valuesSize];
+  int size = (_valuesSize - 1) / 2;
+  int nodeCount = (size * size * 4 - 1) / 3;
+
+  _values = new float[_valuesSize * _valuesSize];
+  _random = new float[4 + 5 * nodeCount];
+  _nodeOffsets = new int[size];
 }
 
 void Fractal::deleteValues()
 {
-  for (int i = 0; i < _valuesSize; ++i)
-  {
-    delete[] _values[i];
-    _values[i] = NULL;
-  }
   delete[] _values;
   _values = NULL;
+
+  delete[] _random;
+  _random = NULL;
+
+  delete[] _nodeOffsets;
+  _nodeOffsets = NULL;
 }
 
 void Fractal::setOptions(const FractalOptions& options)
@@ -123,7 +127,7 @@ float Fractal::value(int x, int y) const
   if ((x < 0) || (x >= _valuesSize) || (y < 0) || (y >= _valuesSize))
     return 0.0f;
 
-  return _values[x][y];
+  return _values[x * _valuesSize + y];
 }
 
 void Fractal::setValue(int x, int y, float value)
@@ -131,18 +135,13 @@ void Fractal::setValue(int x, int y, float value)
   if ((x < 0) || (x >= _valuesSize) || (y < 0) || (y >= _valuesSize))
     return;
 
-  _values[x][y] = value;
+  _values[x * _valuesSize + y] = value;
 }
 
 void Fractal::clear()
 {
-  for (int x = 0; x < _valuesSize; ++x)
-  {
-    for (int z = 0; z < _valuesSize; ++z)
-    {
-      _values[x][z] = -2.0f;
-    }
-  }
+  for (int i = 0; i < _valuesSize * _valuesSize; ++i)
+    _values[i] = -2.0f;
 }
 
 float Fractal::gauss(float x)
@@ -196,6 +195,29 @@ float Fractal::randomValue()
   return (value - _options.clampingMin) / (_options.clampingMax - _options.clampingMin);
 }
 
+float Fractal::randomValue(int seed)
+{
+  _rand = seed;
+  return randomValue();
+}
+
+void Fractal::mixing(int step, float &mixSingle, float &mixFourpoint)
+{
+  float midScale = ((float)step) / ((float)_valuesSize);
+
+  mixSingle = 0.0f;
+  if (_options.mixing == MM_Gauss)
+    mixSingle = 0.5f * gauss(midScale * _options.mixingTwopointGaussCutoff);
+  else if (_options.mixing == MM_Linear)
+    mixSingle = 0.5f - midScale * (0.5f - _options.mixingTwopointLinearMin);
+
+  mixFourpoint = 0.0f;
+  if (_options.mixing == MM_Gauss)
+    mixFourpoint = 0.25f * gauss(midScale * _options.mixingFourpointGaussCutoff);
+  else if (_options.mixing == MM_Linear)
+    mixFourpoint = 0.25f - midScale * (0.25f - _options.mixingFourpointLinearMin);
+}
+
 void Fractal::generateRecursive(int x1, int y1, int x2, int y2)
 {
   int midX = (x1 + x2) / 2;
@@ -209,24 +231,24 @@ void Fractal::generateRecursive(int x1, int y1, int x2, int y2)
     mixSingle = 0.5f - midScale * (0.5f - _options.mixingTwopointLinearMin);
 
   float v1 = (1.0f - 2.0f * mixSingle) * randomValue() +
-               mixSingle * (_values[x1][y1] + _values[x2][y1]);
-  if (_values[midX][y1] == -2.0f)
-    _values[midX][y1] = v1;
+               mixSingle * (at(x1, y1) + at(x2, y1));
+  if (at(midX, y1) == -2.0f)
+    at(midX, y1) = v1;
 
   float v2 = (1.0f - 2.0f * mixSingle) * randomValue() +
-               mixSingle * (_values[x1][y2] + _values[x2][y2]);
-  if (_values[midX][y2] == -2.0f)
-    _values[midX][y2] = v2;
+               mixSingle * (at(x1, y2) + at(x2, y2));
+  if (at(midX, y2) == -2.0f)
+    at(midX, y2) = v2;
 
   float v3 = (1.0f - 2.0f * mixSingle) * randomValue() +
-               mixSingle * (_values[x1][y1] + _values[x1][y2]);
-  if (_values[x1][midY] == -2.0f)
-    _values[x1][midY] = v3;
+               mixSingle * (at(x1, y1) + at(x1, y2));
+  if (at(x1, midY) == -2.0f)
+    at(x1, midY) = v3;
 
   float v4 = (1.0f - 2.0f * mixSingle) * randomValue() +
-               mixSingle * (_values[x2][y1] + _values[x2][y2]);
-  if (_values[x2][midY] == -2.0f)
-    _values[x2][midY] = v4;
+               mixSingle * (at(x2, y1) + at(x2, y2));
+  if (at(x2, midY) == -2.0f)
+    at(x2, midY) = v4;
 
   float mixFourpoint = 0.0f;
   if (_options.mixing == MM_Gauss)
@@ -235,11 +257,11 @@ void Fractal::generateRecursive(int x1, int y1, int x2, int y2)
     mixFourpoint = 0.25f - midScale * (0.25f - _options.mixingFourpointLinearMin);
 
   float vM = (1.0f - 4.0f * mixFourpoint) * randomValue() +
-               mixFourpoint * (_values[x1][y1] + _values[x1][y2] +
-                               _values[x2][y1] + _values[x2][y2]);
+               mixFourpoint * (at(x1, y1) + at(x1, y2) +
+                               at(x2, y1) + at(x2, y2));
 
-  if (_values[midX][midY] == -2.0f)
-    _values[midX][midY] = vM;
+  if (at(midX, midY) == -2.0f)
+    at(midX, midY) = vM;
 
   if (midX == x1 + 1)
     return;
@@ -251,24 +273,135 @@ void Fractal::generateRecursive(int x1, int y1, int x2, int y2)
 }
 
 void Fractal::generate(int seed)
+{
+  /* Iterative version of generateReference(): the quadtree is processed level
+     by level and each level row by row, which gives the same result, because:
+      - random values are drawn beforehand in the order of the recursion,
+      - every point is the midpoint of nodes of only one level,
+      - of the two nodes sharing an edge midpoint, the one with lower x (or y)
+        comes first in the recursion, so it is also the first one here. */
+
+  const int levels = _options.size;
+  const int last = _valuesSize - 1;
+
+  _rand = seed;
+
+  int randomCount = 4 + 5 * (((1 << (2 * levels)) - 1) / 3);
+  for (int i = 0; i < randomCount; ++i)
+    _random[i] = randomValue();
+
+  if (at(0, 0) == -2.0f)
+    at(0, 0) = _random[0];
+
+  if (at(0, last) == -2.0f)
+    at(0, last) = _random[1];
+
+  if (at(last, last) == -2.0f)
+    at(last, last) = _random[2];
+
+  if (at(last, 0) == -2.0f)
+    at(last, 0) = _random[3];
+
+  for (int level = 0; level < levels; ++level)
+  {
+    int count = 1 << level;
+    int step = last >> level;
+    int half = step / 2;
+
+    float mixSingle = 0.0f, mixFourpoint = 0.0f;
+    mixing(step, mixSingle, mixFourpoint);
+
+    float randomSingle = 1.0f - 2.0f * mixSingle;
+    float randomFourpoint = 1.0f - 4.0f * mixFourpoint;
+
+    /* Index of a node in the recursion is the sum of (1 + child * subtree size)
+       over its path; child = xBit + 2 * yBit, so the x and y parts of the sum
+       can be computed separately. */
+    for (int i = 0; i < count; ++i)
+    {
+      _nodeOffsets[i] = 0;
+      for (int bit = 0; bit < level; ++bit)
+      {
+        if (i & (1 << bit))
+          _nodeOffsets[i] += ((1 << (2 * (levels - level + bit))) - 1) / 3;
+      }
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+      float *row1 = &_values[(i * step) * _valuesSize];
+      float *rowM = row1 + half * _valuesSize;
+      float *row2 = row1 + step * _valuesSize;
+
+      for (int j = 0; j < count; ++j)
+      {
+        int y1 = j * step;
+        int midY = y1 + half;
+        int y2 = y1 + step;
+
+        int node = level + _nodeOffsets[i] + 2 * _nodeOffsets[j];
+        const float *random = &_random[4 + 5 * node];
+
+        float c11 = row1[y1], c12 = row1[y2];
+        float c21 = row2[y1], c22 = row2[y2];
+
+        if (rowM[y1] == -2.0f)
+          rowM[y1] = randomSingle * random[0] + mixSingle * (c11 + c21);
+
+        if (rowM[y2] == -2.0f)
+          rowM[y2] = randomSingle * random[1] + mixSingle * (c12 + c22);
+
+        if (row1[midY] == -2.0f)
+          row1[midY] = randomSingle * random[2] + mixSingle * (c11 + c12);
+
+        if (row2[midY] == -2.0f)
+          row2[midY] = randomSingle * random[3] + mixSingle * (c21 + c22);
+
+        if (rowM[midY] == -2.0f)
+          rowM[midY] = randomFourpoint * random[4] +
+                         mixFourpoint * (c11 + c12 + c21 + c22);
+      }
+    }
+  }
+}
+
+void Fractal::generateLine(int seed, float *line)
+{
+  const int last = _valuesSize - 1;
+
+  _rand = seed;
+
+  for (int step = last; step > 1; step /= 2)
+  {
+    float mixSingle = 0.0f, mixFourpoint = 0.0f;
+    mixing(step, mixSingle, mixFourpoint);
+
+    float randomSingle = 1.0f - 2.0f * mixSingle;
+
+    for (int i = 0; i < last; i += step)
+      line[i + step/2] = randomSingle * randomValue() + mixSingle * (line[i] + line[i + step]);
+  }
+}
+
+void Fractal::generateReference(int seed)
 {
   _rand = seed;
 
   float v1 = randomValue();
-  if (_values[0][0] == -2.0f)
-    _values[0][0] = v1;
+  if (at(0, 0) == -2.0f)
+    at(0, 0) = v1;
 
   float v2 = randomValue();
-  if (_values[0][_valuesSize-1] == -2.0f)
-    _values[0][_valuesSize-1] = v2;
+  if (at(0, _valuesSize-1) == -2.0f)
+    at(0, _valuesSize-1) = v2;
 
   float v3 = randomValue();
-  if (_values[_valuesSize-1][_valuesSize-1] == -2.0f)
-    _values[_valuesSize-1][_valuesSize-1] = v3;
+  if (at(_valuesSize-1, _valuesSize-1) == -2.0f)
+    at(_valuesSize-1, _valuesSize-1) = v3;
 
   float v4 = randomValue();
-  if (_values[_valuesSize-1][0] == -2.0f)
-    _values[_valuesSize-1][0] = v4;
+  if (at(_valuesSize-1, 0) == -2.0f)
+    at(_valuesSize-1, 0) = v4;
 
   generateRecursive(0, 0, _valuesSize - 1, _valuesSize - 1);
 }
@@ -71,18 +71,37 @@ class Fractal
     float value(int x, int y) const;
 
     void generate(int seed);
+    void generateReference(int seed);
+
+    /* Fills a line of size() values between line[0] and line[size()-1],
+       as generate() fills the edges of the square, with random values
+       drawn from seed */
+    void generateLine(int seed, float *line);
 
     float randomValue();
 
+    // First random value drawn from seed
+    float randomValue(int seed);
+
   private:
     unsigned int _rand;
     FractalOptions _options;
-    float **_values;
+    // Values stored row by row: (x, y) is at x * _valuesSize + y
+    float *_values;
     int _valuesSize;
+    // Random values used by generate(), in the order of generateRecursive()
+    float *_random;
+    int *_nodeOffsets;
+
+    inline float& at(int x, int y)
+      { return _values[x * _valuesSize + y]; }
 
     void generateRecursive(int x1, int y1, int x2, int y2);
     float gauss(float x);
 
+    // Weights of the neighbors of midpoints between points step apart
+    void mixing(int step, float &mixSingle, float &mixFourpoint);
+
     void newValues();
     void deleteValues();
 };
@@ -0,0 +1,89 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* frustum.cpp
+    Contains the implementation of the Frustum class. */
+
+#include "frustum.h"
+
+#include <cmath>
+
+using namespace std;
+
+Frustum::Frustum()
+{
+  // Everything is visible until the matrices are set
+  for (int i = 0; i < 6; ++i)
+  {
+    _planes[i][0] = _planes[i][1] = _planes[i][2] = 0.0f;
+    _planes[i][3] = 1.0f;
+  }
+}
+
+void Frustum::setMatrices(const float (&projection)[16], const float (&modelview)[16])
+{
+  // Clip matrix: projection * modelview, element (row r, column c) at [c*4 + r]
+  float clip[16];
+  for (int c = 0; c < 4; ++c)
+  {
+    for (int r = 0; r < 4; ++r)
+    {
+      clip[c*4 + r] = 0.0f;
+      for (int k = 0; k < 4; ++k)
+        clip[c*4 + r] += projection[k*4 + r] * modelview[c*4 + k];
+    }
+  }
+
+  // Planes are sums and differences of the last row with the other ones:
+  // left, right, bottom, top, near, far
+  for (int i = 0; i < 6; ++i)
+  {
+    int row = i / 2;
+    float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+
+    for (int c = 0; c < 4; ++c)
+      _planes[i][c] = clip[c*4 + 3] + sign * clip[c*4 + row];
+
+    float length = sqrt(_planes[i][0] * _planes[i][0] +
+                        _planes[i][1] * _planes[i][1] +
+                        _planes[i][2] * _planes[i][2]);
+    if (length > 0.0f)
+    {
+      for (int c = 0; c < 4; ++c)
+        _planes[i][c] /= length;
+    }
+  }
+}
+
+Frustum Frustum::translated(const Vector3D &offset) const
+{
+  // p' = p - offset, so d changes by the plane normal times offset
+  Frustum result = *this;
+  for (int i = 0; i < 6; ++i)
+  {
+    result._planes[i][3] += _planes[i][0] * offset.x +
+                            _planes[i][1] * offset.y +
+                            _planes[i][2] * offset.z;
+  }
+  return result;
+}
+
+bool Frustum::boxVisible(const Vector3D &minValues, const Vector3D &maxValues) const
+{
+  for (int i = 0; i < 6; ++i)
+  {
+    const float *p = _planes[i];
+
+    // Corner of the box furthest along the normal of the plane
+    float x = (p[0] >= 0.0f) ? maxValues.x : minValues.x;
+    float y = (p[1] >= 0.0f) ? maxValues.y : minValues.y;
+    float z = (p[2] >= 0.0f) ? maxValues.z : minValues.z;
+
+    if (p[0] * x + p[1] * y + p[2] * z + p[3] < 0.0f)
+      return false;
+  }
+
+  return true;
+}
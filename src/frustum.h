@@ -0,0 +1,35 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* frustum.h
+    Contains the Frustum class, used for culling of invisible geometry. */
+
+#pragma once
+
+#include "config.h"
+
+#include "common.h"
+
+/* View frustum as six planes; points p with a*p.x + b*p.y + c*p.z + d >= 0
+   for all of them are inside. */
+class Frustum
+{
+  public:
+    Frustum();
+
+    /* Extracts the planes from the projection and modelview matrices (as in
+       OpenGL, column by column); the planes are then in the coordinates of
+       the modelview matrix */
+    void setMatrices(const float (&projection)[16], const float (&modelview)[16]);
+
+    // The same frustum in coordinates moved by offset
+    Frustum translated(const Vector3D &offset) const;
+
+    // Whether the axis aligned box may be (partially) visible
+    bool boxVisible(const Vector3D &minValues, const Vector3D &maxValues) const;
+
+  private:
+    float _planes[6][4];
+};
@@ -0,0 +1,641 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* headless.cpp
+    Contains the implementation of the Headless class. */
+
+#include "headless.h"
+
+#include "application.h"
+#include "map.h"
+#include "fractal.h"
+#include "world.h"
+#include "recording.h"
+#include "settings.h"
+#include "filemanager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+
+const float Headless::BATTLE_TIME = 240.0f;
+const float Headless::BATTLE_SEPARATION = 1200.0f;
+const float Headless::BENCHMARK_TIME = 2.0f;
+const float Headless::SCALING_TIME = 1.0f;
+const float Headless::REPLAY_CHECK_TIME = 60.0f;
+
+Headless::Headless() : Object("Headless")
+{
+}
+
+Headless::~Headless()
+{
+}
+
+void Headless::setupMap(Map *map)
+{
+  Settings *s = Settings::instance();
+  map->setGraphics(false);
+  map->setCacheDirectory(FileManager::instance()->fileName("TerrainCache"));
+  map->setCacheEnabled(s->setting<bool>("TerrainCache"));
+  map->setMemoryBudget(s->setting<int>("TerrainMemory"));
+  map->setVisibleRing(s->setting<int>("ViewRadius"));
+  map->createWorkerThreads();
+}
+
+void Headless::updateMap(Map *map, const Player *player)
+{
+  map->update();
+  map->setViewer(player->mapPositionX(), player->mapPositionZ(),
+                 player->positionOffset(), player->velocityVector());
+  map->prefetch();
+}
+
+long long Headless::fly(World *world, Map *map, unsigned int steps, int &waits)
+{
+  long long stepTime = 0;
+
+  while ((world->stepCount() < steps) && (!world->crashed()))
+  {
+    updateMap(map, world->player());
+
+    if (!world->terrainReady())
+    {
+      ++waits;
+      SDL_Delay(1);
+      continue;
+    }
+
+    long long start = Time::nanoseconds();
+    for (int i = 0; i < STEPS_PER_UPDATE; ++i)
+    {
+      world->step();
+      if ((world->stepCount() >= steps) || world->crashed() || (!world->terrainReady()))
+        break;
+    }
+    stepTime += Time::nanoseconds() - start;
+  }
+
+  return stepTime;
+}
+
+int Headless::replay(const std::string &fileName)
+{
+  Recording recording;
+  if (!recording.load(fileName))
+  {
+    print("Could not load the recording " + fileName);
+    return 1;
+  }
+
+  const Recording::Setup &setup = recording.setup();
+
+  Fractal fractal;
+  fractal.setOptions(setup.fractalOptions);
+
+  Map map(&fractal, "Headless_Map");
+  map.setScale(setup.scale);
+  setupMap(&map);
+
+  World world(&map, "Headless_World");
+  world.setGame(setup.game);
+  world.setSeed(setup.seed);
+  world.setPhysicsRate(setup.physicsRate);
+  world.reset();
+  world.player()->setAmmo(setup.playerAmmo);
+  if (setup.game)
+    world.addEnemies(setup.enemyCount, setup.enemyActions);
+  world.setReplay(&recording);
+
+  while (!map.init())
+  {
+    map.update();
+    SDL_Delay(1);
+  }
+
+  int waits = 0;
+
+  Application::instance()->setQuiet(true);
+  long long stepTime = fly(&world, &map, recording.steps(), waits);
+  Application::instance()->setQuiet(false);
+
+  bool same = (world.stepCount() == recording.steps()) &&
+              (world.checksum() == recording.checksum());
+
+  stringstream p;
+  p << "Replayed " << world.stepCount() << " of " << recording.steps() << " steps ("
+    << world.stepCount() / (float)world.physicsRate() << " s of flight) in "
+    << stepTime / 1e9 << " s: " << (stepTime > 0 ? world.stepCount() * 1e9 / stepTime : 0.0)
+    << " steps/s; waited for terrain " << waits << " times";
+  print(p.str());
+
+  if (same)
+    print("The flight was the same as recorded");
+  else
+    print("The flight differed from the recording!");
+
+  return same ? 0 : 1;
+}
+
+unsigned long long Headless::terrainChecksum(Map *map, int ring)
+{
+  vector< pair<int, int> > quads;
+  for (int x = -ring; x <= ring; ++x)
+  {
+    for (int z = -ring; z <= ring; ++z)
+      quads.push_back(make_pair(x, z));
+  }
+
+  while (!map->requireQuads(quads))
+  {
+    map->update();
+    SDL_Delay(1);
+  }
+
+  Hash hash;
+  Vector3D qs = map->quadSize();
+  for (unsigned int i = 0; i < quads.size(); ++i)
+  {
+    for (int sx = 0; sx < TERRAIN_CHECKSUM_SAMPLES; ++sx)
+    {
+      for (int sz = 0; sz < TERRAIN_CHECKSUM_SAMPLES; ++sz)
+      {
+        Vector3D point(((sx + 0.5f) / TERRAIN_CHECKSUM_SAMPLES - 0.5f) * qs.x, 0.0f,
+                       ((sz + 0.5f) / TERRAIN_CHECKSUM_SAMPLES - 0.5f) * qs.z);
+        hash.add(map->terrainSample(quads[i].first, quads[i].second, point).height);
+      }
+    }
+  }
+
+  map->requireQuads(vector< pair<int, int> >());
+
+  return hash.value();
+}
+
+bool Headless::replayCheckCase(bool home, Fractal *fractal, unsigned int &steps,
+                               unsigned int &collisions, int waits[2])
+{
+  Recording recording;
+  unsigned long long terrain = 0;
+  bool same = false;
+
+  // Each flight has its own Map, so the quads are generated again in another order
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    Map map(fractal, "Headless_Map");
+    map.setScale(Vector3D(20.0f, 800.0f, 20.0f));
+    setupMap(&map);
+    map.setCacheEnabled(false);
+
+    // The replay keeps fewer quads around the player
+    if (pass == 1)
+    {
+      map.setVisibleRing(1);
+      map.setMemoryBudget(0);
+    }
+
+    World world(&map, "Headless_World");
+    world.setGame(true);
+    world.setSeed(1);
+    world.setPhysicsRate(Settings::instance()->setting<int>("PhysicsRate"));
+    world.reset();
+
+    /* Planes flying low over the quads next to the player, or beyond the
+       quads ever rendered or prefetched around it */
+    Vector3D qs = map.quadSize();
+    for (int i = 0; i < REPLAY_CHECK_PLANES; ++i)
+    {
+      Player *enemy = world.addAIPlayer(Player::Team_Red, "Computer " + toString<int>(i + 1), 0);
+
+      int distance = home ? 1 : Map::MAX_VISIBLE_RING + 3 + i;
+      enemy->setMapPosition((i % 2 == 0) ? distance : -distance, (i % 4 < 2) ? distance : -distance);
+      enemy->setPositionOffset(Vector3D(0.0f, (0.1f + 0.1f * i) * qs.y, 0.0f));
+      enemy->setHeading(45.0f * i);
+      enemy->resetInterpolation();
+    }
+
+    while (!map.init())
+    {
+      map.update();
+      SDL_Delay(1);
+    }
+
+    Application::instance()->setQuiet(true);
+
+    if (pass == 0)
+    {
+      world.setRecording(&recording);
+      fly(&world, &map, (unsigned int)(REPLAY_CHECK_TIME * world.physicsRate()), waits[pass]);
+      recording.finish(world.stepCount(), world.checksum());
+      collisions = world.stats().groundCollisions;
+      if (home)
+        terrain = terrainChecksum(&map, REPLAY_CHECK_HOME_RING);
+    }
+    else
+    {
+      world.setReplay(&recording);
+      fly(&world, &map, recording.steps(), waits[pass]);
+      same = (world.stepCount() == recording.steps()) && (world.checksum() == recording.checksum()) &&
+             (world.stats().groundCollisions == collisions);
+
+      // The quads were created in another order, but must have the same heights
+      if (home)
+        same = same && (terrainChecksum(&map, REPLAY_CHECK_HOME_RING) == terrain);
+    }
+
+    Application::instance()->setQuiet(false);
+  }
+
+  steps = recording.steps();
+  return same;
+}
+
+int Headless::replayCheck()
+{
+  Fractal fractal;
+  fractal.setOptions(FractalOptions());
+
+  int exitCode = 0;
+
+  for (int c = 0; c < 2; ++c)
+  {
+    bool home = (c == 1);
+    unsigned int steps = 0, collisions = 0;
+    int waits[2] = { 0, 0 };
+    bool same = replayCheckCase(home, &fractal, steps, collisions, waits);
+
+    stringstream p;
+    p << "Replay check: " << steps << " steps, " << REPLAY_CHECK_PLANES
+      << (home ? " planes next to the player, " : " planes far from the player, ")
+      << collisions << " ground collisions; waited for terrain "
+      << waits[0] << " times when recording and " << waits[1] << " times when replaying";
+    print(p.str());
+
+    // Without collisions, the terrain under the planes was not tested
+    if (same && (collisions > 0))
+    {
+      print("The replay was the same as the recording");
+      continue;
+    }
+
+    if (same)
+      print("No plane hit the ground, so the terrain was not checked!");
+    else
+      print("The replay differed from the recording!");
+
+    exitCode = 1;
+  }
+
+  return exitCode;
+}
+
+void Headless::placeForBattle(Player *player, int index, int teamSize, Map *map)
+{
+  Vector3D qs = map->quadSize();
+  float side = (player->team() == Player::Team_Blue) ? -1.0f : 1.0f;
+  float spacing = qs.x / (teamSize + 1);
+
+  player->setMapPosition(0, 0);
+  player->setPositionOffset(Vector3D(-0.5f * qs.x + (index + 1) * spacing, 1.2f * qs.y,
+                                     0.5f * side * BATTLE_SEPARATION));
+  // Blue flies towards +z, red towards -z
+  player->setHeading(side < 0.0f ? 0.0f : 180.0f);
+  player->resetInterpolation();
+}
+
+int Headless::aliveCount(World *world, Player::Team team)
+{
+  int count = 0;
+
+  const Player *leader = world->player();
+  if ((leader->team() == team) && (leader->hp() > 0))
+    ++count;
+
+  for (list<Player*>::const_iterator it = world->enemyPlayers().begin();
+       it != world->enemyPlayers().end(); ++it)
+  {
+    if (((*it)->team() == team) && ((*it)->hp() > 0))
+      ++count;
+  }
+
+  return count;
+}
+
+const Player* Headless::followedPlayer(World *world)
+{
+  const Player *leader = world->player();
+  if (leader->hp() > 0)
+    return leader;
+
+  for (list<Player*>::const_iterator it = world->enemyPlayers().begin();
+       it != world->enemyPlayers().end(); ++it)
+  {
+    if ((*it)->hp() > 0)
+      return *it;
+  }
+
+  return NULL;
+}
+
+int Headless::battles(int count, int teamSize)
+{
+  const int actions = Player::AI_Acceleration | Player::AI_Turning | Player::AI_Pitching |
+                      Player::AI_EvasiveAction | Player::AI_Firing;
+
+  Fractal fractal;
+  fractal.setOptions(FractalOptions());
+
+  Map map(&fractal, "Headless_Map");
+  map.setScale(Vector3D(20.0f, 800.0f, 20.0f));
+  setupMap(&map);
+
+  while (!map.init())
+  {
+    map.update();
+    SDL_Delay(1);
+  }
+
+  int blueWins = 0, redWins = 0, draws = 0;
+  int blueLosses = 0, redLosses = 0;
+  World::Stats total;
+  unsigned long long totalSteps = 0;
+  long long stepTime = 0;
+
+  Application::instance()->setQuiet(true);
+
+  for (int b = 0; b < count; ++b)
+  {
+    World world(&map, "Headless_World");
+    world.setGame(true);
+    world.setSeed(b + 1);
+    world.setPhysicsRate(Settings::instance()->setting<int>("PhysicsRate"));
+    world.reset();
+
+    Player *leader = world.player();
+    leader->setTeam(Player::Team_Blue);
+    leader->setName("Blue 1");
+    leader->setAI(true);
+    leader->setAIActions(actions);
+    placeForBattle(leader, 0, teamSize, &map);
+
+    for (int i = 0; i < teamSize; ++i)
+    {
+      if (i > 0)
+      {
+        Player *blue = world.addAIPlayer(Player::Team_Blue, "Blue " + toString<int>(i + 1), actions);
+        placeForBattle(blue, i, teamSize, &map);
+      }
+
+      Player *red = world.addAIPlayer(Player::Team_Red, "Red " + toString<int>(i + 1), actions);
+      placeForBattle(red, i, teamSize, &map);
+    }
+
+    const unsigned int maxSteps = (unsigned int)(BATTLE_TIME * world.physicsRate());
+    int blue = teamSize, red = teamSize;
+
+    while ((blue > 0) && (red > 0) && (world.stepCount() < maxSteps))
+    {
+      updateMap(&map, followedPlayer(&world));
+
+      // The terrain under all planes decides about crashes, not only under the followed one
+      if (!world.terrainReady())
+      {
+        SDL_Delay(1);
+        continue;
+      }
+
+      long long start = Time::nanoseconds();
+      for (int i = 0; (i < STEPS_PER_UPDATE) && (world.stepCount() < maxSteps); ++i)
+      {
+        world.step();
+        if (!world.terrainReady())
+          break;
+      }
+      stepTime += Time::nanoseconds() - start;
+
+      blue = aliveCount(&world, Player::Team_Blue);
+      red = aliveCount(&world, Player::Team_Red);
+    }
+
+    if ((blue > 0) && (red == 0))
+      ++blueWins;
+    else if ((red > 0) && (blue == 0))
+      ++redWins;
+    else
+      ++draws;
+
+    blueLosses += teamSize - blue;
+    redLosses += teamSize - red;
+
+    total.bulletsFired += world.stats().bulletsFired;
+    total.hits += world.stats().hits;
+    total.groundCollisions += world.stats().groundCollisions;
+    totalSteps += world.stepCount();
+  }
+
+  Application::instance()->setQuiet(false);
+
+  stringstream p;
+  p << count << " battles of " << teamSize << " vs " << teamSize << ": blue won " << blueWins
+    << ", red won " << redWins << ", " << draws << " draws";
+  print(p.str());
+
+  p.str("");
+  p << "Planes lost: blue " << blueLosses << ", red " << redLosses << "; bullets fired "
+    << total.bulletsFired << ", hits " << total.hits << ", ground collisions "
+    << total.groundCollisions;
+  print(p.str());
+
+  int rate = Settings::instance()->setting<int>("PhysicsRate");
+  p.str("");
+  p << totalSteps << " steps (" << totalSteps / (float)rate << " s simulated, "
+    << (count > 0 ? totalSteps / (float)rate / count : 0.0f) << " s per battle) in "
+    << stepTime / 1e9 << " s: " << (stepTime > 0 ? totalSteps * 1e9 / stepTime : 0.0)
+    << " ticks/s";
+  print(p.str());
+
+  return 0;
+}
+
+Headless::BenchmarkResult Headless::runBenchmark(Map *map, int aircraftCount, float seconds,
+                                                bool broadPhase)
+{
+  const int actions = Player::AI_Acceleration | Player::AI_Turning | Player::AI_Pitching;
+
+  World world(map, "Headless_World");
+  world.setGame(true);
+  world.setBroadPhase(broadPhase);
+  world.setPhysicsRate(Settings::instance()->setting<int>("PhysicsRate"));
+  world.setBulletCapacity(aircraftCount * BENCHMARK_BULLETS);
+  world.reset();
+
+  // A square grid over the quads of the visible ring
+  Vector3D qs = map->quadSize();
+  int side = (int)ceil(sqrt((float)aircraftCount));
+  float extent = (2 * Settings::instance()->setting<int>("ViewRadius") + 1) * qs.x;
+  float spacing = extent / side;
+
+  for (int i = 0; i < aircraftCount; ++i)
+  {
+    Player *p = world.player();
+    if (i > 0)
+    {
+      Player::Team team = (i % 2 == 0) ? Player::Team_Blue : Player::Team_Red;
+      p = world.addAIPlayer(team, "Plane " + toString<int>(i + 1), actions);
+    }
+
+    // The player, followed by the map, in the middle
+    int g = (i + aircraftCount / 2) % aircraftCount;
+    float x = ((g % side) + 0.5f) * spacing - 0.5f * extent;
+    float z = ((g / side) + 0.5f) * spacing - 0.5f * extent;
+    int quadX = (int)floor(x / qs.x + 0.5f);
+    int quadZ = (int)floor(z / qs.z + 0.5f);
+
+    p->setMapPosition(quadX, quadZ);
+    p->setPositionOffset(Vector3D(x - quadX * qs.x, 1.2f * qs.y, z - quadZ * qs.z));
+    p->setHeading((i * 137) % 360);
+    p->resetInterpolation();
+    p->setFiring(true);
+  }
+
+  const unsigned int maxSteps = (unsigned int)(seconds * world.physicsRate());
+  const Player *player = world.player();
+  unsigned long long bulletSteps = 0;
+
+  BenchmarkResult result;
+  result.stepTime = 0;
+  result.peakBullets = 0;
+
+  while (world.stepCount() < maxSteps)
+  {
+    updateMap(map, player);
+
+    if (!world.terrainReady())
+    {
+      SDL_Delay(1);
+      continue;
+    }
+
+    long long start = Time::nanoseconds();
+    for (int i = 0; (i < STEPS_PER_UPDATE) && (world.stepCount() < maxSteps); ++i)
+    {
+      world.step();
+
+      unsigned int bullets = world.entities().bulletCount();
+      result.peakBullets = max(result.peakBullets, bullets);
+      bulletSteps += bullets;
+
+      if (!world.terrainReady())
+        break;
+    }
+    result.stepTime += Time::nanoseconds() - start;
+  }
+
+  result.steps = world.stepCount();
+  result.meanBullets = (result.steps > 0) ? bulletSteps / result.steps : 0;
+  result.stats = world.stats();
+  result.pool = world.entities().bulletPoolStats();
+  result.aircraftLeft = world.entities().aircraftCount();
+  result.checksum = world.checksum();
+
+  return result;
+}
+
+void Headless::initBenchmarkMap(Map *map)
+{
+  map->setScale(Vector3D(20.0f, 800.0f, 20.0f));
+  setupMap(map);
+
+  while (!map->init())
+  {
+    map->update();
+    SDL_Delay(1);
+  }
+}
+
+int Headless::benchmark(int aircraftCount)
+{
+  Fractal fractal;
+  fractal.setOptions(FractalOptions());
+
+  Map map(&fractal, "Headless_Map");
+  initBenchmarkMap(&map);
+
+  Application::instance()->setQuiet(true);
+  BenchmarkResult r = runBenchmark(&map, aircraftCount, BENCHMARK_TIME, true);
+  Application::instance()->setQuiet(false);
+
+  int rate = Settings::instance()->setting<int>("PhysicsRate");
+
+  stringstream p;
+  p << "Benchmark of " << aircraftCount << " aircraft: " << r.steps << " steps ("
+    << r.steps / (float)rate << " s simulated) in " << r.stepTime / 1e9 << " s: "
+    << (r.stepTime > 0 ? r.steps * 1e9 / r.stepTime : 0.0) << " ticks/s, "
+    << (r.steps > 0 ? r.stepTime / 1e3 / r.steps : 0.0) << " us per tick";
+  print(p.str());
+
+  p.str("");
+  p << "Bullets: peak " << r.peakBullets << ", mean " << r.meanBullets
+    << ", fired " << r.stats.bulletsFired << "; hits " << r.stats.hits << " in "
+    << r.stats.hitTests << " tests; aircraft left " << r.aircraftLeft;
+  print(p.str());
+
+  p.str("");
+  p << "Bullet pool: capacity " << r.pool.capacity << ", high-water mark " << r.pool.highWater
+    << "; " << r.pool.allocations << " allocations (" << r.pool.recycled << " recycled), "
+    << r.pool.dropped << " dropped";
+  print(p.str());
+
+  return 0;
+}
+
+int Headless::scaling()
+{
+  const int COUNTS[] = { 10, 20, 50, 100, 200, 500, 1000 };
+  const int COUNT_NUMBER = sizeof(COUNTS) / sizeof(COUNTS[0]);
+
+  Fractal fractal;
+  fractal.setOptions(FractalOptions());
+
+  Map map(&fractal, "Headless_Map");
+  initBenchmarkMap(&map);
+
+  print("Hit tests with the spatial hash and against all planes, "
+        + toString<float>(SCALING_TIME) + " s simulated:");
+  print("aircraft  bullets  us/tick(hash)  tests/bullet(hash)  us/tick(all)  tests/bullet(all)");
+
+  int code = 0;
+
+  for (int i = 0; i < COUNT_NUMBER; ++i)
+  {
+    Application::instance()->setQuiet(true);
+    BenchmarkResult hash = runBenchmark(&map, COUNTS[i], SCALING_TIME, true);
+    BenchmarkResult all = runBenchmark(&map, COUNTS[i], SCALING_TIME, false);
+    Application::instance()->setQuiet(false);
+
+    unsigned long long bulletSteps = (unsigned long long)hash.meanBullets * hash.steps;
+
+    stringstream p;
+    p << setw(8) << COUNTS[i] << setw(9) << hash.meanBullets
+      << setw(15) << (hash.steps > 0 ? hash.stepTime / 1e3 / hash.steps : 0.0)
+      << setw(20) << (bulletSteps > 0 ? hash.stats.hitTests / (double)bulletSteps : 0.0)
+      << setw(14) << (all.steps > 0 ? all.stepTime / 1e3 / all.steps : 0.0)
+      << setw(19) << (bulletSteps > 0 ? all.stats.hitTests / (double)bulletSteps : 0.0);
+    print(p.str());
+
+    // Both find the same hits, so the flights are the same
+    if (hash.checksum != all.checksum)
+    {
+      print("The flights differed with and without the spatial hash!");
+      code = 1;
+    }
+  }
+
+  return code;
+}
@@ -0,0 +1,120 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* headless.h
+    Contains the Headless class, which runs flights without a window. */
+
+#pragma once
+
+#include "config.h"
+
+#include "object.h"
+#include "common.h"
+
+#include <string>
+
+#include "world.h"
+
+class Map;
+
+/* Runs the World without SDL video and OpenGL, as fast as the processor
+   allows: quads of the map are generated, but not uploaded, and the model
+   of the plane gives only its bounds. Player::initModel(false) must be
+   called before. */
+class Headless : public Object
+{
+  public:
+    // Steps made between updates of the map
+    static const int STEPS_PER_UPDATE = 100;
+    // Simulated time [s] after which a battle is a draw
+    static const float BATTLE_TIME;
+    // Distance between the teams at the start of a battle [world units]
+    static const float BATTLE_SEPARATION;
+    // Simulated time [s] of the benchmark of the entities
+    static const float BENCHMARK_TIME;
+    // Bullets in the pool for each aircraft of the benchmark (more than 10 shots/s all the time)
+    static const int BENCHMARK_BULLETS = 32;
+    // Simulated time [s] of each run of the scaling benchmark
+    static const float SCALING_TIME;
+    // Simulated time [s] and low flying planes of each case of the replay check
+    static const float REPLAY_CHECK_TIME;
+    static const int REPLAY_CHECK_PLANES = 8;
+    // Ring of quads around the player compared by the replay check, and samples along a side of each
+    static const int REPLAY_CHECK_HOME_RING = 2;
+    static const int TERRAIN_CHECKSUM_SAMPLES = 16;
+
+  public:
+    Headless();
+    virtual ~Headless();
+
+    /* Replays a recording as a benchmark and checks its final state;
+       returns the exit code of the program (0 if the flight was the same) */
+    int replay(const std::string &fileName);
+
+    /* Records flights with planes hitting the ground far from the player
+       and next to it, replays each on another Map keeping other terrain
+       around the player and compares the states, and for the second one
+       the heights around the player; returns the exit code (0 if they
+       were the same) */
+    int replayCheck();
+
+    /* Runs battles of two teams of AI players (the blue one led by the player
+       of the World) and prints the results; returns the exit code */
+    int battles(int count, int teamSize);
+
+    /* Benchmark of the World with many aircraft, all firing all the time,
+       spread over the quads around the start; returns the exit code */
+    int benchmark(int aircraftCount);
+
+    /* Runs the benchmark for 10 to 1000 aircraft, with the spatial hash of the
+       World and with hit tests against all planes, and prints a table */
+    int scaling();
+
+  private:
+    struct BenchmarkResult
+    {
+      unsigned int steps;
+      long long stepTime;
+      unsigned int peakBullets, meanBullets;
+      World::Stats stats;
+      EntityStore::BulletPoolStats pool;
+      unsigned int aircraftLeft;
+      unsigned long long checksum;
+    };
+
+  private:
+    // Sets up the map like the Simulation does
+    void setupMap(Map *map);
+
+    // Moves the viewer of the map to the player and takes the finished quads
+    void updateMap(Map *map, const Player *player);
+
+    /* Steps the world until the given step or a crash of the player, waiting
+       for the terrain; returns the time [ns] of the steps */
+    long long fly(World *world, Map *map, unsigned int steps, int &waits);
+
+    // Hash of the heights of the quads in a ring around (0, 0), waiting for them
+    unsigned long long terrainChecksum(Map *map, int ring);
+
+    /* One case of the replay check, with the planes next to the player and
+       the heights compared if home; returns whether the replay was the same
+       as the recording */
+    bool replayCheckCase(bool home, Fractal *fractal, unsigned int &steps,
+                         unsigned int &collisions, int waits[2]);
+
+    // Places a plane of a team at the start of a battle
+    void placeForBattle(Player *player, int index, int teamSize, Map *map);
+
+    // Count of the planes of the team still flying
+    int aliveCount(World *world, Player::Team team);
+
+    // A plane still flying, for the map to follow; NULL if there is none
+    const Player* followedPlayer(World *world);
+
+    // Map of the benchmarks, with its starting quads generated
+    void initBenchmarkMap(Map *map);
+
+    BenchmarkResult runBenchmark(Map *map, int aircraftCount, float seconds, bool broadPhase);
+};
@@ -9,9 +9,15 @@
 #include "map.h"
 
 #include "fractal.h"
+#include "normals.h"
+#include "profiler.h"
+#include "trace.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <sstream>
 #include <cassert>
 
@@ -21,6 +27,7 @@
 #include <GL/glext.h>
 
 #define GL_ARRAY_BUFFER_ARB 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER_ARB 0x8893
 #define GL_STATIC_DRAW_ARB 0x88E4
 
 using namespace std;
@@ -28,390 +35,125 @@ using namespace std;
 PFNGLGENBUFFERSARBPROC glGenBuffersARB = NULL;
 PFNGLBINDBUFFERARBPROC glBindBufferARB = NULL;
 PFNGLBUFFERDATAARBPROC glBufferDataARB = NULL;
+PFNGLBUFFERSUBDATAARBPROC glBufferSubDataARB = NULL;
 PFNGLDELETEBUFFERSARBPROC glDeleteBuffersARB = NULL;
 
-void Map::Quad::filterValues(float v0, float &v1, float &v2, float &v3, float v4)
-{
-  float dv = v4 - v0;
-  v1 = v0 + 0.25f * dv;
-  v2 = v0 + 0.50f * dv;
-  v3 = v0 + 0.75f * dv;
-}
-
-void Map::Quad::generate(Quad* neighbors[4], const Vector3D &scale,
-                         Fractal *fractal)
-{
-  fractal->clear();
-
-  if (neighbors[0] != NULL)
-  {
-    for (int i = 0; i < 1+DETAIL_HIGH_COUNT; ++i)
-      fractal->setValue(i, 0, neighbors[0]->_values[i][DETAIL_HIGH_COUNT]);
-  }
-  if (neighbors[1] != NULL)
-  {
-    for (int i = 0; i < 1+DETAIL_HIGH_COUNT; ++i)
-      fractal->setValue(DETAIL_HIGH_COUNT, i, neighbors[1]->_values[0][i]);
-  }
-  if (neighbors[2] != NULL)
-  {
-    for (int i = 0; i < 1+DETAIL_HIGH_COUNT; ++i)
-      fractal->setValue(i, DETAIL_HIGH_COUNT, neighbors[2]->_values[i][0]);
-  }
-  if (neighbors[3] != NULL)
-  {
-    for (int i = 0; i < 1+DETAIL_HIGH_COUNT; ++i)
-      fractal->setValue(0, i, neighbors[3]->_values[DETAIL_HIGH_COUNT][i]);
-  }
-
-  fractal->generate(seed());
+unsigned int Map::_indexVBO = 0;
+Map::IndexRange Map::_indexRanges[Map::PATCH_COUNT][Map::PATCH_COUNT][Map::LOD_COUNT];
 
-  assert(fractal->size() == 1+DETAIL_HIGH_COUNT);
+const float Map::EVICTION_AGE = 10.0f;
+const float Map::PREFETCH_HORIZON = 60.0f;
 
-  for (int x = 0; x < 1+DETAIL_HIGH_COUNT; ++x)
-  {
-    for (int z = 0; z < 1+DETAIL_HIGH_COUNT; ++z)
-    {
-      _values[x][z] = fractal->value(x, z);
-    }
-  }
-
-  // Smooting of newly generated edges
-
-  if (neighbors[0] == NULL)
-  {
-    for (int i = 0; i+4 < 1+DETAIL_HIGH_COUNT; i += 4)
-    {
-      filterValues(_values[i  ][0],
-                   _values[i+1][0],
-                   _values[i+2][0],
-                   _values[i+3][0],
-                   _values[i+4][0]);
-    }
-  }
-
-  if (neighbors[1] == NULL)
-  {
-    for (int i = 0; i+4 < 1+DETAIL_HIGH_COUNT; i += 4)
-    {
-      filterValues(_values[DETAIL_HIGH_COUNT][i  ],
-                   _values[DETAIL_HIGH_COUNT][i+1],
-                   _values[DETAIL_HIGH_COUNT][i+2],
-                   _values[DETAIL_HIGH_COUNT][i+3],
-                   _values[DETAIL_HIGH_COUNT][i+4]);
-    }
-  }
-
-  if (neighbors[2] == NULL)
-  {
-    for (int i = 0; i+4 < 1+DETAIL_HIGH_COUNT; i += 4)
-    {
-      filterValues(_values[i  ][DETAIL_HIGH_COUNT],
-                   _values[i+1][DETAIL_HIGH_COUNT],
-                   _values[i+2][DETAIL_HIGH_COUNT],
-                   _values[i+3][DETAIL_HIGH_COUNT],
-                   _values[i+4][DETAIL_HIGH_COUNT]);
-    }
-  }
-
-  if (neighbors[3] == NULL)
-  {
-    for (int i = 0; i+4 < 1+DETAIL_HIGH_COUNT; i += 4)
-    {
-      filterValues(_values[0][i  ],
-                   _values[0][i+1],
-                   _values[0][i+2],
-                   _values[0][i+3],
-                   _values[0][i+4]);
-    }
-  }
-
-  const int sH = DETAIL_HIGH_COUNT;
-
-  float dx = -0.5f * scale.x * sH;
-  float dz = -0.5f * scale.z * sH;
-
-  for (int x = 0; x < sH; ++x)
-  {
-    for (int z = 0; z < sH; ++z)
-    {
-      Vector3D v1(dx + scale.x * x,     scale.y * _values[x][z],     dz + scale.z * z);
-      Vector3D v2(dx + scale.x * (x+1), scale.y * _values[x+1][z],   dz + scale.z * z);
-      Vector3D v3(dx + scale.x * (x+1), scale.y * _values[x+1][z+1], dz + scale.z * (z+1));
-      Vector3D v4(dx + scale.x * x,     scale.y * _values[x][z+1],   dz + scale.z * (z+1));
-
-      _detailHighVertices[6 * (x * sH + z)]     = v1;
-      _detailHighVertices[6 * (x * sH + z) + 1] = v2;
-      _detailHighVertices[6 * (x * sH + z) + 2] = v3;
+void Map::Quad::createVBO()
+{
+  const int count = vertexCount();
 
-      _detailHighVertices[6 * (x * sH + z) + 3] = v3;
-      _detailHighVertices[6 * (x * sH + z) + 4] = v4;
-      _detailHighVertices[6 * (x * sH + z) + 5] = v1;
-    }
-  }
+  // Positions are derived from the height field only for the upload
+  Vector3D *vertices = new Vector3D[count];
+  PackedNormal *normals = new PackedNormal[count];
 
-  const int sM = DETAIL_MEDIUM_COUNT;
+  vertexData(vertices, normals);
 
-  for (int x = 0; x < sM; ++x)
-  {
-    for (int z = 0; z < sM; ++z)
-    {
-      _detailMediumVertices[6 * (x * sM + z)    ] = _detailHighVertices[6 * ( 2*x    * sH + 2*z  )    ];
-      _detailMediumVertices[6 * (x * sM + z) + 1] = _detailHighVertices[6 * ((2*x+1) * sH + 2*z  ) + 1];
-      _detailMediumVertices[6 * (x * sM + z) + 2] = _detailHighVertices[6 * ((2*x+1) * sH + 2*z+1) + 2];
+  glGenBuffersARB(1, &_verticesVBO);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, _verticesVBO);
+  glBufferDataARB(GL_ARRAY_BUFFER_ARB, count * 3 * sizeof(float),
+                  vertices, GL_STATIC_DRAW_ARB);
 
-      _detailMediumVertices[6 * (x * sM + z) + 3] = _detailHighVertices[6 * ((2*x+1) * sH + 2*z+1) + 3];
-      _detailMediumVertices[6 * (x * sM + z) + 4] = _detailHighVertices[6 * ( 2*x    * sH + 2*z+1) + 4];
-      _detailMediumVertices[6 * (x * sM + z) + 5] = _detailHighVertices[6 * ( 2*x    * sH + 2*z  ) + 5];
-    }
-  }
+  delete[] vertices;
 
-  const int sL = DETAIL_LOW_COUNT;
+  glGenBuffersARB(1, &_normalsVBO);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, _normalsVBO);
+  glBufferDataARB(GL_ARRAY_BUFFER_ARB, count * sizeof(PackedNormal),
+                  normals, GL_STATIC_DRAW_ARB);
 
-  for (int x = 0; x < sL; ++x)
-  {
-    for (int z = 0; z < sL; ++z)
-    {
-      _detailLowVertices[6 * (x * sL + z)    ] = _detailHighVertices[6 * ( 4*x    * sH + 4*z  )    ];
-      _detailLowVertices[6 * (x * sL + z) + 1] = _detailHighVertices[6 * ((4*x+3) * sH + 4*z  ) + 1];
-      _detailLowVertices[6 * (x * sL + z) + 2] = _detailHighVertices[6 * ((4*x+3) * sH + 4*z+3) + 2];
+  delete[] normals;
 
-      _detailLowVertices[6 * (x * sL + z) + 3] = _detailHighVertices[6 * ((4*x+3) * sH + 4*z+3) + 3];
-      _detailLowVertices[6 * (x * sL + z) + 4] = _detailHighVertices[6 * ( 4*x    * sH + 4*z+3) + 4];
-      _detailLowVertices[6 * (x * sL + z) + 5] = _detailHighVertices[6 * ( 4*x    * sH + 4*z  ) + 5];
-    }
-  }
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
 }
 
-void Map::Quad::calculateNormals(Quad* neighbors[4], const Vector3D &scale)
+void Map::Quad::updateEdgeVBO(int side)
 {
-  Vector3D normalsTable[1+DETAIL_HIGH_COUNT][1+DETAIL_HIGH_COUNT];
-
   const int sH = DETAIL_HIGH_COUNT;
+  const int size = sizeof(PackedNormal);
 
-  for (int x = 0; x < sH; ++x)
-  {
-    for (int z = 0; z < sH; ++z)
-    {
-      Vector3D v1(scale.x *  x,    scale.y * _values[x][z],     scale.z *  z);
-      Vector3D v2(scale.x * (x+1), scale.y * _values[x+1][z],   scale.z *  z);
-      Vector3D v3(scale.x * (x+1), scale.y * _values[x+1][z+1], scale.z * (z+1));
-      Vector3D v4(scale.x *  x,    scale.y * _values[x][z+1],   scale.z * (z+1));
-
-      Vector3D n1 = Vector3D::crossProduct(v1 - v2, v3 - v2);
-      Vector3D n2 = Vector3D::crossProduct(v3 - v4, v1 - v4);
-
-      normalsTable[x][z]     += n1 + n2;
-      normalsTable[x+1][z]   += n1;
-      normalsTable[x+1][z+1] += n1 + n2;
-      normalsTable[x][z+1]   += n2;
-    }
-  }
-
-  // Edges of neighboring fields
-
-  if (neighbors[0] != NULL)
-  {
-    for (int x = 0; x < sH; ++x)
-    {
-      int z = sH-1;
-
-      Vector3D v1(scale.x *  x,    scale.y * neighbors[0]->_values[x][z],     scale.z *  z);
-      Vector3D v2(scale.x * (x+1), scale.y * neighbors[0]->_values[x+1][z],   scale.z *  z);
-      Vector3D v3(scale.x * (x+1), scale.y * neighbors[0]->_values[x+1][z+1], scale.z * (z+1));
-      Vector3D v4(scale.x *  x,    scale.y * neighbors[0]->_values[x][z+1],   scale.z * (z+1));
-
-      Vector3D n1 = Vector3D::crossProduct(v1 - v2, v3 - v2);
-      Vector3D n2 = Vector3D::crossProduct(v3 - v4, v1 - v4);
-
-      normalsTable[x  ][0] += n2;
-      normalsTable[x+1][0] += n1 + n2;
-    }
-  }
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, _normalsVBO);
 
-  if (neighbors[1] != NULL)
+  if ((side == 0) || (side == 2))
   {
-    for (int z = 0; z < sH; ++z)
-    {
-      int x = 0;
+    int z = (side == 0) ? 0 : sH;
 
-      Vector3D v1(scale.x *  x,    scale.y * neighbors[1]->_values[x][z],     scale.z *  z);
-      Vector3D v2(scale.x * (x+1), scale.y * neighbors[1]->_values[x+1][z],   scale.z *  z);
-      Vector3D v3(scale.x * (x+1), scale.y * neighbors[1]->_values[x+1][z+1], scale.z * (z+1));
-      Vector3D v4(scale.x *  x,    scale.y * neighbors[1]->_values[x][z+1],   scale.z * (z+1));
+    PackedNormal normals[1+sH];
+    for (int x = 0; x < 1+sH; ++x)
+      normals[x] = _normals[x][z];
 
-      Vector3D n1 = Vector3D::crossProduct(v1 - v2, v3 - v2);
-      Vector3D n2 = Vector3D::crossProduct(v3 - v4, v1 - v4);
-
-      normalsTable[sH][z  ] += n1 + n2;
-      normalsTable[sH][z+1] += n2;
-    }
+    glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, vertexIndex(0, z) * size,
+                       (1+sH) * size, normals);
+    glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, skirtIndex(0, z) * size,
+                       (1+sH) * size, normals);
   }
-
-  if (neighbors[2] != NULL)
-  {
-    for (int x = 0; x < sH; ++x)
-    {
-      int z = 0;
-
-      Vector3D v1(scale.x *  x,    scale.y * neighbors[2]->_values[x][z],     scale.z *  z);
-      Vector3D v2(scale.x * (x+1), scale.y * neighbors[2]->_values[x+1][z],   scale.z *  z);
-      Vector3D v3(scale.x * (x+1), scale.y * neighbors[2]->_values[x+1][z+1], scale.z * (z+1));
-      Vector3D v4(scale.x *  x,    scale.y * neighbors[2]->_values[x][z+1],   scale.z * (z+1));
-
-      Vector3D n1 = Vector3D::crossProduct(v1 - v2, v3 - v2);
-      Vector3D n2 = Vector3D::crossProduct(v3 - v4, v1 - v4);
-
-      normalsTable[x  ][sH] += n1 + n2;
-      normalsTable[x+1][sH] += n1;
-    }
-  }
-
-  if (neighbors[3] != NULL)
-  {
-    for (int z = 0; z < sH; ++z)
-    {
-      int x = sH-1;
-
-      Vector3D v1(scale.x *  x,    scale.y * neighbors[3]->_values[x][z],     scale.z *  z);
-      Vector3D v2(scale.x * (x+1), scale.y * neighbors[3]->_values[x+1][z],   scale.z *  z);
-      Vector3D v3(scale.x * (x+1), scale.y * neighbors[3]->_values[x+1][z+1], scale.z * (z+1));
-      Vector3D v4(scale.x *  x,    scale.y * neighbors[3]->_values[x][z+1],   scale.z * (z+1));
-
-      Vector3D n1 = Vector3D::crossProduct(v1 - v2, v3 - v2);
-      Vector3D n2 = Vector3D::crossProduct(v3 - v4, v1 - v4);
-
-      normalsTable[0][z  ] += n1;
-      normalsTable[0][z+1] += n1 + n2;
-    }
-  }
-
-  for (int x = 0; x < 1+sH; ++x)
+  else
   {
-    for (int z = 0; z < 1+sH; ++z)
-      normalsTable[x][z].normalize();
-  }
+    int x = (side == 3) ? 0 : sH;
 
-  for (int x = 0; x < sH; ++x)
-  {
-    for (int z = 0; z < sH; ++z)
-    {
-      _detailHighNormals[6 * (x * sH + z)    ] = normalsTable[x  ][z  ];
-      _detailHighNormals[6 * (x * sH + z) + 1] = normalsTable[x+1][z  ];
-      _detailHighNormals[6 * (x * sH + z) + 2] = normalsTable[x+1][z+1];
+    glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, vertexIndex(x, 1) * size,
+                       (sH-1) * size, &_normals[x][1]);
 
-      _detailHighNormals[6 * (x * sH + z) + 3] = normalsTable[x+1][z+1];
-      _detailHighNormals[6 * (x * sH + z) + 4] = normalsTable[x  ][z+1];
-      _detailHighNormals[6 * (x * sH + z) + 5] = normalsTable[x  ][z  ];
-    }
-  }
+    // Corners are stored with the edges of constant z
+    glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, vertexIndex(x, 0) * size,
+                       size, &_normals[x][0]);
+    glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, vertexIndex(x, sH) * size,
+                       size, &_normals[x][sH]);
 
-  const int sM = DETAIL_MEDIUM_COUNT;
-
-  for (int x = 0; x < sM; ++x)
-  {
-    for (int z = 0; z < sM; ++z)
+    // Skirt: vertices between the patch corners, then the corners themselves
+    PackedNormal normals[sH];
+    int count = 0;
+    for (int z = 1; z < sH; ++z)
     {
-      _detailMediumNormals[6 * (x * sM + z)    ] = _detailHighNormals[6 * ( 2*x    * sH + 2*z      )];
-      _detailMediumNormals[6 * (x * sM + z) + 1] = _detailHighNormals[6 * ((2*x+1) * sH + 2*z  ) + 1];
-      _detailMediumNormals[6 * (x * sM + z) + 2] = _detailHighNormals[6 * ((2*x+1) * sH + 2*z+1) + 2];
-
-      _detailMediumNormals[6 * (x * sM + z) + 3] = _detailHighNormals[6 * ((2*x+1) * sH + 2*z+1) + 3];
-      _detailMediumNormals[6 * (x * sM + z) + 4] = _detailHighNormals[6 * ( 2*x    * sH + 2*z+1) + 4];
-      _detailMediumNormals[6 * (x * sM + z) + 5] = _detailHighNormals[6 * ( 2*x    * sH + 2*z  ) + 5];
+      if (z % PATCH_SIZE != 0)
+        normals[count++] = _normals[x][z];
     }
-  }
 
-  const int sL = DETAIL_LOW_COUNT;
+    glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, skirtIndex(x, 1) * size,
+                       count * size, normals);
 
-  for (int x = 0; x < sL; ++x)
-  {
-    for (int z = 0; z < sL; ++z)
+    for (int z = 0; z <= sH; z += PATCH_SIZE)
     {
-      _detailLowNormals[6 * (x * sL + z)    ] = _detailHighNormals[6 * ( 4*x    * sH + 4*z  )    ];
-      _detailLowNormals[6 * (x * sL + z) + 1] = _detailHighNormals[6 * ((4*x+3) * sH + 4*z  ) + 1];
-      _detailLowNormals[6 * (x * sL + z) + 2] = _detailHighNormals[6 * ((4*x+3) * sH + 4*z+3) + 2];
-
-      _detailLowNormals[6 * (x * sL + z) + 3] = _detailHighNormals[6 * ((4*x+3) * sH + 4*z+3) + 3];
-      _detailLowNormals[6 * (x * sL + z) + 4] = _detailHighNormals[6 * ( 4*x    * sH + 4*z+3) + 4];
-      _detailLowNormals[6 * (x * sL + z) + 5] = _detailHighNormals[6 * ( 4*x    * sH + 4*z  ) + 5];
+      glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, skirtIndex(x, z) * size,
+                         size, &_normals[x][z]);
     }
   }
-}
 
-void Map::Quad::createVBO()
-{
-  const int sH = DETAIL_HIGH_COUNT;
-  const int sM = DETAIL_MEDIUM_COUNT;
-  const int sL = DETAIL_LOW_COUNT;
-
-  glGenBuffersARB(1, &_detailHighVerticesVBO);
-  glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailHighVerticesVBO);
-  glBufferDataARB(GL_ARRAY_BUFFER_ARB, 6 * sH * sH * 3 * sizeof(float),
-                  _detailHighVertices, GL_STATIC_DRAW_ARB);
-
-  glGenBuffersARB(1, &_detailHighNormalsVBO);
-  glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailHighNormalsVBO);
-  glBufferDataARB(GL_ARRAY_BUFFER_ARB, 6 * sH * sH * 3 * sizeof(float),
-                  _detailHighNormals, GL_STATIC_DRAW_ARB);
-
-  glGenBuffersARB(1, &_detailMediumVerticesVBO);
-  glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailMediumVerticesVBO);
-  glBufferDataARB(GL_ARRAY_BUFFER_ARB, 6 * sM * sM * 3 * sizeof(float),
-                  _detailMediumVertices, GL_STATIC_DRAW_ARB);
-
-  glGenBuffersARB(1, &_detailMediumNormalsVBO);
-  glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailMediumNormalsVBO);
-  glBufferDataARB(GL_ARRAY_BUFFER_ARB, 6 * sM * sM * 3 * sizeof(float),
-                  _detailMediumNormals, GL_STATIC_DRAW_ARB);
-
-  glGenBuffersARB(1, &_detailLowVerticesVBO);
-  glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailLowVerticesVBO);
-  glBufferDataARB(GL_ARRAY_BUFFER_ARB, 6 * sL * sL * 3 * sizeof(float),
-                  _detailLowVertices, GL_STATIC_DRAW_ARB);
-
-  glGenBuffersARB(1, &_detailLowNormalsVBO);
-  glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailLowNormalsVBO);
-  glBufferDataARB(GL_ARRAY_BUFFER_ARB, 6 * sL * sL * 3 * sizeof(float),
-                  _detailLowNormals, GL_STATIC_DRAW_ARB);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
 }
 
-void Map::Quad::render(DetailLevel detailLevel) const
+void Map::Quad::render(const int lods[PATCH_COUNT][PATCH_COUNT]) const
 {
   glEnable(GL_VERTEX_ARRAY);
   glEnableClientState(GL_VERTEX_ARRAY);
   glEnableClientState(GL_NORMAL_ARRAY);
 
-  int arraySize = 0;
-  if (detailLevel == DetailHigh)
-  {
-    glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailHighVerticesVBO);
-    glVertexPointer(3, GL_FLOAT, 0, NULL);
-    glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailHighNormalsVBO);
-    glNormalPointer(GL_FLOAT, 0, NULL);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, _verticesVBO);
+  glVertexPointer(3, GL_FLOAT, 0, NULL);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, _normalsVBO);
+  glNormalPointer(GL_BYTE, sizeof(PackedNormal), NULL);
 
-    arraySize = 6 * DETAIL_HIGH_COUNT * DETAIL_HIGH_COUNT;
-  }
-  else if (detailLevel == DetailMedium)
-  {
-    glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailMediumVerticesVBO);
-    glVertexPointer(3, GL_FLOAT, 0, NULL);
-    glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailMediumNormalsVBO);
-    glNormalPointer(GL_FLOAT, 0, NULL);
+  glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, _indexVBO);
 
-    arraySize = 6 * DETAIL_MEDIUM_COUNT * DETAIL_MEDIUM_COUNT;
-  }
-  else
+  for (int px = 0; px < PATCH_COUNT; ++px)
   {
-    glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailLowVerticesVBO);
-    glVertexPointer(3, GL_FLOAT, 0, NULL);
-    glBindBufferARB(GL_ARRAY_BUFFER_ARB, _detailLowNormalsVBO);
-    glNormalPointer(GL_FLOAT, 0, NULL);
+    for (int pz = 0; pz < PATCH_COUNT; ++pz)
+    {
+      if (lods[px][pz] < 0)
+        continue;
 
-    arraySize = 6 * DETAIL_LOW_COUNT * DETAIL_LOW_COUNT;
+      const IndexRange &range = _indexRanges[px][pz][lods[px][pz]];
+      glDrawElements(GL_TRIANGLES, range.count, GL_UNSIGNED_SHORT,
+                     (const GLvoid*)(range.offset * sizeof(unsigned short)));
+    }
   }
 
-  glDrawArrays(GL_TRIANGLES, 0, arraySize);
+  glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
 
   glDisableClientState(GL_NORMAL_ARRAY);
   glDisableClientState(GL_VERTEX_ARRAY);
@@ -420,22 +162,15 @@ void Map::Quad::render(DetailLevel detailLevel) const
 
 void Map::Quad::destroyVBO()
 {
-  glDeleteBuffersARB(1, &_detailHighVerticesVBO);
-  glDeleteBuffersARB(1, &_detailHighNormalsVBO);
+  if (_verticesVBO == 0)
+    return;
 
-  glDeleteBuffersARB(1, &_detailMediumVerticesVBO);
-  glDeleteBuffersARB(1, &_detailMediumNormalsVBO);
+  glDeleteBuffersARB(1, &_verticesVBO);
+  glDeleteBuffersARB(1, &_normalsVBO);
 
-  glDeleteBuffersARB(1, &_detailLowVerticesVBO);
-  glDeleteBuffersARB(1, &_detailLowNormalsVBO);
+  _verticesVBO = _normalsVBO = 0;
 }
 
-float Map::Quad::value(int x, int z) const
-{
-  if ((x < 0) || (z < 0) || (x >= DETAIL_HIGH_COUNT) || (z >= DETAIL_HIGH_COUNT))
-    return 0.0f;
-  return _values[x][z];
-}
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
@@ -454,6 +189,18 @@ Map::Worker::Worker()
 
 Map::Worker::~Worker()
 {
+  while (!_scheduledTasks.empty())
+  {
+    delete _scheduledTasks.top().quad;
+    _scheduledTasks.pop();
+  }
+
+  while (!_finishedTasks.empty())
+  {
+    delete _finishedTasks.front().quad;
+    _finishedTasks.pop();
+  }
+
   SDL_mutexV(_exitCodeMutex);
   SDL_DestroyMutex(_exitCodeMutex);
   _exitCodeMutex = NULL;
@@ -511,16 +258,18 @@ Map::WorkerTask Map::Worker::getScheduledTask()
   {
     if (!_scheduledTasks.empty())
     {
-      result = _scheduledTasks.front();
+      result = _scheduledTasks.top();
       _scheduledTasks.pop();
     }
     else
     {
       int status = SDL_CondWaitTimeout(_scheduledTaskCond,
                                        _scheduledTaskMutex, 50);
-      if (status == 0)
+
+      // Another thread of the pool may have taken the task already
+      if ((status == 0) && (!_scheduledTasks.empty()))
       {
-        result = _scheduledTasks.front();
+        result = _scheduledTasks.top();
         _scheduledTasks.pop();
       }
     }
@@ -558,10 +307,15 @@ void Map::Worker::addFinishedTask(const Map::WorkerTask &task)
 
 int Map::Worker::run(void *data)
 {
-  Worker *instance = (Worker*)(data);
+  WorkerThread *thread = (WorkerThread*)(data);
+  Worker *instance = thread->worker;
 
   int exitCode = -1;
 
+  stringstream name;
+  name << "Worker " << thread->index;
+  Trace::setThreadName(name.str());
+
   for (;;)
   {
     exitCode = instance->getExitCode();
@@ -573,28 +327,70 @@ int Map::Worker::run(void *data)
     if (!task.valid)
       continue;
 
-    Quad* neighbors[4] = { NULL };
+    // Flows link the task to its dispatch and to its handoff to the main thread
+    bool traced = Trace::recording();
+    if (traced)
+    {
+      Trace::begin(task.cached ? "Load quad" : "Generate quad", task.x, task.z);
+      Trace::flowEnd("Queue", 2 * task.serial);
+    }
+
+    task.map->_map.beginRead(thread->reader);
+
+    TerrainQuad* neighbors[4] = { NULL };
     neighbors[0] = task.map->findQuad(task.x  , task.z-1);
     neighbors[1] = task.map->findQuad(task.x+1, task.z  );
     neighbors[2] = task.map->findQuad(task.x  , task.z+1);
     neighbors[3] = task.map->findQuad(task.x-1, task.z  );
 
-    task.quad->generate(neighbors, task.scale, task.fractal);
-    task.quad->calculateNormals(neighbors, task.scale);
+    const QuadCache &cache = task.map->_cache;
 
+    if (task.cached && task.quad->load(cache, task.scale))
+    {
+      // Saved normals of the edges may not match the current neighbors
+      for (int i = 0; i < 4; ++i)
+      {
+        if (neighbors[i] != NULL)
+          task.quad->calculateEdgeNormals(neighbors, task.scale, i);
+      }
+    }
+    else
+    {
+      thread->fractal.setOptions(task.fractalOptions);
+
+      task.quad->generate(task.scale, &thread->fractal);
+
+      task.quad->calculateNormals(neighbors, task.scale);
+
+      if (cache.enabled())
+        task.quad->save(cache);
+    }
+
+    task.quad->calculatePatchErrors();
+
+    // Only the edge shared with the new quad changes in the neighbors
     for (int i = 0; i < 4; ++i)
     {
       if (neighbors[i] != NULL)
       {
-        Quad* nNeighbors[4] = { NULL };
+        TerrainQuad* nNeighbors[4] = { NULL };
         nNeighbors[0] = task.map->findQuad(neighbors[i]->x()  , neighbors[i]->z()-1);
         nNeighbors[1] = task.map->findQuad(neighbors[i]->x()+1, neighbors[i]->z()  );
         nNeighbors[2] = task.map->findQuad(neighbors[i]->x()  , neighbors[i]->z()+1);
         nNeighbors[3] = task.map->findQuad(neighbors[i]->x()-1, neighbors[i]->z()  );
-        neighbors[i]->calculateNormals(nNeighbors, task.scale);
+        nNeighbors[(i+2) % 4] = task.quad;
+        neighbors[i]->calculateEdgeNormals(nNeighbors, task.scale, (i+2) % 4);
       }
     }
 
+    task.map->_map.endRead(thread->reader);
+
+    if (traced)
+    {
+      Trace::flowStart("Handoff", 2 * task.serial + 1);
+      Trace::end();
+    }
+
     instance->addFinishedTask(task);
   }
 
@@ -616,55 +412,101 @@ Map::Map(Fractal *pFractal, const std::string &pName)
 
   _worker = new Worker();
 
-  _workerThread = NULL;
-
   _scale = Vector3D(10.0f, 10.0f, 10.0f);
 
   _initializing = false;
   _initIndex = 0;
+  _visibleRing = 2;
+  _taskSerial = 0;
+
+  _prefetchTimer.setIntervalMsec(100);
+
+  _viewerX = _viewerZ = 0.0f;
+  _viewerDirX = _viewerDirZ = 0.0f;
 
-  _mapMutex = SDL_CreateMutex();
+  _memoryBudget = DEFAULT_MAX_QUADS * quadMemory();
+
+  _lodFactor = 0.0f;
+  _pixelError = 1.0f;
+  _triangleBudget = DEFAULT_TRIANGLE_BUDGET;
+
+  _occlusionCulling = true;
+  _graphics = true;
 }
 
 Map::~Map()
 {
-  if (_workerThread != NULL)
-  {
+  if (!_workerThreads.empty())
     _worker->kill();
 
+  for (unsigned int i = 0; i < _workerThreads.size(); ++i)
+  {
     int status = 0;
-    SDL_WaitThread(_workerThread, &status);
+    SDL_WaitThread(_workerThreads[i]->thread, &status);
 
     stringstream p;
-    p << "Worker thread finished with status code: " << status;
+    p << "Worker thread " << i << " finished with status code: " << status;
     print(p.str());
 
-    _workerThread = NULL;
+    delete _workerThreads[i];
   }
+  _workerThreads.clear();
 
+  // Quads of the tasks left in the queues are deleted with the worker
   delete _worker;
   _worker = NULL;
+  _unfinishedTasks.clear();
 
   _fractal = NULL;
 
   clear();
-
-  SDL_mutexV(_mapMutex);
-  SDL_DestroyMutex(_mapMutex);
-  _mapMutex = NULL;
 }
 
-float Map::tileValue(int quadPosX, int quadPosZ, int tilePosX, int tilePosZ)
+int Map::terrainSamples(int quadX, int quadZ, const Vector3D *points, int count,
+                        TerrainSample *samples)
 {
-  Quad *quad = findQuad(quadPosX, quadPosZ);
-  if (quad == NULL)
-    return 0.0f;
+  const int sH = DETAIL_HIGH_COUNT;
+
+  int found = 0;
+
+  // Consecutive points are usually over the same quad
+  Quad *quad = NULL;
+  int lastX = 0, lastZ = 0;
+  bool looked = false;
+
+  for (int i = 0; i < count; ++i)
+  {
+    // Tiles from the corner of quad (quadX, quadZ)
+    float tx = points[i].x / _scale.x + 0.5f * sH;
+    float tz = points[i].z / _scale.z + 0.5f * sH;
+    int dx = (int)floor(tx / sH);
+    int dz = (int)floor(tz / sH);
+
+    if ((!looked) || (dx != lastX) || (dz != lastZ))
+    {
+      quad = findQuad(quadX + dx, quadZ + dz);
+      lastX = dx;
+      lastZ = dz;
+      looked = true;
+    }
+
+    samples[i] = TerrainSample();
+    if (quad == NULL)
+      continue;
+
+    samples[i].found = true;
+    quad->surface(tx - dx * sH, tz - dz * sH, samples[i].height, samples[i].normal);
+    ++found;
+  }
 
-  float v1 = _scale.y * quad->value(tilePosX, tilePosZ);
-  float v2 = _scale.y * quad->value(tilePosX + 1, tilePosZ);
-  float v3 = _scale.y * quad->value(tilePosX + 1, tilePosZ + 1);
-  float v4 = _scale.y * quad->value(tilePosX, tilePosZ + 1);
-  return (v1 + v2 + v3 + v4) / 4.0f;
+  return found;
+}
+
+Map::TerrainSample Map::terrainSample(int quadX, int quadZ, const Vector3D &point)
+{
+  TerrainSample sample;
+  terrainSamples(quadX, quadZ, &point, 1, &sample);
+  return sample;
 }
 
 void Map::initFunctions()
@@ -672,58 +514,196 @@ void Map::initFunctions()
   glGenBuffersARB = (PFNGLGENBUFFERSARBPROC) SDL_GL_GetProcAddress("glGenBuffersARB");
   glBindBufferARB = (PFNGLBINDBUFFERARBPROC) SDL_GL_GetProcAddress("glBindBufferARB");
   glBufferDataARB = (PFNGLBUFFERDATAARBPROC) SDL_GL_GetProcAddress("glBufferDataARB");
+  glBufferSubDataARB = (PFNGLBUFFERSUBDATAARBPROC) SDL_GL_GetProcAddress("glBufferSubDataARB");
   glDeleteBuffersARB = (PFNGLDELETEBUFFERSARBPROC) SDL_GL_GetProcAddress("glDeleteBuffersARB");
+
+  createIndexBuffers();
+}
+
+void Map::createIndexBuffers()
+{
+  vector<unsigned short> indices;
+  TerrainQuad::buildIndices(indices, _indexRanges);
+
+  if (_indexVBO != 0)
+    glDeleteBuffersARB(1, &_indexVBO);
+
+  glGenBuffersARB(1, &_indexVBO);
+  glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, _indexVBO);
+  glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, indices.size() * sizeof(unsigned short),
+                  &indices[0], GL_STATIC_DRAW_ARB);
+
+  glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+}
+
+void Map::printMemoryUsage()
+{
+  const int sH = DETAIL_HIGH_COUNT;
+
+  // Previous layout: height field + vertices and normals as triangle soup
+  // (a Vector3D per index) for all levels of detail, both in RAM and VBOs
+  unsigned int soupVertices = 0;
+  for (int px = 0; px < PATCH_COUNT; ++px)
+  {
+    for (int pz = 0; pz < PATCH_COUNT; ++pz)
+    {
+      for (int lod = 0; lod < LOD_COUNT; ++lod)
+        soupVertices += _indexRanges[px][pz][lod].count;
+    }
+  }
+  const unsigned int soupSize = soupVertices * sizeof(Vector3D);
+  const unsigned int oldQuadRam = (1+sH) * (1+sH) * sizeof(float) + 2 * soupSize;
+  const unsigned int oldQuadVideo = 2 * soupSize;
+
+  const unsigned int quadRam = sizeof(Quad);
+  const unsigned int quadVideo = Quad::vertexCount() * (3 * sizeof(float) + sizeof(PackedNormal));
+  const IndexRange &last = _indexRanges[PATCH_COUNT-1][PATCH_COUNT-1][LOD_COUNT-1];
+  const unsigned int sharedVideo = (last.offset + last.count) * sizeof(unsigned short);
+
+  unsigned int resident = _map.size();
+
+  const double MB = 1024.0 * 1024.0;
+
+  stringstream p;
+  p.precision(2);
+  p << fixed;
+  p << "Quad memory: " << quadRam / 1024 << " KB RAM + " << quadVideo / 1024 << " KB VBO"
+    << " (was " << oldQuadRam / 1024 << " KB RAM + " << oldQuadVideo / 1024 << " KB VBO)";
+  print(p.str());
+
+  p.str("");
+  p << "Shared index buffers: " << sharedVideo / 1024 << " KB";
+  print(p.str());
+
+  p.str("");
+  p << "Resident quads: " << resident << ", "
+    << resident * quadRam / MB << " MB RAM + "
+    << (resident * quadVideo + sharedVideo) / MB << " MB VBO"
+    << " (was " << resident * oldQuadRam / MB << " MB RAM + "
+    << resident * oldQuadVideo / MB << " MB VBO)";
+  print(p.str());
+
+  int budgetQuads = maxQuads();
+
+  p.str("");
+  p << "Memory budget of " << budgetQuads << " quads: "
+    << budgetQuads * quadRam / MB << " MB RAM + "
+    << (budgetQuads * quadVideo + sharedVideo) / MB << " MB VBO"
+    << " (was " << budgetQuads * oldQuadRam / MB << " MB RAM + "
+    << budgetQuads * oldQuadVideo / MB << " MB VBO)";
+  print(p.str());
 }
 
-void Map::createWorkerThread()
+void Map::setMemoryBudget(int megabytes)
 {
-  _workerThread = SDL_CreateThread(Worker::run, (void*)(_worker));
-  print("Worker thread created");
+  _memoryBudget = max(0, megabytes) * 1024 * 1024;
 }
 
-void Map::clear()
+unsigned int Map::quadMemory()
+{
+  const unsigned int quadVideo = Quad::vertexCount() * (3 * sizeof(float) + sizeof(PackedNormal));
+  return sizeof(Quad) + quadVideo;
+}
+
+int Map::maxQuads() const
 {
-  SDL_mutexP(_mapMutex);
+  // Never less than the visible quads and one ring around them
+  int side = 2 * _visibleRing + 3;
+  return max((int)(_memoryBudget / quadMemory()), side * side);
+}
+
+void Map::setVisibleRing(int ring)
+{
+  _visibleRing = max(1, min(ring, (int)MAX_VISIBLE_RING));
+}
+
+void Map::createWorkerThreads()
+{
+  int count = processorCount();
+
+  for (int i = 0; i < count; ++i)
   {
-    for (QuadMapIterator it = _map.begin(); it != _map.end(); ++it)
-      delete (*it).second;
+    WorkerThread *thread = new WorkerThread(_worker);
+    thread->index = i;
+    thread->reader = _map.registerReader();
+    if (thread->reader < 0)
+    {
+      delete thread;
+      break;
+    }
 
-    _map.clear();
+    thread->thread = SDL_CreateThread(Worker::run, (void*)(thread));
+    if (thread->thread == NULL)
+    {
+      delete thread;
+      break;
+    }
+
+    _workerThreads.push_back(thread);
   }
-  SDL_mutexV(_mapMutex);
 
-  while (!_createdQuads.empty())
-    _createdQuads.pop();
+  stringstream p;
+  p << "Worker threads created: " << _workerThreads.size();
+  print(p.str());
+}
 
+void Map::clear()
+{
+  _pendingTasks.clear();
+  _prefetchRequests.clear();
+  _missedQuads.clear();
+
+  // Running tasks read and update their neighbors, so they must finish first
   while (!_unfinishedTasks.empty())
   {
     WorkerTask task = _worker->finishedTask();
     if (!task.valid)
       continue;
     _unfinishedTasks.erase(make_pair(task.x, task.z));
+    delete task.quad;
   }
+
+  vector<Quad*> quads;
+  _map.values(quads);
+  _map.clear();
+
+  for (unsigned int i = 0; i < quads.size(); ++i)
+    delete quads[i];
+
+  _evictedQuads.clear();
+  _requiredQuads.clear();
+
+  // An initialization cut short starts again with the next init()
+  _initializing = false;
 }
 
 float Map::initProgress() const
 {
-  return _initIndex / 25.0f;
+  int side = 2 * _visibleRing + 1;
+  return (float)_initIndex / (side * side);
 }
 
-bool Map::init()
+void Map::ringQuads(vector< pair<int, int> > &quads) const
 {
-  const int TASKS[][2] =
+  // Nearest rings first
+  quads.clear();
+  for (int ring = 0; ring <= _visibleRing; ++ring)
+  {
+    for (int dx = -ring; dx <= ring; ++dx)
     {
-      {0, 0},
-
-      { 1, 0}, { 1,  1}, {0,  1}, {-1,  1},
-      {-1, 0}, {-1, -1}, {0, -1}, { 1, -1},
+      for (int dz = -ring; dz <= ring; ++dz)
+      {
+        if (max(abs(dx), abs(dz)) == ring)
+          quads.push_back(make_pair(dx, dz));
+      }
+    }
+  }
+}
 
-      { 2,  0}, { 2,  1}, { 2,  2}, { 1,  2},
-      { 0,  2}, {-1,  2}, {-2,  2}, {-2,  1},
-      {-2,  0}, {-2, -1}, {-2, -2}, {-1, -2},
-      { 0, -2}, { 1, -2}, { 2, -2}, { 2, -1}
-    };
-  const int TASKS_SIZE = sizeof(TASKS) / sizeof(*TASKS);
+bool Map::init()
+{
+  vector< pair<int, int> > tasks;
+  ringQuads(tasks);
 
   if (!_initializing)
   {
@@ -731,99 +711,553 @@ bool Map::init()
 
     clear();
 
+    FractalOptions o = _fractal->options();
+    o.size = DETAIL_HIGH_POW;
+    _cache.setKey(o, _scale);
+
     _initializing = true;
     _initIndex = 0;
 
-    scheduleTask(TASKS[0][0], TASKS[0][1]);
+    // All quads are scheduled at once; those which do not depend
+    // on each other are generated concurrently by the worker pool
+    for (unsigned int i = 0; i < tasks.size(); ++i)
+      scheduleTask(tasks[i].first, tasks[i].second);
+
     return false;
   }
 
-  Quad *q = findQuad(TASKS[_initIndex][0], TASKS[_initIndex][1]);
-  if (q == NULL)
+  _initIndex = 0;
+  for (unsigned int i = 0; i < tasks.size(); ++i)
+  {
+    if (findQuad(tasks[i].first, tasks[i].second) != NULL)
+      ++_initIndex;
+  }
+
+  if (_initIndex < (int)tasks.size())
     return false;
 
-  ++_initIndex;
+  print("Map initialization finished");
+  _initializing = false;
+
+  return true;
+}
+
+Map::Quad* Map::findQuad(int x, int z)
+{
+  return _map.find(x, z);
+}
+
+void Map::setLodParameters(float fov, int viewportHeight, float pixelError)
+{
+  _lodFactor = viewportHeight / (2.0f * tan(0.5f * fov * M_PI / 180.0f));
+  _pixelError = pixelError;
+}
 
-  if (_initIndex >= TASKS_SIZE)
+Map::Quad* Map::visibleQuad(int x, int z)
+{
+  Quad * quad = findQuad(x, z);
+  if (quad != NULL)
   {
-    print("Map initialization finished");
-    _initializing = false;
+    if (quad->prefetched() && (!quad->rendered()))
+      ++_prefetchStats.hits;
 
-    return true;
+    quad->setRendered(true);
+    quad->setLastUsed(SDL_GetTicks());
   }
+  else
+  {
+    pair<int, int> position = make_pair(x, z);
 
-  scheduleTask(TASKS[_initIndex][0], TASKS[_initIndex][1]);
+    if (_missedQuads.insert(position).second)
+      ++_prefetchStats.misses;
 
-  return false;
+    // Prefetched too late
+    _prefetchRequests.erase(position);
+
+    scheduleTask(x, z);
+  }
+
+  return quad;
 }
 
-Map::Quad* Map::findQuad(int x, int z)
+void Map::render(int x, int z, const Vector3D &viewer, const Frustum &frustum)
 {
-  Quad *quad = NULL;
-  SDL_mutexP(_mapMutex);
+  ProfileScope scope("Map::render");
+
+  const int ring = _visibleRing;
+  const Vector3D s = quadSize();
+
+  _quadDraws.clear();
+  _patchDraws.clear();
+
+  // Quads and patches within the view frustum, with their levels of detail
+  for (int dx = -ring; dx <= ring; ++dx)
   {
-    QuadMapIterator it = _map.find(make_pair(x, z));
-    if (it != _map.end())
-      quad = (*it).second;
+    for (int dz = -ring; dz <= ring; ++dz)
+    {
+      Quad *quad = visibleQuad(x + dx, z + dz);
+      if (quad == NULL)
+        continue;
+
+      QuadDraw draw;
+      draw.quad = quad;
+      draw.offset = Vector3D(s.x * dx, 0.0f, s.z * dz);
+
+      draw.viewer = viewer - draw.offset;
+
+      Frustum quadFrustum = frustum.translated(draw.offset);
+
+      Vector3D minValues, maxValues;
+      quad->bounds(minValues, maxValues);
+
+      if (!quadFrustum.boxVisible(minValues, maxValues))
+      {
+        ++_renderStats.quadsCulled;
+        continue;
+      }
+
+      for (int px = 0; px < PATCH_COUNT; ++px)
+      {
+        for (int pz = 0; pz < PATCH_COUNT; ++pz)
+        {
+          quad->patchBounds(px, pz, minValues, maxValues);
+
+          if (!quadFrustum.boxVisible(minValues, maxValues))
+          {
+            draw.lods[px][pz] = -1;
+            ++_renderStats.patchesCulled;
+            continue;
+          }
+
+          draw.lods[px][pz] = 0;
+
+          float ddx = max(0.0f, max(minValues.x - draw.viewer.x, draw.viewer.x - maxValues.x));
+          float ddz = max(0.0f, max(minValues.z - draw.viewer.z, draw.viewer.z - maxValues.z));
+
+          PatchDraw patch;
+          patch.distance = sqrt(ddx * ddx + ddz * ddz);
+          patch.quad = _quadDraws.size();
+          patch.px = px;
+          patch.pz = pz;
+          _patchDraws.push_back(patch);
+        }
+      }
+
+      _quadDraws.push_back(draw);
+    }
+  }
+
+  if (_occlusionCulling)
+    cullOccludedPatches(viewer);
+
+  // Coarser levels everywhere, until the remaining patches are within the budget
+  float pixelError = _pixelError;
+  int triangles = selectDrawLods(_lodFactor / pixelError);
+  for (int i = 0; (i < MAX_LOD_REDUCTIONS) && (triangles > _triangleBudget); ++i)
+  {
+    pixelError *= 2.0f;
+    triangles = selectDrawLods(_lodFactor / pixelError);
+  }
+
+  _renderStats.triangles += triangles;
+  _renderStats.pixelError = max(_renderStats.pixelError, pixelError);
+
+  for (unsigned int i = 0; i < _quadDraws.size(); ++i)
+  {
+    const QuadDraw &draw = _quadDraws[i];
+
+    int patches = 0;
+    for (int px = 0; px < PATCH_COUNT; ++px)
+    {
+      for (int pz = 0; pz < PATCH_COUNT; ++pz)
+      {
+        if (draw.lods[px][pz] >= 0)
+          ++patches;
+      }
+    }
+
+    if (patches == 0)
+      continue;
+
+    ++_renderStats.quadsDrawn;
+    _renderStats.patchesDrawn += patches;
+
+    glPushMatrix();
+    {
+      glTranslatef(draw.offset.x, draw.offset.y, draw.offset.z);
+      draw.quad->render(draw.lods);
+    }
+    glPopMatrix();
   }
-  SDL_mutexV(_mapMutex);
-  return quad;
 }
 
-void Map::renderQuad(int x, int z, DetailLevel detailLevel)
+int Map::selectDrawLods(float lodScale)
 {
-  Quad * quad = findQuad(x, z);
-  if (quad != NULL)
+  int triangles = 0;
+
+  for (unsigned int i = 0; i < _quadDraws.size(); ++i)
+  {
+    QuadDraw &draw = _quadDraws[i];
+
+    int lods[PATCH_COUNT][PATCH_COUNT];
+    draw.quad->selectLods(draw.viewer, lodScale, lods);
+
+    // Culled patches stay skipped
+    for (int px = 0; px < PATCH_COUNT; ++px)
+    {
+      for (int pz = 0; pz < PATCH_COUNT; ++pz)
+      {
+        if (draw.lods[px][pz] < 0)
+          continue;
+
+        draw.lods[px][pz] = lods[px][pz];
+        triangles += TerrainQuad::patchTriangles(lods[px][pz]);
+      }
+    }
+  }
+
+  return triangles;
+}
+
+void Map::cullOccludedPatches(const Vector3D &viewer)
+{
+  sort(_patchDraws.begin(), _patchDraws.end());
+
+  _horizonCuller.reset(viewer);
+
+  // Front to back: each patch is tested against the nearer terrain, then becomes part of it
+  for (unsigned int i = 0; i < _patchDraws.size(); ++i)
   {
-    quad->render(detailLevel);
+    const PatchDraw &patch = _patchDraws[i];
+    QuadDraw &draw = _quadDraws[patch.quad];
+
+    Vector3D minValues, maxValues;
+    draw.quad->patchBounds(patch.px, patch.pz, minValues, maxValues);
+
+    if (_horizonCuller.occluded(minValues + draw.offset, maxValues + draw.offset))
+    {
+      draw.lods[patch.px][patch.pz] = -1;
+      ++_renderStats.patchesOccluded;
+    }
+
+    /* The cells of occluders are as large as the triangles of the coarsest
+       level, so the drawn surface is nowhere lower than their minimum */
+    const HeightPyramid &heights = draw.quad->heights();
+    const int cells = PATCH_SIZE / OCCLUDER_SIZE;
+    const float cellX = (maxValues.x - minValues.x) / cells;
+    const float cellZ = (maxValues.z - minValues.z) / cells;
+
+    for (int cx = 0; cx < cells; ++cx)
+    {
+      for (int cz = 0; cz < cells; ++cz)
+      {
+        float x0 = draw.offset.x + minValues.x + cx * cellX;
+        float z0 = draw.offset.z + minValues.z + cz * cellZ;
+        _horizonCuller.addOccluder(x0, z0, x0 + cellX, z0 + cellZ,
+                                   heights.minHeight(0, patch.px * cells + cx, patch.pz * cells + cz));
+      }
+    }
   }
-  else
+}
+
+int Map::quadTriangles(int x, int z, const Vector3D &viewer, float pixelError)
+{
+  Quad *quad = findQuad(x, z);
+  if (quad == NULL)
+    return 0;
+
+  int lods[PATCH_COUNT][PATCH_COUNT];
+  return quad->selectLods(viewer, _lodFactor / pixelError, lods);
+}
+
+float Map::arrivalTime(float px, float pz, float vx, float vz, int x, int z) const
+{
+  // Quad (x, z) becomes visible when the player is within the box around it
+
+  const float r = _visibleRing + 0.5f;
+  float p[2] = { px, pz };
+  float v[2] = { vx, vz };
+  float lo[2] = { x - r, z - r };
+  float hi[2] = { x + r, z + r };
+
+  float tMin = 0.0f, tMax = PREFETCH_HORIZON;
+
+  for (int i = 0; i < 2; ++i)
   {
-    scheduleTask(x, z);
+    if (fabs(v[i]) < 1e-6f)
+    {
+      if ((p[i] < lo[i]) || (p[i] > hi[i]))
+        return -1.0f;
+      continue;
+    }
+
+    float t1 = (lo[i] - p[i]) / v[i];
+    float t2 = (hi[i] - p[i]) / v[i];
+    if (t1 > t2)
+      swap(t1, t2);
+
+    tMin = max(tMin, t1);
+    tMax = min(tMax, t2);
   }
+
+  if (tMin > tMax)
+    return -1.0f;
+
+  return tMin;
+}
+
+void Map::setViewer(int quadX, int quadZ, const Vector3D &offset, const Vector3D &velocity)
+{
+  // Position and velocity in quads; quad (x, z) spans [x - 0.5, x + 0.5]
+  Vector3D qs = quadSize();
+  _viewerX = quadX + offset.x / qs.x;
+  _viewerZ = quadZ + offset.z / qs.z;
+  _viewerDirX = velocity.x / qs.x;
+  _viewerDirZ = velocity.z / qs.z;
 }
 
-void Map::scheduleTask(int x, int z)
+void Map::prefetch()
 {
-  if (_unfinishedTasks.find(make_pair(x, z)) != _unfinishedTasks.end())
+  if (_initializing || (!_prefetchTimer.checkTimeout()))
     return;
 
-  pair<int, int> neighbors[] =
+  float px = _viewerX;
+  float pz = _viewerZ;
+  float vx = _viewerDirX;
+  float vz = _viewerDirZ;
+
+  int quadX = (int)floor(px + 0.5f);
+  int quadZ = (int)floor(pz + 0.5f);
+
+  const int maxRing = _visibleRing + PREFETCH_RINGS;
+
+  vector< pair< float, pair<int, int> > > candidates;
+
+  for (int dx = -maxRing; dx <= maxRing; ++dx)
+  {
+    for (int dz = -maxRing; dz <= maxRing; ++dz)
     {
-      make_pair(x, z - 1),
-      make_pair(x + 1, z),
-      make_pair(x, z + 1),
-      make_pair(x - 1, z)
-    };
+      if (max(abs(dx), abs(dz)) <= _visibleRing)
+        continue;
+
+      int x = quadX + dx;
+      int z = quadZ + dz;
+
+      float eta = arrivalTime(px, pz, vx, vz, x, z);
+      if (eta < 0.0f)
+        continue;
+
+      if (findQuad(x, z) != NULL)
+        continue;
+
+      candidates.push_back(make_pair(eta, make_pair(x, z)));
+    }
+  }
+
+  // Nearest in time first
+  sort(candidates.begin(), candidates.end());
+
+  for (unsigned int i = 0; i < candidates.size(); ++i)
+  {
+    if (scheduleTask(candidates[i].second.first, candidates[i].second.second))
+    {
+      _prefetchRequests.insert(candidates[i].second);
+      ++_prefetchStats.scheduled;
+    }
+  }
+}
 
-  for (int i = 0; i < 4; ++i)
+void Map::printPrefetchStats()
+{
+  stringstream p;
+  p << "Prefetch: " << _prefetchStats.scheduled << " scheduled, "
+    << _prefetchStats.hits << " hits, "
+    << _prefetchStats.wasted << " wasted, "
+    << _prefetchStats.misses << " render misses";
+  print(p.str());
+}
+
+bool Map::scheduleTask(int x, int z)
+{
+  pair<int, int> position = make_pair(x, z);
+
+  if (_unfinishedTasks.find(position) != _unfinishedTasks.end())
+    return false;
+
+  if (find(_pendingTasks.begin(), _pendingTasks.end(), position) != _pendingTasks.end())
+    return false;
+
+  _pendingTasks.push_back(position);
+
+  dispatchTasks();
+
+  return true;
+}
+
+bool Map::taskConflicts(int x, int z) const
+{
+  /* A task reads the values of its neighbors and recalculates their normals,
+     so two tasks may run concurrently only if they have no common neighbors:
+     i.e. the distance between them is greater than 2. */
+
+  for (set< pair<int, int>, PairComparator >::const_iterator it = _unfinishedTasks.begin();
+       it != _unfinishedTasks.end(); ++it)
   {
-    if (_unfinishedTasks.find(neighbors[i]) != _unfinishedTasks.end())
-      return;
+    if (abs((*it).first - x) + abs((*it).second - z) <= 2)
+      return true;
   }
 
-  WorkerTask task;
-  task.valid = true;
-  task.x = x;
-  task.z = z;
-  task.quad = new Quad(x, z);
-  task.fractal = _fractal;
-  task.scale = _scale;
-  task.map = this;
+  return false;
+}
+
+float Map::taskPriority(int x, int z) const
+{
+  // Distance from the player, increased for quads behind him (lower is more urgent)
+
+  float dx = x - _viewerX;
+  float dz = z - _viewerZ;
+  float distance = sqrt(dx * dx + dz * dz);
+
+  float directionLength = sqrt(_viewerDirX * _viewerDirX + _viewerDirZ * _viewerDirZ);
+  if ((distance < 1e-3f) || (directionLength < 1e-6f))
+    return distance;
+
+  float cosAngle = (dx * _viewerDirX + dz * _viewerDirZ) / (distance * directionLength);
+
+  return distance * (1.5f - 0.5f * cosAngle);
+}
 
+bool Map::taskNeeded(int x, int z) const
+{
+  int viewerQuadX = (int)floor(_viewerX + 0.5f);
+  int viewerQuadZ = (int)floor(_viewerZ + 0.5f);
+  int ring = max(abs(x - viewerQuadX), abs(z - viewerQuadZ));
+  return (ring <= _visibleRing + PREFETCH_RINGS) || quadRequired(x, z);
+}
+
+bool Map::quadRequired(int x, int z) const
+{
+  return binary_search(_requiredQuads.begin(), _requiredQuads.end(), make_pair(x, z));
+}
+
+bool Map::requireQuads(const vector< pair<int, int> > &quads)
+{
+  _requiredQuads = quads;
+  sort(_requiredQuads.begin(), _requiredQuads.end());
+  _requiredQuads.erase(unique(_requiredQuads.begin(), _requiredQuads.end()), _requiredQuads.end());
+
+  for (unsigned int i = 0; i < _requiredQuads.size(); ++i)
   {
-    stringstream p;
-    p << "Creating field: (" << x << ", " << z << ")";
-    print(p.str());
+    if (findQuad(_requiredQuads[i].first, _requiredQuads[i].second) == NULL)
+      return false;
+  }
+
+  return true;
+}
+
+void Map::dispatchTasks()
+{
+  // Tasks no longer needed are cancelled before they are started
+
+  list< pair<int, int> >::iterator it = _pendingTasks.begin();
+  while (it != _pendingTasks.end())
+  {
+    if (findQuad((*it).first, (*it).second) != NULL)
+    {
+      it = _pendingTasks.erase(it);
+    }
+    else if (!taskNeeded((*it).first, (*it).second))
+    {
+      _prefetchRequests.erase(*it);
+      ++_taskStats.cancelled;
+      it = _pendingTasks.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+
+  /* Only a few tasks per thread are given to the worker, so that the order
+     of the rest can still change as the player moves */
+  int threadCount = max(1, (int)_workerThreads.size());
+  int freeSlots = TASKS_PER_THREAD * threadCount - (int)_unfinishedTasks.size();
+
+  while (freeSlots > 0)
+  {
+    // Most urgent task which does not conflict with the running ones
+    list< pair<int, int> >::iterator best = _pendingTasks.end();
+    float bestPriority = 0.0f;
+
+    for (it = _pendingTasks.begin(); it != _pendingTasks.end(); ++it)
+    {
+      float priority = taskPriority((*it).first, (*it).second);
+      if ((best != _pendingTasks.end()) && (priority >= bestPriority))
+        continue;
+
+      if (taskConflicts((*it).first, (*it).second))
+        continue;
+
+      best = it;
+      bestPriority = priority;
+    }
+
+    if (best == _pendingTasks.end())
+      break;
+
+    int x = (*best).first;
+    int z = (*best).second;
+
+    WorkerTask task;
+    task.valid = true;
+    task.cached = _cache.contains(x, z);
+    task.x = x;
+    task.z = z;
+    task.priority = bestPriority;
+    task.quad = new Quad(x, z);
+    task.fractalOptions = _fractal->options();
+    task.fractalOptions.size = DETAIL_HIGH_POW;
+    task.scale = _scale;
+    task.map = this;
+
+    {
+      stringstream p;
+      if (task.cached)
+        p << "Loading field: (" << x << ", " << z << ")";
+      else
+        p << "Creating field: (" << x << ", " << z << ")";
+      print(p.str());
+    }
+
+    task.serial = ++_taskSerial;
+    Trace::instant("Dispatch", x, z);
+    Trace::flowStart("Queue", 2 * task.serial);
+
+    _worker->scheduleTask(task);
+    _unfinishedTasks.insert(make_pair(x, z));
+    ++_taskStats.dispatched;
+
+    _pendingTasks.erase(best);
+    --freeSlots;
   }
+}
 
-  _worker->scheduleTask(task);
-  _unfinishedTasks.insert(make_pair(x, z));
+void Map::printTaskStats()
+{
+  stringstream p;
+  p << "Tasks: " << _pendingTasks.size() << " pending, "
+    << _unfinishedTasks.size() << " in progress, "
+    << _taskStats.dispatched << " dispatched, "
+    << _taskStats.cancelled << " cancelled";
+  print(p.str());
 }
 
 void Map::update()
 {
-  for (;;)
+  ProfileScope scope("Map::update");
+
+  // Uploads are limited, so that a burst of created quads does not stall a frame
+  for (int uploads = 0; _initializing || (uploads < UPLOADS_PER_UPDATE); ++uploads)
   {
     WorkerTask task = _worker->finishedTask();
     if (!task.valid)
@@ -835,37 +1269,122 @@ void Map::update()
       print(p.str());
     }
 
-    SDL_mutexP(_mapMutex);
-    {
-      _map[make_pair(task.x, task.z)] = task.quad;
-    }
-    SDL_mutexV(_mapMutex);
+    Trace::flowEnd("Handoff", 2 * task.serial + 1);
 
-    task.quad->createVBO();
+    pair<int, int> position = make_pair(task.x, task.z);
 
-    Quad* neighbors[4] = { NULL };
-    neighbors[0] = findQuad(task.x  , task.z-1);
-    neighbors[1] = findQuad(task.x+1, task.z  );
-    neighbors[2] = findQuad(task.x  , task.z+1);
-    neighbors[3] = findQuad(task.x-1, task.z  );
+    task.quad->setPrefetched(_prefetchRequests.erase(position) > 0);
+    task.quad->setLastUsed(SDL_GetTicks());
+    _missedQuads.erase(position);
 
-    for (int i = 0; i < 4; ++i)
+    if (_evictedQuads.erase(position) > 0)
+      ++_evictionStats.regenerated;
+
+    _map.insert(task.x, task.z, task.quad);
+
+    if (_graphics)
     {
-      if (neighbors[i] != NULL)
+      ProfileScope uploadScope("VBO uploads");
+
+      task.quad->createVBO();
+
+      Quad* neighbors[4] = { NULL };
+      neighbors[0] = findQuad(task.x  , task.z-1);
+      neighbors[1] = findQuad(task.x+1, task.z  );
+      neighbors[2] = findQuad(task.x  , task.z+1);
+      neighbors[3] = findQuad(task.x-1, task.z  );
+
+      for (int i = 0; i < 4; ++i)
       {
-        neighbors[i]->destroyVBO();
-        neighbors[i]->createVBO();
+        if (neighbors[i] != NULL)
+          neighbors[i]->updateEdgeVBO((i+2) % 4);
       }
     }
 
     _unfinishedTasks.erase(make_pair(task.x, task.z));
+  }
+
+  // Nothing is rendered without graphics, so the quads around the viewer are requested here
+  if ((!_graphics) && (!_initializing))
+  {
+    int viewerQuadX = (int)floor(_viewerX + 0.5f);
+    int viewerQuadZ = (int)floor(_viewerZ + 0.5f);
 
-    _createdQuads.push(make_pair(task.x, task.z));
+    for (int dx = -_visibleRing; dx <= _visibleRing; ++dx)
+    {
+      for (int dz = -_visibleRing; dz <= _visibleRing; ++dz)
+        visibleQuad(viewerQuadX + dx, viewerQuadZ + dz);
+    }
   }
 
-  while (_createdQuads.size() > 100)
+  for (unsigned int i = 0; i < _requiredQuads.size(); ++i)
   {
-    pair<int, int> q = _createdQuads.front();
+    if (findQuad(_requiredQuads[i].first, _requiredQuads[i].second) == NULL)
+      scheduleTask(_requiredQuads[i].first, _requiredQuads[i].second);
+  }
+
+  dispatchTasks();
+
+  evictQuads();
+}
+
+void Map::evictQuads()
+{
+  int limit = maxQuads();
+
+  int count = _map.size();
+
+  _evictionStats.peakQuads = max(_evictionStats.peakQuads, count);
+
+  if (count <= limit)
+    return;
+
+  /* Quads far from the player and unused for a long time go first. Visible
+     and required quads and the neighbors of quads being created (which the
+     worker reads) are never evicted, even if that exceeds the budget. */
+
+  unsigned int now = SDL_GetTicks();
+  int viewerQuadX = (int)floor(_viewerX + 0.5f);
+  int viewerQuadZ = (int)floor(_viewerZ + 0.5f);
+
+  vector< pair<float, pair<int, int> > > candidates;
+
+  vector<Quad*> quads;
+  _map.values(quads);
+
+  for (unsigned int i = 0; i < quads.size(); ++i)
+  {
+    int x = quads[i]->x();
+    int z = quads[i]->z();
+
+    if (max(abs(x - viewerQuadX), abs(z - viewerQuadZ)) <= _visibleRing)
+      continue;
+
+    if (taskConflicts(x, z) || quadRequired(x, z))
+      continue;
+
+    float dx = x - _viewerX;
+    float dz = z - _viewerZ;
+    float age = 0.001f * (now - quads[i]->lastUsed());
+
+    float score = sqrt(dx * dx + dz * dz) + age / EVICTION_AGE;
+    candidates.push_back(make_pair(score, make_pair(x, z)));
+  }
+
+  int excess = count - limit;
+  if (excess > (int)candidates.size())
+  {
+    ++_evictionStats.overBudget;
+    excess = candidates.size();
+  }
+
+  // Highest scores first
+  partial_sort(candidates.begin(), candidates.begin() + excess, candidates.end(),
+               greater< pair<float, pair<int, int> > >());
+
+  for (int i = 0; i < excess; ++i)
+  {
+    pair<int, int> q = candidates[i].second;
 
     {
       stringstream p;
@@ -873,15 +1392,40 @@ void Map::update()
       print(p.str());
     }
 
-    SDL_mutexP(_mapMutex);
-    {
-      QuadMapIterator it = _map.find(q);
-      (*it).second->destroyVBO();
-      delete (*it).second;
-      _map.erase(it);
-    }
-    SDL_mutexV(_mapMutex);
+    // The worker threads do not use quads which are not conflicting with their tasks
+    Quad *quad = _map.find(q.first, q.second);
+    _map.erase(q.first, q.second);
+
+    if (quad->prefetched() && (!quad->rendered()))
+      ++_prefetchStats.wasted;
+    quad->destroyVBO();
+    delete quad;
+
+    float dx = q.first - _viewerX;
+    float dz = q.second - _viewerZ;
 
-    _createdQuads.pop();
+    ++_evictionStats.evicted;
+    _evictionStats.distanceSum += sqrt(dx * dx + dz * dz);
+    _evictedQuads.insert(q);
   }
 }
+
+void Map::printEvictionStats()
+{
+  int resident = _map.size();
+
+  stringstream p;
+  p.precision(2);
+  p << fixed;
+  p << "Eviction: " << resident << " quads resident (peak " << _evictionStats.peakQuads
+    << ", budget " << maxQuads() << " quads, " << _memoryBudget / (1024 * 1024) << " MB)";
+  print(p.str());
+
+  p.str("");
+  p << _evictionStats.evicted << " evicted";
+  if (_evictionStats.evicted > 0)
+    p << " at mean distance " << _evictionStats.distanceSum / _evictionStats.evicted << " quads";
+  p << ", " << _evictionStats.regenerated << " created again, "
+    << _evictionStats.overBudget << " times over budget";
+  print(p.str());
+}
@@ -13,29 +13,55 @@
 
 #include "object.h"
 #include "common.h"
-
-#include <map>
+#include "fractal.h"
+#include "normals.h"
+#include "quadcache.h"
+#include "terrain.h"
+#include "quadtable.h"
+#include "frustum.h"
+#include "occlusion.h"
+
+#include <list>
 #include <queue>
 #include <set>
+#include <vector>
 
 #include <SDL/SDL_thread.h>
 #include <SDL/SDL_mutex.h>
 
-class Fractal;
-
 class Map : public Object
 {
   public:
-    enum DetailLevel
+    // Counts of the geometry drawn by render()
+    struct RenderStats
+    {
+      int triangles;
+      int quadsDrawn, quadsCulled;
+      int patchesDrawn, patchesCulled, patchesOccluded;
+      // Allowed error on screen [px], raised to keep within the triangle budget
+      float pixelError;
+
+      RenderStats() : triangles(0), quadsDrawn(0), quadsCulled(0),
+                      patchesDrawn(0), patchesCulled(0), patchesOccluded(0),
+                      pixelError(0.0f) {}
+    };
+
+    // Surface of the terrain under a point
+    struct TerrainSample
     {
-      // 128x128
-      DetailHigh,
-      // 64x64
-      DetailMedium,
-      // 32x32
-      DetailLow
+      // False when the quad under the point is not created yet
+      bool found;
+      float height;
+      Vector3D normal;
+
+      TerrainSample() : found(false), height(0.0f), normal(0.0f, 1.0f, 0.0f) {}
     };
 
+    // Largest ring of quads rendered around the player (15 x 15 quads)
+    static const int MAX_VISIBLE_RING = 7;
+    // Default triangle budget of a frame
+    static const int DEFAULT_TRIANGLE_BUDGET = 500000;
+
   public:
     Map(Fractal *pFractal, const std::string &pName = "");
     virtual ~Map();
@@ -46,6 +72,24 @@ class Map : public Object
     inline void setScale(const Vector3D &pScale)
       { _scale = pScale; }
 
+    inline void setCacheEnabled(bool pEnabled)
+      { _cache.setEnabled(pEnabled); }
+
+    inline void setCacheDirectory(const std::string &pDirectory)
+      { _cache.setDirectory(pDirectory); }
+
+    // Memory [MB] of quads kept in RAM and video memory
+    void setMemoryBudget(int megabytes);
+
+    // Rings of quads rendered around the player, from 1 to MAX_VISIBLE_RING
+    void setVisibleRing(int ring);
+    inline int visibleRing() const
+      { return _visibleRing; }
+
+    // Triangles of terrain drawn in a frame, at most
+    inline void setTriangleBudget(int pTriangles)
+      { _triangleBudget = pTriangles; }
+
     inline Vector3D quadSize() const
     {
       return Vector3D(_scale.x * DETAIL_HIGH_COUNT,
@@ -58,11 +102,18 @@ class Map : public Object
       return _scale;
     }
 
-    float tileValue(int quadPosX, int quadPosZ, int tilePosX, int tilePosZ);
+    /* Surface under points given relative to the center of quad (quadX,
+       quadZ), like positions of players; points may lie in other quads.
+       Returns the number of points over created quads. */
+    int terrainSamples(int quadX, int quadZ, const Vector3D *points, int count,
+                       TerrainSample *samples);
+    TerrainSample terrainSample(int quadX, int quadZ, const Vector3D &point);
 
     static void initFunctions();
 
-    void createWorkerThread();
+    void printMemoryUsage();
+
+    void createWorkerThreads();
 
     void clear();
 
@@ -70,69 +121,144 @@ class Map : public Object
 
     float initProgress() const;
 
-    void renderQuad(int x, int z, DetailLevel detailLevel);
+    /* Sets the detail of the rendered quads: patches are drawn with the
+       coarsest level whose error on screen is below pixelError */
+    void setLodParameters(float fov, int viewportHeight, float pixelError);
+
+    /* Renders the quads within the visible ring around quad (x, z); viewer
+       is the camera position and frustum is the view frustum, both relative
+       to the center of quad (x, z) */
+    void render(int x, int z, const Vector3D &viewer, const Frustum &frustum);
+
+    /* Without graphics (no OpenGL context), quads are not uploaded and
+       must not be rendered; heights and normals are still available, and
+       update() requests the quads around the viewer instead of render() */
+    inline void setGraphics(bool pGraphics)
+      { _graphics = pGraphics; }
+    inline bool graphics() const
+      { return _graphics; }
+
+    // Culling of terrain hidden behind nearer terrain
+    inline void setOcclusionCulling(bool pEnabled)
+      { _occlusionCulling = pEnabled; }
+    inline bool occlusionCulling() const
+      { return _occlusionCulling; }
+
+    // Triangles of the whole quad at the given pixelError
+    int quadTriangles(int x, int z, const Vector3D &viewer, float pixelError);
+
+    inline void resetRenderStats()
+      { _renderStats = RenderStats(); }
+    // Geometry drawn since resetRenderStats()
+    inline const RenderStats& renderStats() const
+      { return _renderStats; }
+
+    // Player's quad, position in it and velocity, for the scheduling of quads
+    void setViewer(int quadX, int quadZ, const Vector3D &offset, const Vector3D &velocity);
+
+    // Schedules quads which will become visible soon
+    void prefetch();
+
+    /* Quads which must be created whatever the viewer, e.g. those under
+       planes far from it: update() requests them, and they are neither
+       cancelled nor evicted until the next call. Returns true if all of
+       them are created already. */
+    bool requireQuads(const std::vector< std::pair<int, int> > &quads);
+
+    void printPrefetchStats();
+
+    void printTaskStats();
+
+    void printEvictionStats();
 
     void update();
 
   private:
-    static const int DETAIL_HIGH_POW = 7;
-    static const int DETAIL_HIGH_COUNT = 128;
-    static const int DETAIL_MEDIUM_COUNT = 64;
-    static const int DETAIL_LOW_COUNT = 32;
+    static const int DETAIL_HIGH_POW = TerrainQuad::SIZE_POW;
+    static const int DETAIL_HIGH_COUNT = TerrainQuad::SIZE;
 
-    class Quad
-    {
-      public:
-        Quad(int x, int z) : _x(x), _z(z) {}
-        ~Quad() {}
+    static const int PATCH_SIZE = TerrainQuad::PATCH_SIZE;
+    static const int PATCH_COUNT = TerrainQuad::PATCH_COUNT;
+    static const int LOD_COUNT = TerrainQuad::LOD_COUNT;
+    static const int OCCLUDER_SIZE = TerrainQuad::OCCLUDER_SIZE;
 
-        inline int x() const
-          { return _x; }
-        inline int z() const
-          { return _z; }
+    // Default memory budget, in quads
+    static const int DEFAULT_MAX_QUADS = 100;
 
-        inline int seed() const
-          { return (_x * 0x1f1f1f1f) ^ _z; }
+    // Rings of quads prefetched beyond the visible ones
+    static const int PREFETCH_RINGS = 2;
+    // Quads arriving later than this [s] are not prefetched
+    static const float PREFETCH_HORIZON;
 
-        void generate(Quad* neighbors[4], const Vector3D &scale,
-                      Fractal *fractal);
-        
-        void calculateNormals(Quad* neighbors[4], const Vector3D &scale);
+    // Tasks given at once to each worker thread
+    static const int TASKS_PER_THREAD = 4;
+    // Created quads uploaded to video memory in one update(), after initialization
+    static const int UPLOADS_PER_UPDATE = 4;
+    // Times the allowed error may be doubled to keep within the triangle budget
+    static const int MAX_LOD_REDUCTIONS = 4;
 
-        void createVBO();
+    // Time [s] unused that counts as much as one quad of distance, when evicting
+    static const float EVICTION_AGE;
 
-        void render(DetailLevel detailLevel) const;
+    typedef TerrainQuad::IndexRange IndexRange;
 
-        void destroyVBO();
+    // Index buffer shared by all quads, with a range for each patch and level
+    static unsigned int _indexVBO;
+    static IndexRange _indexRanges[PATCH_COUNT][PATCH_COUNT][LOD_COUNT];
 
-        float value(int x, int z) const;
+    // Quad with its geometry uploaded to video memory
+    class Quad : public TerrainQuad
+    {
+      public:
+        Quad(int x, int z) : TerrainQuad(x, z), _prefetched(false), _rendered(false),
+                             _lastUsed(0), _verticesVBO(0), _normalsVBO(0) {}
+        virtual ~Quad() {}
+
+        inline bool prefetched() const
+          { return _prefetched; }
+        inline void setPrefetched(bool pPrefetched)
+          { _prefetched = pPrefetched; }
+
+        inline bool rendered() const
+          { return _rendered; }
+        inline void setRendered(bool pRendered)
+          { _rendered = pRendered; }
+
+        // Time [ms] when the quad was last rendered (or created)
+        inline unsigned int lastUsed() const
+          { return _lastUsed; }
+        inline void setLastUsed(unsigned int pLastUsed)
+          { _lastUsed = pLastUsed; }
 
-      private:
-        const int _x, _z;
+        void createVBO();
 
-        float _values[1+DETAIL_HIGH_COUNT][1+DETAIL_HIGH_COUNT];
+        // Uploads normals of the given edge (after calculateEdgeNormals())
+        void updateEdgeVBO(int side);
 
-        Vector3D _detailHighVertices[6 * DETAIL_HIGH_COUNT * DETAIL_HIGH_COUNT];
-        Vector3D _detailHighNormals[6 * DETAIL_HIGH_COUNT * DETAIL_HIGH_COUNT];
+        // Draws the patches at the given levels; those with level -1 are skipped
+        void render(const int lods[PATCH_COUNT][PATCH_COUNT]) const;
 
-        Vector3D _detailMediumVertices[6 * DETAIL_MEDIUM_COUNT * DETAIL_MEDIUM_COUNT];
-        Vector3D _detailMediumNormals[6 * DETAIL_MEDIUM_COUNT * DETAIL_MEDIUM_COUNT];
+        void destroyVBO();
 
-        Vector3D _detailLowVertices[6 * DETAIL_LOW_COUNT * DETAIL_LOW_COUNT];
-        Vector3D _detailLowNormals[6 * DETAIL_LOW_COUNT * DETAIL_LOW_COUNT];
+      private:
+        bool _prefetched, _rendered;
 
-        unsigned int _detailHighVerticesVBO, _detailHighNormalsVBO;
-        unsigned int _detailMediumVerticesVBO, _detailMediumNormalsVBO;
-        unsigned int _detailLowVerticesVBO, _detailLowNormalsVBO;
+        unsigned int _lastUsed;
 
-        void filterValues(float v0, float &v1, float &v2, float &v3, float v4);
+        unsigned int _verticesVBO, _normalsVBO;
     };
 
     struct WorkerTask
     {
       bool valid;
+      // Quad is to be loaded from the cache instead of generated
+      bool cached;
       int x, z;
-      Fractal *fractal;
+      // Lower is more urgent
+      float priority;
+      // Number of the task, identifying it on the trace
+      unsigned int serial;
+      FractalOptions fractalOptions;
       Vector3D scale;
       Quad *quad;
       Map *map;
@@ -140,13 +266,39 @@ class Map : public Object
       WorkerTask()
       {
         valid = false;
+        cached = false;
         x = z = 0;
-        fractal = NULL;
+        priority = 0.0f;
+        serial = 0;
         quad = NULL;
         map = NULL;
       }
     };
 
+    struct WorkerTaskComparator
+    {
+      bool operator()(const WorkerTask &t1, const WorkerTask &t2) const
+      {
+        return t1.priority > t2.priority;
+      }
+    };
+
+    class Worker;
+
+    // Data of a single thread of the worker pool; each thread has its own
+    // Fractal, so that quads can be generated concurrently
+    struct WorkerThread
+    {
+      Worker *worker;
+      Fractal fractal;
+      SDL_Thread *thread;
+      // Reader slot in the quad table
+      int reader;
+      int index;
+
+      WorkerThread(Worker *pWorker) : worker(pWorker), thread(NULL), reader(-1), index(0) {}
+    };
+
     class Worker
     {
       public:
@@ -160,7 +312,9 @@ class Map : public Object
         static int run(void *data);
 
       private:
-        std::queue<WorkerTask> _scheduledTasks, _finishedTasks;
+        std::priority_queue< WorkerTask, std::vector<WorkerTask>,
+                             WorkerTaskComparator > _scheduledTasks;
+        std::queue<WorkerTask> _finishedTasks;
         SDL_mutex *_exitCodeMutex, *_scheduledTaskMutex, *_finishedTaskMutex;
         SDL_cond *_scheduledTaskCond;
         int _exitCode;
@@ -170,6 +324,49 @@ class Map : public Object
         void addFinishedTask(const WorkerTask &task);
     };
 
+    struct PrefetchStats
+    {
+      int scheduled, hits, wasted, misses;
+
+      PrefetchStats() : scheduled(0), hits(0), wasted(0), misses(0) {}
+    };
+
+    // Quad visible in the current frame
+    struct QuadDraw
+    {
+      Quad *quad;
+      // Position relative to the center quad and the viewer relative to the quad
+      Vector3D offset, viewer;
+      int lods[PATCH_COUNT][PATCH_COUNT];
+    };
+
+    // Patch within the view frustum, in the current frame
+    struct PatchDraw
+    {
+      float distance;
+      int quad;
+      int px, pz;
+
+      inline bool operator<(const PatchDraw &other) const
+        { return distance < other.distance; }
+    };
+
+    struct EvictionStats
+    {
+      int evicted, regenerated, overBudget, peakQuads;
+      float distanceSum;
+
+      EvictionStats() : evicted(0), regenerated(0), overBudget(0),
+                        peakQuads(0), distanceSum(0.0f) {}
+    };
+
+    struct TaskStats
+    {
+      int dispatched, cancelled;
+
+      TaskStats() : dispatched(0), cancelled(0) {}
+    };
+
     class PairComparator
     {
       public:
@@ -182,22 +379,63 @@ class Map : public Object
     };
 
   private:
-    typedef std::map< std::pair<int, int>,
-                      Quad*, PairComparator > QuadMap;
-    typedef std::map< std::pair<int, int>,
-                      Quad*, PairComparator >::iterator QuadMapIterator;
+    // Modified only by the main thread; read by the worker threads without locking
+    typedef QuadTable<Quad> QuadMap;
 
     Fractal *_fractal;
     QuadMap _map;
     Vector3D _scale;
-    SDL_Thread *_workerThread;
+    QuadCache _cache;
+    std::vector<WorkerThread*> _workerThreads;
     Worker *_worker;
-    SDL_mutex *_mapMutex;
+    std::list< std::pair<int, int> > _pendingTasks;
     std::set< std::pair<int, int>, PairComparator > _unfinishedTasks;
-    std::queue< std::pair<int, int> > _createdQuads;
+    unsigned int _taskSerial;
     bool _initializing;
     int _initIndex;
+    int _visibleRing;
+
+    Timer _prefetchTimer;
+    // Quads scheduled by prefetch() and not yet created
+    std::set< std::pair<int, int>, PairComparator > _prefetchRequests;
+    // Quads missing when they were to be rendered
+    std::set< std::pair<int, int>, PairComparator > _missedQuads;
+    PrefetchStats _prefetchStats;
+    TaskStats _taskStats;
+    unsigned int _memoryBudget;
+    // Quads evicted and not created again since
+    std::set< std::pair<int, int>, PairComparator > _evictedQuads;
+    // Quads given to requireQuads(), sorted
+    std::vector< std::pair<int, int> > _requiredQuads;
+    EvictionStats _evictionStats;
+    // Player's position and direction of flight in quads
+    float _viewerX, _viewerZ;
+    float _viewerDirX, _viewerDirZ;
+    // Screen height / (2 tan(fov/2)) and allowed error on screen [px]
+    float _lodFactor, _pixelError;
+    int _triangleBudget;
+    RenderStats _renderStats;
+    bool _occlusionCulling;
+    bool _graphics;
+    HorizonCuller _horizonCuller;
+    std::vector<QuadDraw> _quadDraws;
+    std::vector<PatchDraw> _patchDraws;
+
+    static void createIndexBuffers();
 
     Quad* findQuad(int x, int z);
-    void scheduleTask(int x, int z);
+    bool scheduleTask(int x, int z);
+    void ringQuads(std::vector< std::pair<int, int> > &quads) const;
+    float arrivalTime(float px, float pz, float vx, float vz, int x, int z) const;
+    bool taskConflicts(int x, int z) const;
+    float taskPriority(int x, int z) const;
+    bool taskNeeded(int x, int z) const;
+    bool quadRequired(int x, int z) const;
+    void dispatchTasks();
+    static unsigned int quadMemory();
+    int maxQuads() const;
+    void evictQuads();
+    Quad* visibleQuad(int x, int z);
+    void cullOccludedPatches(const Vector3D &viewer);
+    int selectDrawLods(float lodScale);
 };
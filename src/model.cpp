@@ -42,11 +42,13 @@ void Model::destroy()
   if (!_valid)
     return;
 
-  glDeleteLists(_list, 1);
+  if (_list != 0)
+    glDeleteLists(_list, 1);
+  _list = 0;
   _valid = false;
 }
 
-bool Model::load(const std::string& pFileName)
+bool Model::load(const std::string& pFileName, bool pGraphics)
 {
   ifstream f(pFileName.c_str());
   if (!f.good())
@@ -177,6 +179,14 @@ bool Model::load(const std::string& pFileName)
   if (faces3.empty() && faces4.empty())
     return false;
 
+  // Without graphics only the bounding box is kept
+  if (!pGraphics)
+  {
+    _valid = true;
+    print(string("Loaded bounds of model '") + pFileName + "'");
+    return true;
+  }
+
   _list = glGenLists(1);
 
   glNewList(_list, GL_COMPILE);
@@ -257,7 +267,7 @@ bool Model::load(const std::string& pFileName)
 
 void Model::render()
 {
-  if (!_valid)
+  if ((!_valid) || (_list == 0))
     return;
 
   glCallList(_list);
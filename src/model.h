@@ -25,7 +25,8 @@ class Model : public Object
     inline bool valid() const
       { return _valid; }
 
-    bool load(const std::string &pFileName);
+    // Without graphics, no display list is made (render() draws nothing)
+    bool load(const std::string &pFileName, bool pGraphics = true);
 
     inline Vector3D boundingBoxMin() const
       { return _boundMin; }
@@ -0,0 +1,262 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* normals.cpp
+    Contains the implementation of normal calculating functions. */
+
+#include "normals.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+
+// Rounds v from [-127, 127] to the nearest integer; faster than floorf(v + 0.5f)
+static inline signed char roundComponent(float v)
+{
+  return (signed char)((int)(v + 128.5f) - 128);
+}
+
+static inline void packNormal(float x, float y, float z, PackedNormal &n)
+{
+  float length = sqrtf(x * x + y * y + z * z);
+
+  n.x = roundComponent(127.0f * (x / length));
+  n.y = roundComponent(127.0f * (y / length));
+  n.z = roundComponent(127.0f * (z / length));
+  n.w = 0;
+}
+
+/* Normals of vertices [from, to) of a row; up, center and down point at
+   vertex 0 of rows x-1, x and x+1.
+
+   For vertex (x, z), summing the normals of its six triangles gives:
+    nx = sy*sz * (2*(h[x-1][z] - h[x+1][z]) + h[x-1][z-1] - h[x+1][z+1] + h[x][z+1] - h[x][z-1])
+    ny = 6*sx*sz
+    nz = sx*sy * (2*(h[x][z-1] - h[x][z+1]) + h[x-1][z-1] - h[x+1][z+1] + h[x+1][z] - h[x-1][z]) */
+static void calculateRowScalar(const float *up, const float *center, const float *down,
+                               int from, int to, float cx, float cy, float cz,
+                               PackedNormal *normals)
+{
+  for (int z = from; z < to; ++z)
+  {
+    float diagonal = up[z-1] - down[z+1];
+
+    float a = 2.0f * (up[z] - down[z]) + diagonal + (center[z+1] - center[z-1]);
+    float b = 2.0f * (center[z-1] - center[z+1]) + diagonal + (down[z] - up[z]);
+
+    packNormal(cx * a, cy, cz * b, normals[z]);
+  }
+}
+
+#if defined(__AVX__) || defined(__SSE__)
+
+#if defined(__AVX__)
+typedef __m256 VectorFloat;
+const int VECTOR_SIZE = 8;
+#define VF_SET1 _mm256_set1_ps
+#define VF_LOAD _mm256_loadu_ps
+#define VF_STORE _mm256_storeu_ps
+#define VF_ADD _mm256_add_ps
+#define VF_SUB _mm256_sub_ps
+#define VF_MUL _mm256_mul_ps
+#define VF_DIV _mm256_div_ps
+#define VF_SQRT _mm256_sqrt_ps
+#else
+typedef __m128 VectorFloat;
+const int VECTOR_SIZE = 4;
+#define VF_SET1 _mm_set1_ps
+#define VF_LOAD _mm_loadu_ps
+#define VF_STORE _mm_storeu_ps
+#define VF_ADD _mm_add_ps
+#define VF_SUB _mm_sub_ps
+#define VF_MUL _mm_mul_ps
+#define VF_DIV _mm_div_ps
+#define VF_SQRT _mm_sqrt_ps
+#endif
+
+// Vectorized version of calculateRowScalar(), processing VECTOR_SIZE vertices at once
+static int calculateRowVector(const float *up, const float *center, const float *down,
+                              int size, float cx, float cy, float cz,
+                              PackedNormal *normals)
+{
+  const VectorFloat two = VF_SET1(2.0f);
+  const VectorFloat vcx = VF_SET1(cx);
+  const VectorFloat vcy = VF_SET1(cy);
+  const VectorFloat vcz = VF_SET1(cz);
+  const VectorFloat scale = VF_SET1(127.0f);
+
+  float result[3][VECTOR_SIZE];
+
+  int z = 0;
+  for (; z + VECTOR_SIZE <= size; z += VECTOR_SIZE)
+  {
+    VectorFloat upLeft = VF_LOAD(up + z - 1);
+    VectorFloat upMid = VF_LOAD(up + z);
+    VectorFloat left = VF_LOAD(center + z - 1);
+    VectorFloat right = VF_LOAD(center + z + 1);
+    VectorFloat downMid = VF_LOAD(down + z);
+    VectorFloat downRight = VF_LOAD(down + z + 1);
+
+    VectorFloat diagonal = VF_SUB(upLeft, downRight);
+
+    VectorFloat a = VF_ADD(VF_ADD(VF_MUL(two, VF_SUB(upMid, downMid)), diagonal),
+                           VF_SUB(right, left));
+    VectorFloat b = VF_ADD(VF_ADD(VF_MUL(two, VF_SUB(left, right)), diagonal),
+                           VF_SUB(downMid, upMid));
+
+    VectorFloat nx = VF_MUL(vcx, a);
+    VectorFloat nz = VF_MUL(vcz, b);
+
+    VectorFloat length = VF_SQRT(VF_ADD(VF_ADD(VF_MUL(nx, nx), VF_MUL(vcy, vcy)),
+                                        VF_MUL(nz, nz)));
+
+    VF_STORE(result[0], VF_MUL(scale, VF_DIV(nx, length)));
+    VF_STORE(result[1], VF_MUL(scale, VF_DIV(vcy, length)));
+    VF_STORE(result[2], VF_MUL(scale, VF_DIV(nz, length)));
+
+    for (int i = 0; i < VECTOR_SIZE; ++i)
+    {
+      normals[z+i].x = roundComponent(result[0][i]);
+      normals[z+i].y = roundComponent(result[1][i]);
+      normals[z+i].z = roundComponent(result[2][i]);
+      normals[z+i].w = 0;
+    }
+  }
+
+  return z;
+}
+
+#endif
+
+void calculateNormals(const float *heights, int size,
+                      float scaleX, float scaleY, float scaleZ,
+                      PackedNormal *normals)
+{
+  const int stride = size + 2;
+
+  for (int x = 0; x < size; ++x)
+  {
+    const float *up = heights + x * stride + 1;
+    const float *center = up + stride;
+    const float *down = center + stride;
+
+    calculateNormalsRow(up, center, down, size, scaleX, scaleY, scaleZ,
+                        &normals[x * size]);
+  }
+}
+
+void calculateNormalsRow(const float *up, const float *center, const float *down,
+                         int size, float scaleX, float scaleY, float scaleZ,
+                         PackedNormal *normals)
+{
+  const float cx = scaleY * scaleZ;
+  const float cy = 6.0f * scaleX * scaleZ;
+  const float cz = scaleX * scaleY;
+
+  int done = 0;
+#if defined(__AVX__) || defined(__SSE__)
+  done = calculateRowVector(up, center, down, size, cx, cy, cz, normals);
+#endif
+  calculateRowScalar(up, center, down, done, size, cx, cy, cz, normals);
+}
+
+void calculateNormalsScalar(const float *heights, int size,
+                            float scaleX, float scaleY, float scaleZ,
+                            PackedNormal *normals)
+{
+  const int stride = size + 2;
+
+  const float cx = scaleY * scaleZ;
+  const float cy = 6.0f * scaleX * scaleZ;
+  const float cz = scaleX * scaleY;
+
+  for (int x = 0; x < size; ++x)
+  {
+    const float *up = heights + x * stride + 1;
+    const float *center = up + stride;
+    const float *down = center + stride;
+
+    calculateRowScalar(up, center, down, 0, size, cx, cy, cz,
+                       &normals[x * size]);
+  }
+}
+
+static inline void crossProduct(const float a[3], const float b[3], float result[3])
+{
+  result[0] = a[1] * b[2] - a[2] * b[1];
+  result[1] = a[2] * b[0] - a[0] * b[2];
+  result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline void addNormal(float *sums, int size, int x, int z, const float n[3])
+{
+  if ((x < 0) || (z < 0) || (x >= size) || (z >= size))
+    return;
+
+  float *sum = &sums[3 * (x * size + z)];
+  sum[0] += n[0];
+  sum[1] += n[1];
+  sum[2] += n[2];
+}
+
+void calculateNormalsReference(const float *heights, int size,
+                               float scaleX, float scaleY, float scaleZ,
+                               PackedNormal *normals)
+{
+  const int stride = size + 2;
+
+  float *sums = new float[3 * size * size];
+  memset(sums, 0, 3 * size * size * sizeof(float));
+
+  for (int x = -1; x < size; ++x)
+  {
+    for (int z = -1; z < size; ++z)
+    {
+      float h1 = scaleY * heights[(x+1) * stride + z+1];
+      float h2 = scaleY * heights[(x+2) * stride + z+1];
+      float h3 = scaleY * heights[(x+2) * stride + z+2];
+      float h4 = scaleY * heights[(x+1) * stride + z+2];
+
+      float v1v2[3] = { -scaleX, h1 - h2, 0.0f };
+      float v3v2[3] = { 0.0f, h3 - h2, scaleZ };
+      float v3v4[3] = { scaleX, h3 - h4, 0.0f };
+      float v1v4[3] = { 0.0f, h1 - h4, -scaleZ };
+
+      float n1[3], n2[3];
+      crossProduct(v1v2, v3v2, n1);
+      crossProduct(v3v4, v1v4, n2);
+
+      float n12[3] = { n1[0] + n2[0], n1[1] + n2[1], n1[2] + n2[2] };
+
+      addNormal(sums, size, x,   z,   n12);
+      addNormal(sums, size, x+1, z,   n1);
+      addNormal(sums, size, x+1, z+1, n12);
+      addNormal(sums, size, x,   z+1, n2);
+    }
+  }
+
+  for (int i = 0; i < size * size; ++i)
+    packNormal(sums[3*i], sums[3*i+1], sums[3*i+2], normals[i]);
+
+  delete[] sums;
+}
+
+const char* normalsInstructionSet()
+{
+#if defined(__AVX__)
+  return "AVX";
+#elif defined(__SSE__)
+  return "SSE";
+#else
+  return "none";
+#endif
+}
@@ -0,0 +1,51 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* normals.h
+    Contains functions calculating vertex normals of height fields. */
+
+#pragma once
+
+#include "config.h"
+
+// Normal packed into signed bytes (GL_BYTE), padded to 4 bytes
+struct PackedNormal
+{
+  signed char x, y, z, w;
+};
+
+/* All functions take a height field of size x size vertices with a border
+   of one vertex on each side, i.e. (size+2) x (size+2) values, stored row by
+   row: vertex (x, z) is at heights[(x+1) * (size+2) + z+1].
+   The normals are written row by row: vertex (x, z) at normals[x * size + z].
+
+   The normal of a vertex is the sum of the normals of the triangles around it
+   (each quad split by its (x, z) - (x+1, z+1) diagonal), which reduces to
+   central differences of the six neighboring heights. */
+
+// Uses SSE or AVX when available
+void calculateNormals(const float *heights, int size,
+                      float scaleX, float scaleY, float scaleZ,
+                      PackedNormal *normals);
+
+/* Normals of a single row of size vertices (using SSE or AVX when available);
+   up, center and down point at vertex 0 of rows x-1, x and x+1, each of them
+   with one more value on both sides. */
+void calculateNormalsRow(const float *up, const float *center, const float *down,
+                         int size, float scaleX, float scaleY, float scaleZ,
+                         PackedNormal *normals);
+
+// Plain C++ version of calculateNormals()
+void calculateNormalsScalar(const float *heights, int size,
+                            float scaleX, float scaleY, float scaleZ,
+                            PackedNormal *normals);
+
+// Sums cross products of the triangles, like Map::Quad did before; kept for comparison
+void calculateNormalsReference(const float *heights, int size,
+                               float scaleX, float scaleY, float scaleZ,
+                               PackedNormal *normals);
+
+// Name of the instruction set used by calculateNormals()
+const char* normalsInstructionSet();
@@ -0,0 +1,205 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* occlusion.cpp
+    Contains the implementation of the HeightPyramid and HorizonCuller
+    classes. */
+
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace std;
+
+HeightPyramid::HeightPyramid()
+{
+  _levelCount = _cellCount = _cellSize = 0;
+}
+
+void HeightPyramid::build(const float *values, int size, int cellSize, float scale)
+{
+  _cellSize = cellSize;
+  _cellCount = size / cellSize;
+
+  _levelCount = 0;
+  for (int count = _cellCount; count > 0; count /= 2)
+    ++_levelCount;
+
+  _offsets.resize(_levelCount);
+  int total = 0;
+  for (int level = 0; level < _levelCount; ++level)
+  {
+    _offsets[level] = total;
+    total += cellCount(level) * cellCount(level);
+  }
+
+  _min.resize(total);
+  _max.resize(total);
+
+  // Cells of level 0 include the vertices on all of their edges
+  for (int cx = 0; cx < _cellCount; ++cx)
+  {
+    for (int cz = 0; cz < _cellCount; ++cz)
+    {
+      float minValue = FLT_MAX, maxValue = -FLT_MAX;
+
+      for (int x = cx * cellSize; x <= (cx+1) * cellSize; ++x)
+      {
+        const float *row = &values[x * (size+1)];
+        for (int z = cz * cellSize; z <= (cz+1) * cellSize; ++z)
+        {
+          minValue = min(minValue, row[z]);
+          maxValue = max(maxValue, row[z]);
+        }
+      }
+
+      _min[cx * _cellCount + cz] = scale * minValue;
+      _max[cx * _cellCount + cz] = scale * maxValue;
+    }
+  }
+
+  for (int level = 1; level < _levelCount; ++level)
+  {
+    int count = cellCount(level);
+    for (int cx = 0; cx < count; ++cx)
+    {
+      for (int cz = 0; cz < count; ++cz)
+      {
+        int i = _offsets[level] + cx * count + cz;
+        _min[i] = min(min(minHeight(level-1, 2*cx, 2*cz), minHeight(level-1, 2*cx+1, 2*cz)),
+                      min(minHeight(level-1, 2*cx, 2*cz+1), minHeight(level-1, 2*cx+1, 2*cz+1)));
+        _max[i] = max(max(maxHeight(level-1, 2*cx, 2*cz), maxHeight(level-1, 2*cx+1, 2*cz)),
+                      max(maxHeight(level-1, 2*cx, 2*cz+1), maxHeight(level-1, 2*cx+1, 2*cz+1)));
+      }
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+
+HorizonCuller::HorizonCuller()
+{
+  reset(Vector3D());
+}
+
+void HorizonCuller::reset(const Vector3D &eye)
+{
+  _eye = eye;
+
+  for (int i = 0; i < BINS; ++i)
+    _horizon[i] = -FLT_MAX;
+
+  _pending.clear();
+}
+
+bool HorizonCuller::project(float minX, float minZ, float maxX, float maxZ,
+                            float &minDistance, float &maxDistance,
+                            float &firstAngle, float &lastAngle) const
+{
+  float dx = max(0.0f, max(minX - _eye.x, _eye.x - maxX));
+  float dz = max(0.0f, max(minZ - _eye.z, _eye.z - maxZ));
+  if ((dx == 0.0f) && (dz == 0.0f))
+    return false;
+
+  minDistance = sqrt(dx * dx + dz * dz);
+
+  float fx = max(fabs(minX - _eye.x), fabs(maxX - _eye.x));
+  float fz = max(fabs(minZ - _eye.z), fabs(maxZ - _eye.z));
+  maxDistance = sqrt(fx * fx + fz * fz);
+
+  // Angles of the corners relative to the direction of the center (less than PI apart)
+  const float binsPerRadian = BINS / (2.0f * M_PI);
+  float center = atan2(0.5f * (minZ + maxZ) - _eye.z, 0.5f * (minX + maxX) - _eye.x);
+
+  const float corners[4][2] = { { minX, minZ }, { maxX, minZ }, { minX, maxZ }, { maxX, maxZ } };
+
+  float first = 0.0f, last = 0.0f;
+  for (int i = 0; i < 4; ++i)
+  {
+    float angle = atan2(corners[i][1] - _eye.z, corners[i][0] - _eye.x) - center;
+    if (angle > M_PI)
+      angle -= 2.0f * M_PI;
+    else if (angle < -M_PI)
+      angle += 2.0f * M_PI;
+
+    first = min(first, angle);
+    last = max(last, angle);
+  }
+
+  firstAngle = (center + first) * binsPerRadian;
+  lastAngle = (center + last) * binsPerRadian;
+
+  return true;
+}
+
+void HorizonCuller::flush(float distance)
+{
+  while ((!_pending.empty()) && (_pending.front().maxDistance <= distance))
+  {
+    const Occluder &o = _pending.front();
+
+    for (int b = o.firstBin; b <= o.lastBin; ++b)
+    {
+      int bin = ((b % BINS) + BINS) % BINS;
+      _horizon[bin] = max(_horizon[bin], o.elevation);
+    }
+
+    pop_heap(_pending.begin(), _pending.end());
+    _pending.pop_back();
+  }
+}
+
+bool HorizonCuller::occluded(const Vector3D &minValues, const Vector3D &maxValues)
+{
+  float minDistance, maxDistance, firstAngle, lastAngle;
+  if (!project(minValues.x, minValues.z, maxValues.x, maxValues.z,
+               minDistance, maxDistance, firstAngle, lastAngle))
+    return false;
+
+  flush(minDistance);
+
+  // Highest elevation of any point of the box
+  float height = maxValues.y - _eye.y;
+  float elevation = height / ((height > 0.0f) ? minDistance : maxDistance);
+
+  // All directions in which the box is seen, even partially
+  int firstBin = (int)floor(firstAngle);
+  int lastBin = (int)floor(lastAngle);
+
+  for (int b = firstBin; b <= lastBin; ++b)
+  {
+    int bin = ((b % BINS) + BINS) % BINS;
+    if (_horizon[bin] <= elevation)
+      return false;
+  }
+
+  return true;
+}
+
+void HorizonCuller::addOccluder(float minX, float minZ, float maxX, float maxZ, float minHeight)
+{
+  Occluder o;
+  float minDistance, firstAngle, lastAngle;
+  if (!project(minX, minZ, maxX, maxZ, minDistance, o.maxDistance, firstAngle, lastAngle))
+    return;
+
+  /* Every ray in a direction covered entirely by the rectangle crosses it
+     somewhere between minDistance and maxDistance; below this elevation it
+     is then below minHeight there */
+  float height = minHeight - _eye.y;
+  o.elevation = height / ((height > 0.0f) ? o.maxDistance : minDistance);
+
+  o.firstBin = (int)ceil(firstAngle);
+  o.lastBin = (int)floor(lastAngle) - 1;
+  if (o.firstBin > o.lastBin)
+    return;
+
+  _pending.push_back(o);
+  push_heap(_pending.begin(), _pending.end());
+}
@@ -0,0 +1,107 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* occlusion.h
+    Contains the HeightPyramid and HorizonCuller classes, used for culling
+    of terrain hidden behind nearer terrain. Neither of them uses OpenGL. */
+
+#pragma once
+
+#include "config.h"
+
+#include "common.h"
+
+#include <vector>
+
+/* Minimum and maximum heights of a height field over square cells: level 0
+   has cells of cellSize tiles, each next level cells twice as large, up to
+   a single cell covering the whole field. */
+class HeightPyramid
+{
+  public:
+    HeightPyramid();
+
+    /* values are (size+1) x (size+1) heights stored row by row, i.e. vertex
+       (x, z) at values[x * (size+1) + z]; size must be cellSize times a power
+       of 2. Heights are multiplied by scale. */
+    void build(const float *values, int size, int cellSize, float scale);
+
+    inline int levelCount() const
+      { return _levelCount; }
+
+    // Number of cells along each side of the level
+    inline int cellCount(int level) const
+      { return _cellCount >> level; }
+
+    // Size of the cells of the level, in tiles
+    inline int cellSize(int level) const
+      { return _cellSize << level; }
+
+    inline float minHeight(int level, int x, int z) const
+      { return _min[_offsets[level] + x * cellCount(level) + z]; }
+
+    inline float maxHeight(int level, int x, int z) const
+      { return _max[_offsets[level] + x * cellCount(level) + z]; }
+
+    // Memory [bytes] taken by the heights, besides the object itself
+    inline unsigned int memoryUsage() const
+      { return _offsets.capacity() * sizeof(int) + (_min.capacity() + _max.capacity()) * sizeof(float); }
+
+  private:
+    int _levelCount, _cellCount, _cellSize;
+    std::vector<int> _offsets;
+    std::vector<float> _min, _max;
+};
+
+/* Conservative occlusion test of axis aligned boxes standing on the terrain,
+   seen from the eye: keeps the horizon, i.e. the highest elevation (as a
+   tangent of the angle) under which the terrain is certainly solid, for each
+   direction around the eye.
+
+   Boxes must be tested in the order of increasing distance from the eye.
+   Occluders are added to the horizon only once they are entirely nearer than
+   the tested box, so the order in which they are given does not matter. */
+class HorizonCuller
+{
+  public:
+    // Directions around the eye
+    static const int BINS = 1024;
+
+  public:
+    HorizonCuller();
+
+    void reset(const Vector3D &eye);
+
+    // Whether the box is hidden behind the occluders
+    bool occluded(const Vector3D &minValues, const Vector3D &maxValues);
+
+    // Rectangle of terrain which is nowhere lower than minHeight
+    void addOccluder(float minX, float minZ, float maxX, float maxZ, float minHeight);
+
+  private:
+    struct Occluder
+    {
+      float maxDistance;
+      int firstBin, lastBin;
+      float elevation;
+
+      // For the heap with the nearest on top
+      inline bool operator<(const Occluder &other) const
+        { return maxDistance > other.maxDistance; }
+    };
+
+    Vector3D _eye;
+    float _horizon[BINS];
+    std::vector<Occluder> _pending;
+
+    // Adds the pending occluders which are entirely within distance
+    void flush(float distance);
+
+    /* Horizontal distances to the rectangle and the range of angles it covers
+       (in bins, not wrapped); false if the eye is above the rectangle */
+    bool project(float minX, float minZ, float maxX, float maxZ,
+                 float &minDistance, float &maxDistance,
+                 float &firstAngle, float &lastAngle) const;
+};
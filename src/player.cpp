@@ -31,18 +31,14 @@ const Vector3D Player::MAX_ANGULAR_VELOCITY = Vector3D(30.0f, 1.0f, 30.0f);
 Model* Player::_model = NULL;
 
 
-Player::Player(Map* pMap)
+Player::Player(Map* pMap, Random *pRandom)
 {
   _map = pMap;
+  _random = pRandom;
 
-  _updateTimer.setIntervalMsec(2);
   _firingTimer.setIntervalMsec(100);
   _aiTimer.setIntervalMsec(0);
 
-  _updateTimer.reset();
-  _firingTimer.reset();
-  _aiTimer.reset();
-
   _team = Team_Blue;
   _controlType = Control_AngularVelocity;
   _hp = Player::MAX_HP;
@@ -64,9 +60,10 @@ Player::Player(Map* pMap)
 Player::~Player()
 {
   _map = NULL;
+  _random = NULL;
 }
 
-void Player::initModel()
+void Player::initModel(bool pGraphics)
 {
   assert(_model == NULL);
 
@@ -74,7 +71,7 @@ void Player::initModel()
   if (FileManager::instance()->ensureCanRead("FighterModel"))
   {
     _model = new Model("FighterModel");
-    if (!_model->load(FileManager::instance()->fileName("FighterModel")))
+    if (!_model->load(FileManager::instance()->fileName("FighterModel"), pGraphics))
     {
       Application::instance()->print("Player", "Could not load the fighter model!");
       Application::instance()->quit(1);
@@ -105,6 +102,10 @@ void Player::reset()
   _accelerationControl = 0.0f;
   _angularVelocityControl = Vector3D();
   _angularAccelerationControl = Vector3D();
+
+  _createdBullets.clear();
+
+  resetInterpolation();
 }
 
 Color Player::color() const
@@ -123,12 +124,8 @@ Color Player::color() const
 
 float Player::altitude() const
 {
-  Vector3D qs = _map->quadSize();
-  Vector3D ts = _map->quadTileSize();
-  int tilePosX = (int)((_position.x + 0.5f * qs.x) / ts.x);
-  int tilePosZ = (int)((_position.z + 0.5f * qs.z) / ts.z);
-  float mapH = _map->tileValue(_quadPositionX, _quadPositionZ, tilePosX, tilePosZ);
-  return _position.y - mapH;
+  Map::TerrainSample sample = _map->terrainSample(_quadPositionX, _quadPositionZ, _position);
+  return _position.y - sample.height;
 }
 
 Vector3D Player::mapOffset() const
@@ -166,28 +163,22 @@ Vector3D Player::maximumAngularControl() const
   return Vector3D();
 }
 
-void Player::checkHit(Bullet* bullet)
+void Player::hit()
 {
   if (_hp == 0)
     return;
 
-  Vector3D pos = bullet->position() - actualPosition();
-
-  if (pos.between(_model->boundingBoxMin(), _model->boundingBoxMax()))
-  {
-    --_hp;
-    bullet->setDecayed();
+  --_hp;
 
-    Application::instance()->print("Player",
-      _name + ": hit! HP: " + toString<int>(_hp) + "/" +
-      toString<int>(Player::MAX_HP));
+  Application::instance()->print("Player",
+    _name + ": hit! HP: " + toString<int>(_hp) + "/" +
+    toString<int>(Player::MAX_HP));
 
-    if (_ai && ((_aiActions & AI_EvasiveAction) != 0)
-        && (_aiState == 0))
-    {
-      _aiTimer.setInterval(0);
-      _aiState = 40;
-    }
+  if (_ai && ((_aiActions & AI_EvasiveAction) != 0)
+      && (_aiState == 0))
+  {
+    _aiTimer.setInterval(0.0f);
+    _aiState = 40;
   }
 }
 
@@ -195,11 +186,11 @@ void Player::render(float frameRotation)
 {
   glPushMatrix();
   {
-    Vector3D pos = actualPosition();
+    Vector3D pos = renderPosition();
     glTranslatef(pos.x, pos.y, pos.z);
 
     float matrix[16] = { 0.0f };
-    _rotation.reverseToGLMatrix(matrix);
+    _renderRotation.reverseToGLMatrix(matrix);
     glMultMatrixf(matrix);
 
     Color c = color();
@@ -277,122 +268,122 @@ void Player::render(float frameRotation)
   glPopMatrix();
 }
 
-void Player::update()
+void Player::step(float delta)
 {
-  if (_updateTimer.checkTimeout())
-  {
-    float delta = _updateTimer.timeoutDifference() / 1e9f;
+  _previousPosition = _position;
+  _previousQuadPositionX = _quadPositionX;
+  _previousQuadPositionZ = _quadPositionZ;
+  _previousRotation = _rotation;
 
-    // Calculation of angular acceleration of own rotation
+  // Calculation of angular acceleration of own rotation
 
-    if (_controlType == Control_AngularAcceleration)
-    {
-      _angularAcceleration += (_angularAccelerationControl - _angularAcceleration) * delta * 6.5f;
-
-      Vector3D deltaAngularAcceleration = _angularAcceleration - _angularAccelerationControl;
-      if (fabs(deltaAngularAcceleration.x) < 0.5f)
-        _angularAcceleration.x = _angularAccelerationControl.x;
-      if (fabs(deltaAngularAcceleration.y) < 0.5f)
-        _angularAcceleration.y = _angularAccelerationControl.y;
-      if (fabs(deltaAngularAcceleration.z) < 0.5f)
-        _angularAcceleration.z = _angularAccelerationControl.z;
-    }
-    else if (_controlType == Control_AngularVelocity)
-    {
-      _angularAcceleration = (_angularVelocityControl - _angularVelocity) * 0.75f;
-    }
+  if (_controlType == Control_AngularAcceleration)
+  {
+    _angularAcceleration += (_angularAccelerationControl - _angularAcceleration) * delta * 6.5f;
+
+    Vector3D deltaAngularAcceleration = _angularAcceleration - _angularAccelerationControl;
+    if (fabs(deltaAngularAcceleration.x) < 0.5f)
+      _angularAcceleration.x = _angularAccelerationControl.x;
+    if (fabs(deltaAngularAcceleration.y) < 0.5f)
+      _angularAcceleration.y = _angularAccelerationControl.y;
+    if (fabs(deltaAngularAcceleration.z) < 0.5f)
+      _angularAcceleration.z = _angularAccelerationControl.z;
+  }
+  else if (_controlType == Control_AngularVelocity)
+  {
+    _angularAcceleration = (_angularVelocityControl - _angularVelocity) * 0.75f;
+  }
 
-    _angularAcceleration.clamp(-Player::MAX_ANGULAR_ACCELERATION, Player::MAX_ANGULAR_ACCELERATION);
+  _angularAcceleration.clamp(-Player::MAX_ANGULAR_ACCELERATION, Player::MAX_ANGULAR_ACCELERATION);
 
-    // Updating of angular velocity of own rotation
+  // Updating of angular velocity of own rotation
 
-    _angularVelocity += delta * _angularAcceleration;
-    _angularVelocity.clamp(-Player::MAX_ANGULAR_VELOCITY, Player::MAX_ANGULAR_VELOCITY);
+  _angularVelocity += delta * _angularAcceleration;
+  _angularVelocity.clamp(-Player::MAX_ANGULAR_VELOCITY, Player::MAX_ANGULAR_VELOCITY);
 
-    if (fabs(_angularAcceleration.x) < 0.1f)
-      _angularVelocity.x = 0.0f;
-    if (fabs(_angularAcceleration.y) < 0.1f)
-      _angularVelocity.y = 0.0f;
-    if (fabs(_angularAcceleration.z) < 0.1f)
-      _angularVelocity.z = 0.0f;
+  if (fabs(_angularAcceleration.x) < 0.1f)
+    _angularVelocity.x = 0.0f;
+  if (fabs(_angularAcceleration.y) < 0.1f)
+    _angularVelocity.y = 0.0f;
+  if (fabs(_angularAcceleration.z) < 0.1f)
+    _angularVelocity.z = 0.0f;
 
-    // Calculation of angular acceleration in bank turning
+  // Calculation of angular acceleration in bank turning
 
-    float turnRate = 0.0f;
-    if (fabs(_rotation.roll()) > 1.0f)
-    {
-      float r  = fabs(_rotation.roll());
-      if (r > 45.0f)
-        r = 45.0f;
+  float turnRate = 0.0f;
+  if (fabs(_rotation.roll()) > 1.0f)
+  {
+    float r  = fabs(_rotation.roll());
+    if (r > 45.0f)
+      r = 45.0f;
 
-      float turnRadius = (_velocityValue * _velocityValue)
-                          / (tan(r * PI_180) * 10.0f);
+    float turnRadius = (_velocityValue * _velocityValue)
+                        / (tan(r * PI_180) * 10.0f);
 
-      turnRate = 360.0f / ((2.0f * M_PI * turnRadius) / _velocityValue);
+    turnRate = 360.0f / ((2.0f * M_PI * turnRadius) / _velocityValue);
 
-      if (_rotation.roll() < 0.0f)
-        turnRate = -turnRate;
-    }
+    if (_rotation.roll() < 0.0f)
+      turnRate = -turnRate;
+  }
 
-    // Calculation of position, velocity and rotation
+  // Calculation of position, velocity and rotation
 
-    _velocityValue += delta * _accelerationControl;
-    if (_velocityValue > Player::MAX_VELOCITY)
-      _velocityValue = Player::MAX_VELOCITY;
-    else if (_velocityValue < Player::MIN_VELOCITY)
-      _velocityValue = Player::MIN_VELOCITY;
+  _velocityValue += delta * _accelerationControl;
+  if (_velocityValue > Player::MAX_VELOCITY)
+    _velocityValue = Player::MAX_VELOCITY;
+  else if (_velocityValue < Player::MIN_VELOCITY)
+    _velocityValue = Player::MIN_VELOCITY;
 
-    _velocity = _velocityValue * _rotation.mainAxis();
-    _position += delta * _velocity;
+  _velocity = _velocityValue * _rotation.mainAxis();
+  _position += delta * _velocity;
 
-    _rotation.rotateLocal(-_angularVelocity.x * delta,
-                           _angularVelocity.y * delta,
-                          -_angularVelocity.z * delta);
+  _rotation.rotateLocal(-_angularVelocity.x * delta,
+                         _angularVelocity.y * delta,
+                        -_angularVelocity.z * delta);
 
-    if (turnRate != 0.0f)
-      _rotation.rotateGlobal(0.0f, turnRate * delta, 0.0f);
+  if (turnRate != 0.0f)
+    _rotation.rotateGlobal(0.0f, turnRate * delta, 0.0f);
 
-    // Change of field position after leaving "zeroth" field
+  // Change of field position after leaving "zeroth" field
 
-    Vector3D qs = _map->quadSize();
+  Vector3D qs = _map->quadSize();
 
-    if (_position.x > 0.5f * qs.x)
-    {
-      ++_quadPositionX;
-      _position.x -= qs.x;
-    }
-    else if (_position.x < -0.5f * qs.x)
-    {
-      --_quadPositionX;
-      _position.x += qs.x;
-    }
+  if (_position.x > 0.5f * qs.x)
+  {
+    ++_quadPositionX;
+    _position.x -= qs.x;
+  }
+  else if (_position.x < -0.5f * qs.x)
+  {
+    --_quadPositionX;
+    _position.x += qs.x;
+  }
 
-    if (_position.z > 0.5f * qs.z)
-    {
-      ++_quadPositionZ;
-      _position.z -= qs.z;
-    }
-    else if (_position.z < -0.5f * qs.z)
-    {
-      --_quadPositionZ;
-      _position.z += qs.z;
-    }
+  if (_position.z > 0.5f * qs.z)
+  {
+    ++_quadPositionZ;
+    _position.z -= qs.z;
+  }
+  else if (_position.z < -0.5f * qs.z)
+  {
+    --_quadPositionZ;
+    _position.z += qs.z;
+  }
 
-    // After shooting down
+  // After shooting down
 
-    if ((_hp == 0) && (_fade == 1.0f))
-    {
-      _fade = 0.99f;
-    }
-    else if (_fade < 1.0f)
-    {
-      _fade -= delta * 0.3f;
-      if (_fade < 0.0f)
-        _fade = 0.0f;
-    }
+  if ((_hp == 0) && (_fade == 1.0f))
+  {
+    _fade = 0.99f;
+  }
+  else if (_fade < 1.0f)
+  {
+    _fade -= delta * 0.3f;
+    if (_fade < 0.0f)
+      _fade = 0.0f;
   }
 
-  if (_firingTimer.checkTimeout())
+  if (_firingTimer.checkTimeout(delta))
   {
     if (_firing && (_ammo != 0))
     {
@@ -400,14 +391,14 @@ void Player::update()
       Vector3D vel = Vector3D::normalize(_velocity) * (_velocity.length() + 400.0f);
       Vector3D side = _rotation.sideAxis();
       Vector3D up = _rotation.upAxis();
-      _createdBullets.push_back(new Bullet(pos, vel, side, up));
+      _createdBullets.push_back(Bullet(pos, vel, side, up));
 
       if (_ammo != -1)
         --_ammo;
     }
   }
 
-  if (_ai && _aiTimer.checkTimeout())
+  if (_ai && _aiTimer.checkTimeout(delta))
   {
     if ((_lastAIState != _aiState) || (_lastAIParam != _aiParam))
     {
@@ -423,7 +414,7 @@ void Player::update()
       bool ok = true;
       do
       {
-        _aiState = 10 * (rand() % 4);
+        _aiState = 10 * _random->integer(4);
         ok = true;
         if (_aiState == 10)
           ok = (_aiActions & AI_Acceleration) != 0;
@@ -433,7 +424,7 @@ void Player::update()
           ok = (_aiActions & AI_Pitching) != 0;
       } while (!ok);
 
-      _aiTimer.setIntervalMsec(500 + rand() % 4000);
+      _aiTimer.setIntervalMsec(500 + _random->integer(4000));
     }
     // Change of velocity
     else if (_aiState < 20)
@@ -442,17 +433,17 @@ void Player::update()
       {
         _accelerationControl = Player::MAX_ACCELERATION;
         float v08 = Player::MIN_VELOCITY + 0.8f * (Player::MAX_VELOCITY - Player::MIN_VELOCITY);
-        if ((_velocity.length() > v08) || (rand() % 2 == 0))
+        if ((_velocity.length() > v08) || (_random->integer(2) == 0))
           _accelerationControl *= -1.0f;
 
         _aiState = 11;
-        _aiTimer.setIntervalMsec(3000 + rand() % 7000);
+        _aiTimer.setIntervalMsec(3000 + _random->integer(7000));
       }
       else if (_aiState == 11)
       {
         _accelerationControl = 0.0f;
         _aiState = 0;
-        _aiTimer.setIntervalMsec(2000 + rand() % 3000);
+        _aiTimer.setIntervalMsec(2000 + _random->integer(3000));
       }
     }
     // Turning
@@ -462,7 +453,7 @@ void Player::update()
       if (_aiState == 20)
       {
         _angularAccelerationControl.z = Player::MAX_ANGULAR_ACCELERATION.z;
-        if (rand() % 2 == 0)
+        if (_random->integer(2) == 0)
           _angularAccelerationControl.z *= -1.0f;
 
         _aiState = 21;
@@ -475,7 +466,7 @@ void Player::update()
         {
           _angularAccelerationControl.z = 0.0f;
           _aiState = 22;
-          _aiTimer.setIntervalMsec(10000 + rand() % 10000);
+          _aiTimer.setIntervalMsec(10000 + _random->integer(10000));
         }
         else
         {
@@ -507,7 +498,7 @@ void Player::update()
         {
           _angularAccelerationControl.z = 0.0f;
           _aiState = 0;
-          _aiTimer.setIntervalMsec(2000 + rand() % 3000);
+          _aiTimer.setIntervalMsec(2000 + _random->integer(3000));
         }
         else
         {
@@ -524,7 +515,7 @@ void Player::update()
       if (_aiState == 30)
       {
         _angularAccelerationControl.x = Player::MAX_ANGULAR_ACCELERATION.x;
-        _aiParam = _position.y + (rand() % 1000 - 500) / 50.0f;
+        _aiParam = _position.y + (_random->integer(1000) - 500) / 50.0f;
         if (_aiParam < 1.05f * _map->quadSize().y)
           _aiParam = 1.05f * _map->quadSize().y;
 
@@ -577,7 +568,7 @@ void Player::update()
         {
           _angularAccelerationControl.x = 0.0f;
           _aiState = 0;
-          _aiTimer.setIntervalMsec(2000 + rand() % 3000);
+          _aiTimer.setIntervalMsec(2000 + _random->integer(3000));
         }
         else
         {
@@ -591,21 +582,27 @@ void Player::update()
     // Evasive manouvers
     else if (_aiState < 50)
     {
-      _aiState = 10 * (1 + rand() % 3);
+      _aiState = 10 * (1 + _random->integer(3));
     }
   }
 }
 
-void Player::resetTimers()
+void Player::interpolate(float alpha)
 {
-  _updateTimer.reset();
-  _firingTimer.reset();
-  _aiTimer.reset();
+  // The previous position relative to the current quad
+  Vector3D qs = _map->quadSize();
+  Vector3D previous = _previousPosition +
+                      Vector3D(qs.x * (_previousQuadPositionX - _quadPositionX), 0.0f,
+                               qs.z * (_previousQuadPositionZ - _quadPositionZ));
+
+  _renderPosition = previous + alpha * (_position - previous);
+  _renderRotation = Rotation::interpolate(_previousRotation, _rotation, alpha);
 }
 
-vector<Bullet*> Player::createdBullets()
+void Player::resetInterpolation()
 {
-  vector<Bullet*> result = _createdBullets;
-  _createdBullets.clear();
-  return result;
+  _previousPosition = _renderPosition = _position;
+  _previousQuadPositionX = _quadPositionX;
+  _previousQuadPositionZ = _quadPositionZ;
+  _previousRotation = _renderRotation = _rotation;
 }
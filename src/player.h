@@ -14,6 +14,7 @@
 #include "common.h"
 #include "rotation.h"
 #include "bullet.h"
+#include "entitystore.h"
 #include "object.h"
 
 #include <vector>
@@ -43,14 +44,21 @@ class Player
       AI_Acceleration  = 0x01,
       AI_Turning       = 0x02,
       AI_Pitching      = 0x04,
-      AI_EvasiveAction = 0x08
+      AI_EvasiveAction = 0x08,
+      // Firing at the opponents ahead (decided by the World)
+      AI_Firing        = 0x10
     };
 
+    // Highest speed [world units/s]
+    static const float MAX_VELOCITY;
+
   public:
-    Player(Map *pMap);
+    // AI decisions are drawn from pRandom
+    Player(Map *pMap, Random *pRandom);
     virtual ~Player();
 
-    static void initModel();
+    // Without graphics, only the bounds of the model are loaded (for hits)
+    static void initModel(bool pGraphics = true);
     static void destroyModel();
 
     inline static const Model* model()
@@ -111,6 +119,9 @@ class Player
     inline float velocity() const
       { return _velocity.length(); }
 
+    inline const Vector3D& velocityVector() const
+      { return _velocity; }
+
     inline float acceleration() const
       { return _acceleration.length(); }
 
@@ -134,6 +145,16 @@ class Player
     inline float height() const
       { return _position.y; }
 
+    // Position and rotation to draw, between the last two steps (see interpolate())
+    inline const Vector3D& renderPositionOffset() const
+      { return _renderPosition; }
+
+    inline Vector3D renderPosition() const
+      { return mapOffset() + _renderPosition; }
+
+    inline const Rotation& renderRotation() const
+      { return _renderRotation; }
+
     inline void setHeading(float pHeading)
       { _rotation.setAngles(0.0f, -pHeading, 0.0f); }
 
@@ -157,22 +178,44 @@ class Player
 
     Vector3D maximumAngularControl() const;
 
-    void checkHit(Bullet *bullet);
+    // Takes a hit of a bullet (the World tests the bullets against the planes)
+    void hit();
+
+    // Destroys the plane at once, e.g. after it has hit the ground
+    inline void crash()
+      { _hp = 0; }
 
     void render(float frameRotation = 0.0f);
 
-    void update();
+    // Advances the player by delta [s] of simulated time
+    void step(float delta);
+
+    /* Sets the drawn state to the given fraction of the way from the state
+       before the last step to the current one */
+    void interpolate(float alpha);
+
+    // Draws the current state, e.g. after the player was placed
+    void resetInterpolation();
 
-    void resetTimers();
+    // Bullets fired since the last clearCreatedBullets(), taken by the World in one batch
+    inline const std::vector<Bullet>& createdBullets() const
+      { return _createdBullets; }
+    inline void clearCreatedBullets()
+      { _createdBullets.clear(); }
 
-    std::vector<Bullet*> createdBullets();
+    // Place of the plane in the EntityStore of the World
+    inline void setHandle(const EntityHandle &pHandle)
+      { _handle = pHandle; }
+    inline const EntityHandle& handle() const
+      { return _handle; }
 
   private:
     static Model *_model;
 
-    Timer _updateTimer, _firingTimer, _aiTimer;
+    StepTimer _firingTimer, _aiTimer;
 
     Map *_map;
+    Random *_random;
 
     std::string _name;
 
@@ -183,7 +226,8 @@ class Player
     float _fade;
     int _ammo;
     bool _firing;
-    std::vector<Bullet*> _createdBullets;
+    std::vector<Bullet> _createdBullets;
+    EntityHandle _handle;
 
     bool _ai;
     int _aiActions;
@@ -200,6 +244,13 @@ class Player
     Vector3D _position;
     int _quadPositionX, _quadPositionZ;
 
+    // State before the last step and the drawn one
+    Vector3D _previousPosition;
+    int _previousQuadPositionX, _previousQuadPositionZ;
+    Rotation _previousRotation;
+    Vector3D _renderPosition;
+    Rotation _renderRotation;
+
     float _accelerationControl;
     Vector3D _angularVelocityControl;
     Vector3D _angularAccelerationControl;
@@ -208,7 +259,6 @@ class Player
 
     static const float MAX_ACCELERATION;
     static const float MIN_VELOCITY;
-    static const float MAX_VELOCITY;
 
     static const Vector3D MAX_ANGULAR_ACCELERATION;
     static const Vector3D MAX_ANGULAR_VELOCITY;
@@ -0,0 +1,190 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* profiler.cpp
+    Contains the implementation of the Profiler class. */
+
+#include "profiler.h"
+
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+
+Profiler* Profiler::_instance = NULL;
+
+Profiler::Profiler() : Object("Profiler")
+{
+  assert(_instance == NULL);
+  _instance = this;
+
+  // The whole frame
+  Section root;
+  root.name = "Frame";
+  root.parent = -1;
+  root.depth = 0;
+  root.time = 0;
+  root.history.resize(FRAMES, 0.0f);
+  _sections.push_back(root);
+
+  _stack.push_back(0);
+  _starts.push_back(0);
+  _traced.push_back(false);
+
+  _frameStart = Time::nanoseconds();
+  _frameCount = 0;
+}
+
+Profiler::~Profiler()
+{
+  _instance = NULL;
+}
+
+int Profiler::child(int parent, const char *name)
+{
+  if (parent < 0)
+    return -1;
+
+  const vector<int> &children = _sections[parent].children;
+  for (unsigned int i = 0; i < children.size(); ++i)
+  {
+    const char *childName = _sections[children[i]].name;
+    if ((childName == name) || (strcmp(childName, name) == 0))
+      return children[i];
+  }
+
+  if ((int)_sections.size() >= MAX_SECTIONS)
+    return -1;
+
+  Section section;
+  section.name = name;
+  section.parent = parent;
+  section.depth = _sections[parent].depth + 1;
+  section.time = 0;
+  section.history.resize(FRAMES, 0.0f);
+
+  int index = _sections.size();
+  _sections.push_back(section);
+  _sections[parent].children.push_back(index);
+
+  return index;
+}
+
+void Profiler::begin(const char *name)
+{
+  bool traced = Trace::recording();
+  if (traced)
+    Trace::begin(name);
+
+  _stack.push_back(child(_stack.back(), name));
+  _starts.push_back(Time::nanoseconds());
+  _traced.push_back(traced);
+}
+
+void Profiler::end()
+{
+  // The frame itself is closed only by endFrame()
+  if (_stack.size() <= 1)
+    return;
+
+  int section = _stack.back();
+  if (section >= 0)
+    _sections[section].time += Time::nanoseconds() - _starts.back();
+
+  if (_traced.back())
+    Trace::end();
+
+  _stack.pop_back();
+  _starts.pop_back();
+  _traced.pop_back();
+}
+
+void Profiler::endFrame()
+{
+  long long now = Time::nanoseconds();
+  _sections[0].time = now - _frameStart;
+  _frameStart = now;
+
+  int slot = _frameCount % FRAMES;
+  for (unsigned int i = 0; i < _sections.size(); ++i)
+  {
+    _sections[i].history[slot] = 1e-6f * _sections[i].time;
+    _sections[i].time = 0;
+  }
+
+  ++_frameCount;
+
+  Trace::instant("Frame");
+}
+
+string Profiler::path(int section) const
+{
+  if (_sections[section].parent < 0)
+    return _sections[section].name;
+  return path(_sections[section].parent) + "/" + _sections[section].name;
+}
+
+void Profiler::summarize(int section, vector<Summary> &result) const
+{
+  const Section &s = _sections[section];
+  int frames = min(_frameCount, (int)FRAMES);
+
+  Summary summary;
+  summary.name = s.name;
+  summary.depth = s.depth;
+  summary.last = summary.median = summary.p95 = summary.p99 = summary.max = 0.0f;
+
+  if (frames > 0)
+  {
+    vector<float> times(s.history.begin(), s.history.begin() + frames);
+    sort(times.begin(), times.end());
+
+    summary.last = s.history[(_frameCount - 1) % FRAMES];
+    summary.median = times[(int)(0.50f * (frames - 1) + 0.5f)];
+    summary.p95 = times[(int)(0.95f * (frames - 1) + 0.5f)];
+    summary.p99 = times[(int)(0.99f * (frames - 1) + 0.5f)];
+    summary.max = times[frames - 1];
+  }
+
+  result.push_back(summary);
+
+  for (unsigned int i = 0; i < s.children.size(); ++i)
+    summarize(s.children[i], result);
+}
+
+void Profiler::summary(vector<Summary> &result) const
+{
+  result.clear();
+  summarize(0, result);
+}
+
+bool Profiler::dump(const string &fileName) const
+{
+  ofstream file(fileName.c_str());
+  if (!file)
+    return false;
+
+  file << "frame";
+  for (unsigned int i = 0; i < _sections.size(); ++i)
+    file << "," << path(i);
+  file << endl;
+
+  // Oldest frame first
+  int frames = min(_frameCount, (int)FRAMES);
+  for (int f = _frameCount - frames; f < _frameCount; ++f)
+  {
+    file << f;
+    for (unsigned int i = 0; i < _sections.size(); ++i)
+      file << "," << _sections[i].history[f % FRAMES];
+    file << endl;
+  }
+
+  return !file.fail();
+}
@@ -0,0 +1,109 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* profiler.h
+    Contains the Profiler class, which measures the time spent in nested
+    parts of each frame, and the ProfileScope helper. */
+
+#pragma once
+
+#include "config.h"
+
+#include "object.h"
+#include "common.h"
+
+#include <string>
+#include <vector>
+
+/* Sections are identified by their name and the section in which they
+   started, so the same name (e.g. text rendering) may appear in several
+   places of the tree. Times of the last FRAMES frames are kept.
+   Only the main thread may be profiled. Sections are also recorded as
+   slices of the Trace, while it is recording. */
+class Profiler : public Object
+{
+  public:
+    // Frames kept in the history
+    static const int FRAMES = 300;
+    // Sections at most; further ones are not measured
+    static const int MAX_SECTIONS = 64;
+
+    // Times [ms] of a section over the kept frames
+    struct Summary
+    {
+      std::string name;
+      int depth;
+      float last, median, p95, p99, max;
+    };
+
+  public:
+    Profiler();
+    virtual ~Profiler();
+
+    inline static Profiler* instance()
+      { return _instance; }
+
+    // name must stay valid (e.g. a string literal)
+    void begin(const char *name);
+    void end();
+
+    // Records the times measured since the previous call
+    void endFrame();
+
+    inline int frameCount() const
+      { return _frameCount; }
+
+    // All sections, each followed by its subsections
+    void summary(std::vector<Summary> &result) const;
+
+    // Writes the time of each section in each kept frame as CSV
+    bool dump(const std::string &fileName) const;
+
+  private:
+    struct Section
+    {
+      const char *name;
+      int parent, depth;
+      std::vector<int> children;
+      // Time in the current frame [ns]
+      long long time;
+      // Times in the kept frames [ms]
+      std::vector<float> history;
+    };
+
+    static Profiler *_instance;
+    std::vector<Section> _sections;
+    // Open sections (-1 if not measured), their start times and whether they are on the trace
+    std::vector<int> _stack;
+    std::vector<long long> _starts;
+    std::vector<bool> _traced;
+    long long _frameStart;
+    int _frameCount;
+
+    int child(int parent, const char *name);
+    std::string path(int section) const;
+    void summarize(int section, std::vector<Summary> &result) const;
+};
+
+// Measures the time until the end of the enclosing block
+class ProfileScope
+{
+  public:
+    explicit ProfileScope(const char *name)
+    {
+      _profiler = Profiler::instance();
+      if (_profiler != NULL)
+        _profiler->begin(name);
+    }
+
+    ~ProfileScope()
+    {
+      if (_profiler != NULL)
+        _profiler->end();
+    }
+
+  private:
+    Profiler *_profiler;
+};
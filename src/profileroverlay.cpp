@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* profileroverlay.cpp
+    Contains the implementation of the ProfilerOverlay class. */
+
+#include "profileroverlay.h"
+
+#include "decorator.h"
+
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+
+ProfilerOverlay::ProfilerOverlay(Widget *pParent) : Widget(pParent, "ProfilerOverlay")
+{
+  _font = NULL;
+  _metrics = NULL;
+
+  _refreshTimer.setIntervalMsec(500);
+}
+
+ProfilerOverlay::~ProfilerOverlay()
+{
+  delete _metrics;
+  _metrics = NULL;
+
+  _font = NULL;
+}
+
+void ProfilerOverlay::init()
+{
+  _font = Decorator::instance()->getFont(FT_Small);
+  _metrics = new FontMetrics(_font);
+}
+
+void ProfilerOverlay::update()
+{
+  if ((Profiler::instance() != NULL) && _refreshTimer.checkTimeout())
+    Profiler::instance()->summary(_summary);
+}
+
+void ProfilerOverlay::render()
+{
+  if ((_font == NULL) || _summary.empty())
+    return;
+
+  const char *COLUMNS[5] = { "last", "median", "95%", "99%", "max" };
+
+  float margin = Decorator::instance()->getDefaultMargin();
+  float indent = _metrics->width("  ");
+  float nameWidth = _metrics->width("Simulation::update") + 4.0f * indent;
+  float columnWidth = _metrics->width("0000.00 ");
+  float lineHeight = _metrics->height();
+
+  Rect frame;
+  frame.w = nameWidth + 5.0f * columnWidth + 2.0f * margin;
+  frame.h = (_summary.size() + 1) * lineHeight + 2.0f * margin;
+  frame.x = geometry().x2() - frame.w;
+  frame.y = geometry().y;
+  Decorator::instance()->renderFrame(frame);
+
+  Point position(frame.x + margin, frame.y + margin);
+
+  _font->renderText("[ms]", position);
+  for (int c = 0; c < 5; ++c)
+    _font->renderText(COLUMNS[c], Point(position.x + nameWidth + c * columnWidth, position.y));
+
+  for (unsigned int i = 0; i < _summary.size(); ++i)
+  {
+    const Profiler::Summary &s = _summary[i];
+    position.y += lineHeight;
+
+    _font->renderText(s.name, Point(position.x + s.depth * indent, position.y));
+
+    const float values[5] = { s.last, s.median, s.p95, s.p99, s.max };
+    for (int c = 0; c < 5; ++c)
+    {
+      ostringstream stream;
+      stream << fixed << setprecision(2) << values[c];
+      _font->renderText(stream.str(), Point(position.x + nameWidth + c * columnWidth, position.y));
+    }
+  }
+}
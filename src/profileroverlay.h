@@ -0,0 +1,36 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* profileroverlay.h
+    Contains the ProfilerOverlay class, which displays the times measured
+    by the Profiler. */
+
+#pragma once
+
+#include "config.h"
+
+#include "widget.h"
+#include "fontengine.h"
+#include "profiler.h"
+
+#include <vector>
+
+class ProfilerOverlay : public Widget
+{
+  public:
+    ProfilerOverlay(Widget *pParent);
+    virtual ~ProfilerOverlay();
+
+    virtual void init();
+    virtual void render();
+    virtual void update();
+
+  private:
+    Font *_font;
+    FontMetrics *_metrics;
+    // Refreshed a few times per second, so that the numbers can be read
+    Timer _refreshTimer;
+    std::vector<Profiler::Summary> _summary;
+};
@@ -0,0 +1,252 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* quadcache.cpp
+    Contains the implementation of the QuadCache class. */
+
+#include "quadcache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#elif defined(WIN32) || defined(_WIN32)
+#include <direct.h>
+#endif
+
+using namespace std;
+
+// Changed whenever the generation of quads or the file format changes
+const unsigned int FORMAT_VERSION = 2;
+
+struct QuadFileHeader
+{
+  char magic[4];
+  unsigned int version;
+  unsigned int size;
+  unsigned int reserved;
+};
+
+static bool makeDirectory(const string &path)
+{
+#if defined(__linux__)
+  return mkdir(path.c_str(), 0755) == 0;
+#elif defined(WIN32) || defined(_WIN32)
+  return _mkdir(path.c_str()) == 0;
+#else
+  return false;
+#endif
+}
+
+// Heights of the terrain are within [0, 1]
+static unsigned short encodeHeight(float v)
+{
+  if (v < 0.0f)
+    v = 0.0f;
+  if (v > 1.0f)
+    v = 1.0f;
+  return (unsigned short)(v * 65535.0f + 0.5f);
+}
+
+static inline float decodeHeight(unsigned short v)
+{
+  return v / 65535.0f;
+}
+
+static unsigned int fileSize(int size)
+{
+  return sizeof(QuadFileHeader) + size * size * (sizeof(unsigned short) + sizeof(PackedNormal));
+}
+
+static bool decodeQuad(const char *data, int size, float *values, PackedNormal *normals)
+{
+  const QuadFileHeader *header = (const QuadFileHeader*)(data);
+  if ((memcmp(header->magic, "FSQC", 4) != 0) ||
+      (header->version != FORMAT_VERSION) || ((int)header->size != size))
+    return false;
+
+  const unsigned short *heights = (const unsigned short*)(data + sizeof(QuadFileHeader));
+  for (int i = 0; i < size * size; ++i)
+    values[i] = decodeHeight(heights[i]);
+
+  memcpy(normals, heights + size * size, size * size * sizeof(PackedNormal));
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+
+QuadCache::QuadCache()
+{
+  _enabled = false;
+}
+
+QuadCache::~QuadCache()
+{
+}
+
+void QuadCache::setKey(const FractalOptions &options, const Vector3D &scale)
+{
+  Hash hash;
+  hash.add(FORMAT_VERSION);
+
+  hash.add(options.size);
+  hash.add(options.distribution);
+  hash.add(options.distributionUniformMin);
+  hash.add(options.distributionUniformMax);
+  hash.add(options.distributionNormalMean);
+  hash.add(options.distributionNormalVariance);
+  hash.add(options.distributionWeibullScale);
+  hash.add(options.distributionWeibullShape);
+  hash.add(options.clamping);
+  hash.add(options.clampingMin);
+  hash.add(options.clampingMax);
+  hash.add(options.mixing);
+  hash.add(options.mixingTwopointGaussCutoff);
+  hash.add(options.mixingFourpointGaussCutoff);
+  hash.add(options.mixingTwopointLinearMin);
+  hash.add(options.mixingFourpointLinearMin);
+
+  hash.add(scale.x);
+  hash.add(scale.y);
+  hash.add(scale.z);
+
+  stringstream s;
+  s << _directory << "/" << hex << setw(16) << setfill('0') << hash.value();
+  _keyDirectory = s.str();
+}
+
+string QuadCache::fileName(int x, int z) const
+{
+  stringstream s;
+  s << _keyDirectory << "/" << x << "_" << z << ".quad";
+  return s.str();
+}
+
+bool QuadCache::contains(int x, int z) const
+{
+  if ((!_enabled) || _keyDirectory.empty())
+    return false;
+
+  FILE *file = fopen(fileName(x, z).c_str(), "rb");
+  if (file == NULL)
+    return false;
+
+  fclose(file);
+  return true;
+}
+
+bool QuadCache::load(int x, int z, int size, float *values, PackedNormal *normals) const
+{
+  if ((!_enabled) || _keyDirectory.empty())
+    return false;
+
+  string name = fileName(x, z);
+  unsigned int expectedSize = fileSize(size);
+
+#if defined(__linux__)
+  int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat info;
+  if ((fstat(fd, &info) != 0) || (info.st_size != (off_t)expectedSize))
+  {
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, expectedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+    return false;
+
+  bool result = decodeQuad((const char*)(data), size, values, normals);
+
+  munmap(data, expectedSize);
+
+  return result;
+#else
+  FILE *file = fopen(name.c_str(), "rb");
+  if (file == NULL)
+    return false;
+
+  vector<char> data(expectedSize + 1);
+  unsigned int read = fread(&data[0], 1, expectedSize + 1, file);
+  fclose(file);
+
+  if (read != expectedSize)
+    return false;
+
+  return decodeQuad(&data[0], size, values, normals);
+#endif
+}
+
+bool QuadCache::save(int x, int z, int size, const float *values, const PackedNormal *normals) const
+{
+  if ((!_enabled) || _keyDirectory.empty())
+    return false;
+
+  vector<char> data(fileSize(size));
+
+  QuadFileHeader *header = (QuadFileHeader*)(&data[0]);
+  memcpy(header->magic, "FSQC", 4);
+  header->version = FORMAT_VERSION;
+  header->size = size;
+  header->reserved = 0;
+
+  unsigned short *heights = (unsigned short*)(&data[sizeof(QuadFileHeader)]);
+  for (int i = 0; i < size * size; ++i)
+    heights[i] = encodeHeight(values[i]);
+
+  memcpy(heights + size * size, normals, size * size * sizeof(PackedNormal));
+
+  // Written under a temporary name, so that a partial file is never loaded
+  string name = fileName(x, z);
+  string tempName = name + ".tmp";
+
+  FILE *file = fopen(tempName.c_str(), "wb");
+  if (file == NULL)
+  {
+    makeDirectory(_directory);
+    makeDirectory(_keyDirectory);
+
+    file = fopen(tempName.c_str(), "wb");
+    if (file == NULL)
+      return false;
+  }
+
+  bool result = fwrite(&data[0], 1, data.size(), file) == data.size();
+  result = (fclose(file) == 0) && result;
+
+  if (!result)
+  {
+    remove(tempName.c_str());
+    return false;
+  }
+
+#if defined(WIN32) || defined(_WIN32)
+  remove(name.c_str());
+#endif
+
+  return rename(tempName.c_str(), name.c_str()) == 0;
+}
+
+void QuadCache::quantize(float *values, int count)
+{
+  for (int i = 0; i < count; ++i)
+    values[i] = decodeHeight(encodeHeight(values[i]));
+}
@@ -0,0 +1,57 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* quadcache.h
+    Contains the QuadCache class, which stores generated map quads on disk. */
+
+#pragma once
+
+#include "config.h"
+
+#include "common.h"
+#include "fractal.h"
+#include "normals.h"
+
+#include <string>
+
+/* Each quad is a separate file in a directory named after the hash of the
+   generation parameters; heights are stored as 16-bit integers, followed
+   by the packed normals.
+   Functions other than setters may be called from the worker threads. */
+class QuadCache
+{
+  public:
+    QuadCache();
+    ~QuadCache();
+
+    inline void setEnabled(bool pEnabled)
+      { _enabled = pEnabled; }
+    inline bool enabled() const
+      { return _enabled; }
+
+    inline void setDirectory(const std::string &pDirectory)
+      { _directory = pDirectory; }
+    inline std::string directory() const
+      { return _directory; }
+
+    // Selects the set of quads generated with given parameters
+    void setKey(const FractalOptions &options, const Vector3D &scale);
+
+    bool contains(int x, int z) const;
+
+    bool load(int x, int z, int size, float *values, PackedNormal *normals) const;
+    bool save(int x, int z, int size, const float *values, const PackedNormal *normals) const;
+
+    /* Rounds values to the precision they are stored with, so that quads
+       loaded from disk match the ones generated */
+    static void quantize(float *values, int count);
+
+  private:
+    bool _enabled;
+    std::string _directory;
+    std::string _keyDirectory;
+
+    std::string fileName(int x, int z) const;
+};
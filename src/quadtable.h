@@ -0,0 +1,252 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* quadtable.h
+    Contains the QuadTable class, a hash table of map quads readable
+    without locking. */
+
+#pragma once
+
+#include "config.h"
+
+#include "atomic.h"
+
+#include <cstddef>
+#include <vector>
+
+/* Open addressing hash table of T* keyed by quad coordinates.
+
+   There is a single writer (the main thread) and any number of readers.
+   Tables are never modified after they are published: each change makes
+   a new copy, which replaces the current table with a single pointer store
+   (read-copy-update). Old tables are deleted when no reader can see them
+   any more, which is tracked with epochs: a reader records the current
+   epoch in its slot for the time of its reads (beginRead() - endRead()).
+
+   find() may be called by the writer at any time, and by the readers
+   between beginRead() and endRead(). */
+template<typename T>
+class QuadTable
+{
+  public:
+    static const int MAX_READERS = 64;
+
+  public:
+    QuadTable()
+    {
+      _table = new Table(MIN_CAPACITY);
+      _epoch = 1;
+      _readerCount = 0;
+      for (int i = 0; i < MAX_READERS; ++i)
+        _readers[i].epoch = 0;
+    }
+
+    ~QuadTable()
+    {
+      delete _table;
+      for (unsigned int i = 0; i < _retired.size(); ++i)
+        delete _retired[i].table;
+    }
+
+    // Called by the writer, before the reader thread starts; returns -1 if there are too many
+    int registerReader()
+    {
+      if (_readerCount >= MAX_READERS)
+        return -1;
+      return _readerCount++;
+    }
+
+    inline void beginRead(int reader)
+    {
+      atomicStore(&_readers[reader].epoch, atomicLoad(&_epoch));
+    }
+
+    inline void endRead(int reader)
+    {
+      atomicStore(&_readers[reader].epoch, (unsigned int)0);
+    }
+
+    T* find(int x, int z) const
+    {
+      const Table *table = atomicLoad(const_cast<Table**>(&_table));
+      return table->find(key(x, z));
+    }
+
+    // Writer only
+
+    inline int size() const
+      { return _table->count; }
+
+    void insert(int x, int z, T *value)
+    {
+      Table *table = new Table(capacityFor(_table->count + 1));
+      copyEntries(_table, table, false, 0);
+      table->insert(key(x, z), value);
+      publish(table);
+    }
+
+    void erase(int x, int z)
+    {
+      Table *table = new Table(capacityFor(_table->count));
+      copyEntries(_table, table, true, key(x, z));
+      publish(table);
+    }
+
+    void clear()
+    {
+      publish(new Table(MIN_CAPACITY));
+    }
+
+    void values(std::vector<T*> &result) const
+    {
+      result.clear();
+      for (int i = 0; i < _table->capacity; ++i)
+      {
+        if (_table->entries[i].value != NULL)
+          result.push_back(_table->entries[i].value);
+      }
+    }
+
+  private:
+    static const int MIN_CAPACITY = 64;
+
+    struct Entry
+    {
+      unsigned long long key;
+      T *value;
+    };
+
+    struct Table
+    {
+      int capacity, count;
+      Entry *entries;
+
+      Table(int pCapacity) : capacity(pCapacity), count(0)
+      {
+        entries = new Entry[capacity];
+        for (int i = 0; i < capacity; ++i)
+        {
+          entries[i].key = 0;
+          entries[i].value = NULL;
+        }
+      }
+
+      ~Table()
+      {
+        delete[] entries;
+      }
+
+      inline static unsigned int hash(unsigned long long k)
+      {
+        k *= 0x9e3779b97f4a7c15ULL;
+        return (unsigned int)(k >> 32);
+      }
+
+      T* find(unsigned long long k) const
+      {
+        int mask = capacity - 1;
+        for (int i = hash(k) & mask; ; i = (i + 1) & mask)
+        {
+          if (entries[i].value == NULL)
+            return NULL;
+          if (entries[i].key == k)
+            return entries[i].value;
+        }
+      }
+
+      void insert(unsigned long long k, T *value)
+      {
+        int mask = capacity - 1;
+        int i = hash(k) & mask;
+        while ((entries[i].value != NULL) && (entries[i].key != k))
+          i = (i + 1) & mask;
+
+        if (entries[i].value == NULL)
+          ++count;
+        entries[i].key = k;
+        entries[i].value = value;
+      }
+    };
+
+    // Each in its own cache line, so that readers do not slow down each other
+    struct Reader
+    {
+      unsigned int epoch;
+      char padding[64 - sizeof(unsigned int)];
+    };
+
+    struct RetiredTable
+    {
+      Table *table;
+      unsigned int epoch;
+    };
+
+    Table *_table;
+    unsigned int _epoch;
+    int _readerCount;
+    Reader _readers[MAX_READERS];
+    std::vector<RetiredTable> _retired;
+
+    inline static unsigned long long key(int x, int z)
+    {
+      return (((unsigned long long)(unsigned int)x) << 32) | (unsigned int)z;
+    }
+
+    // Load factor at most 1/2
+    static int capacityFor(int count)
+    {
+      int capacity = MIN_CAPACITY;
+      while (capacity < 2 * count)
+        capacity *= 2;
+      return capacity;
+    }
+
+    // Copies all entries, except the one with skipKey if skip is set
+    static void copyEntries(const Table *from, Table *to, bool skip, unsigned long long skipKey)
+    {
+      for (int i = 0; i < from->capacity; ++i)
+      {
+        const Entry &e = from->entries[i];
+        if ((e.value != NULL) && ((!skip) || (e.key != skipKey)))
+          to->insert(e.key, e.value);
+      }
+    }
+
+    void publish(Table *table)
+    {
+      RetiredTable retired;
+      retired.table = _table;
+      retired.epoch = _epoch;
+
+      atomicStore(&_table, table);
+      atomicStore(&_epoch, _epoch + 1);
+
+      _retired.push_back(retired);
+      reclaim();
+    }
+
+    /* A table retired in epoch E may still be used only by readers which
+       started in epoch E or earlier */
+    void reclaim()
+    {
+      unsigned int oldest = atomicLoad(&_epoch);
+      for (int i = 0; i < _readerCount; ++i)
+      {
+        unsigned int e = atomicLoad(&_readers[i].epoch);
+        if ((e != 0) && (e < oldest))
+          oldest = e;
+      }
+
+      unsigned int kept = 0;
+      for (unsigned int i = 0; i < _retired.size(); ++i)
+      {
+        if (_retired[i].epoch < oldest)
+          delete _retired[i].table;
+        else
+          _retired[kept++] = _retired[i];
+      }
+      _retired.resize(kept);
+    }
+};
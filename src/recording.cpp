@@ -0,0 +1,262 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* recording.cpp
+    Contains the implementation of the Recording class. */
+
+#include "recording.h"
+
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+
+template<class T>
+static void write(ostream &s, const T &value)
+{
+  s.write((const char*)&value, sizeof(T));
+}
+
+template<class T>
+static void read(istream &s, T &value)
+{
+  s.read((char*)&value, sizeof(T));
+}
+
+static void write(ostream &s, const Vector3D &v)
+{
+  write(s, v.x);
+  write(s, v.y);
+  write(s, v.z);
+}
+
+static void read(istream &s, Vector3D &v)
+{
+  read(s, v.x);
+  read(s, v.y);
+  read(s, v.z);
+}
+
+static void write(ostream &s, const FractalOptions &o)
+{
+  write(s, o.size);
+  write(s, (int)o.distribution);
+  write(s, o.distributionUniformMin);
+  write(s, o.distributionUniformMax);
+  write(s, o.distributionNormalMean);
+  write(s, o.distributionNormalVariance);
+  write(s, o.distributionWeibullScale);
+  write(s, o.distributionWeibullShape);
+  write(s, (int)o.clamping);
+  write(s, o.clampingMin);
+  write(s, o.clampingMax);
+  write(s, (int)o.mixing);
+  write(s, o.mixingTwopointGaussCutoff);
+  write(s, o.mixingFourpointGaussCutoff);
+  write(s, o.mixingTwopointLinearMin);
+  write(s, o.mixingFourpointLinearMin);
+}
+
+static void read(istream &s, FractalOptions &o)
+{
+  int distribution = 0, clamping = 0, mixing = 0;
+  read(s, o.size);
+  read(s, distribution);
+  read(s, o.distributionUniformMin);
+  read(s, o.distributionUniformMax);
+  read(s, o.distributionNormalMean);
+  read(s, o.distributionNormalVariance);
+  read(s, o.distributionWeibullScale);
+  read(s, o.distributionWeibullShape);
+  read(s, clamping);
+  read(s, o.clampingMin);
+  read(s, o.clampingMax);
+  read(s, mixing);
+  read(s, o.mixingTwopointGaussCutoff);
+  read(s, o.mixingFourpointGaussCutoff);
+  read(s, o.mixingTwopointLinearMin);
+  read(s, o.mixingFourpointLinearMin);
+
+  o.distribution = (DistributionType)distribution;
+  o.clamping = (ClampingMode)clamping;
+  o.mixing = (MixingMode)mixing;
+}
+
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+
+Recording::Setup::Setup()
+{
+  scale = Vector3D(20.0f, 800.0f, 20.0f);
+  game = false;
+  playerAmmo = -1;
+  enemyCount = 0;
+  enemyActions = 0;
+  seed = 1;
+  physicsRate = 0;
+}
+
+bool Recording::Controls::operator==(const Controls &c) const
+{
+  return (acceleration == c.acceleration) &&
+         (angular.x == c.angular.x) && (angular.y == c.angular.y) &&
+         (angular.z == c.angular.z) && (firing == c.firing);
+}
+
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+
+const char Recording::MAGIC[4] = { 'F', 'S', 'R', 'C' };
+
+Recording::Recording()
+{
+  _steps = 0;
+  _checksum = 0;
+}
+
+void Recording::clear()
+{
+  _events.clear();
+  _steps = 0;
+  _checksum = 0;
+}
+
+void Recording::addControls(unsigned int step, const Controls &controls)
+{
+  if ((!_events.empty()) && (_events.back().controls == controls))
+    return;
+
+  // Controls set again in the same step replace the previous ones
+  if ((!_events.empty()) && (_events.back().step == step))
+  {
+    _events.back().controls = controls;
+    return;
+  }
+
+  Event event;
+  event.step = step;
+  event.controls = controls;
+  _events.push_back(event);
+}
+
+Recording::Controls Recording::controls(unsigned int step) const
+{
+  // The last event at or before the step
+  int lo = 0, hi = _events.size();
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (_events[mid].step <= step)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0)
+    return Controls();
+
+  return _events[lo - 1].controls;
+}
+
+void Recording::finish(unsigned int pSteps, unsigned long long pChecksum)
+{
+  _steps = pSteps;
+  _checksum = pChecksum;
+}
+
+bool Recording::save(const std::string &fileName) const
+{
+  ofstream file(fileName.c_str(), ios::out | ios::binary);
+  if (!file)
+    return false;
+
+  file.write(MAGIC, sizeof(MAGIC));
+  write(file, (int)VERSION);
+
+  write(file, _setup.fractalOptions);
+  write(file, _setup.scale);
+  write(file, (unsigned char)_setup.game);
+  write(file, _setup.playerAmmo);
+  write(file, _setup.enemyCount);
+  write(file, _setup.enemyActions);
+  write(file, _setup.seed);
+  write(file, _setup.physicsRate);
+
+  write(file, _steps);
+  write(file, _checksum);
+
+  write(file, (unsigned int)_events.size());
+  for (unsigned int i = 0; i < _events.size(); ++i)
+  {
+    const Event &e = _events[i];
+    write(file, e.step);
+    write(file, e.controls.acceleration);
+    write(file, e.controls.angular);
+    write(file, (unsigned char)e.controls.firing);
+  }
+
+  return !file.fail();
+}
+
+bool Recording::load(const std::string &fileName)
+{
+  ifstream file(fileName.c_str(), ios::in | ios::binary);
+  if (!file)
+    return false;
+
+  char magic[4] = { 0 };
+  int version = 0;
+  file.read(magic, sizeof(magic));
+  read(file, version);
+  if ((memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) || (version != VERSION))
+    return false;
+
+  Setup setup;
+  unsigned char game = 0;
+  read(file, setup.fractalOptions);
+  read(file, setup.scale);
+  read(file, game);
+  read(file, setup.playerAmmo);
+  read(file, setup.enemyCount);
+  read(file, setup.enemyActions);
+  read(file, setup.seed);
+  read(file, setup.physicsRate);
+  setup.game = (game != 0);
+
+  unsigned int steps = 0, count = 0;
+  unsigned long long checksum = 0;
+  read(file, steps);
+  read(file, checksum);
+  read(file, count);
+  if (file.fail())
+    return false;
+
+  vector<Event> events;
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    Event e;
+    unsigned char firing = 0;
+    read(file, e.step);
+    read(file, e.controls.acceleration);
+    read(file, e.controls.angular);
+    read(file, firing);
+    e.controls.firing = (firing != 0);
+
+    if (file.fail())
+      return false;
+
+    events.push_back(e);
+  }
+
+  _setup = setup;
+  _events.swap(events);
+  _steps = steps;
+  _checksum = checksum;
+
+  return true;
+}
@@ -0,0 +1,98 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* recording.h
+    Contains the Recording class, a flight saved to be replayed. */
+
+#pragma once
+
+#include "config.h"
+
+#include "common.h"
+#include "fractal.h"
+
+#include <string>
+#include <vector>
+
+/* Everything that decides the course of a flight: the options and scale
+   of the terrain, whose heights depend on nothing else, the setup of the
+   game, the seed and rate of the physics and the controls of the player,
+   stored at the steps in which they changed. Replaying it takes the
+   World through the same states; the checksum of the last one tells whether
+   it did. Files are binary, in the byte order of the machine. */
+class Recording
+{
+  public:
+    struct Setup
+    {
+      FractalOptions fractalOptions;
+      Vector3D scale;
+      bool game;
+      int playerAmmo;
+      int enemyCount, enemyActions;
+      unsigned int seed;
+      int physicsRate;
+
+      Setup();
+    };
+
+    struct Controls
+    {
+      float acceleration;
+      Vector3D angular;
+      bool firing;
+
+      Controls() : acceleration(0.0f), firing(false) {}
+
+      bool operator==(const Controls &c) const;
+    };
+
+  public:
+    Recording();
+
+    inline void setSetup(const Setup &pSetup)
+      { _setup = pSetup; }
+    inline const Setup& setup() const
+      { return _setup; }
+
+    // Removes the controls and the end
+    void clear();
+
+    // Stores the controls used from the given step on, if they changed
+    void addControls(unsigned int step, const Controls &controls);
+
+    // Controls used in the given step
+    Controls controls(unsigned int step) const;
+
+    inline unsigned int eventCount() const
+      { return _events.size(); }
+
+    // Sets the end: steps made and the checksum of the state after them
+    void finish(unsigned int pSteps, unsigned long long pChecksum);
+
+    inline unsigned int steps() const
+      { return _steps; }
+    inline unsigned long long checksum() const
+      { return _checksum; }
+
+    bool save(const std::string &fileName) const;
+    bool load(const std::string &fileName);
+
+  private:
+    struct Event
+    {
+      unsigned int step;
+      Controls controls;
+    };
+
+    static const char MAGIC[4];
+    // Changed whenever the format or the generation of the terrain changes
+    static const int VERSION = 2;
+
+    Setup _setup;
+    std::vector<Event> _events;
+    unsigned int _steps;
+    unsigned long long _checksum;
+};
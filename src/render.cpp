@@ -19,7 +19,12 @@
 #include "simulation.h"
 #include "settingsdialog.h"
 #include "console.h"
+#include "profiler.h"
+#include "profileroverlay.h"
+#include "trace.h"
+#include "recording.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <ctime>
 #include <sstream>
@@ -60,11 +65,14 @@ Render::Render() : Widget(NULL, "Render")
 
   _console = new Console(this);
 
+  _profilerOverlay = new ProfilerOverlay(this);
+
   Settings::instance()->registerSetting<bool>("FPS", true);
 
   BindingManager *b = BindingManager::instance();
   b->registerKey("Console", KeyBinding(SDLK_BACKQUOTE));
   b->registerKey("ToggleFPS", KeyBinding(SDLK_F1));
+  b->registerKey("ToggleProfiler", KeyBinding(SDLK_F2));
   b->registerKey("Quit", KeyBinding(SDLK_F4));
 }
 
@@ -80,6 +88,7 @@ Render::~Render()
   _gameDialog = NULL;
   _settingsDialog = NULL;
   _console = NULL;
+  _profilerOverlay = NULL;
   _fpsLabel = NULL;
 }
 
@@ -129,6 +138,24 @@ void Render::init()
   initChildren();
 }
 
+bool Render::replay(const std::string &fileName)
+{
+  Recording recording;
+  if (!recording.load(fileName))
+  {
+    print("Could not load the recording " + fileName);
+    return false;
+  }
+
+  print("Replaying " + fileName);
+
+  _mainMenu->hide();
+  _simulation->replay(recording);
+  _simulation->show();
+
+  return true;
+}
+
 void Render::render()
 {
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -317,6 +344,8 @@ void Render::resizeEvent()
   _console->setGeometry(Rect(geometry().position(),
                              Size(geometry().w, geometry().h / 2.0f)));
 
+  _profilerOverlay->setGeometry(geometry());
+
   _fpsLabel->setGeometry(geometry());
 
   Rect mainMenuArea;
@@ -347,6 +376,11 @@ void Render::keyboardDownEvent(KeyboardDownEvent *e)
     e->stop();
     _fpsLabel->setVisible(!_fpsLabel->visible());
   }
+  else if (b->findKey("ToggleProfiler").check(keysym))
+  {
+    e->stop();
+    _profilerOverlay->setVisible(!_profilerOverlay->visible());
+  }
   else if (b->findKey("Quit").check(keysym))
   {
     e->stop();
@@ -406,11 +440,69 @@ void Render::consoleCommand(const std::string &command)
     print("FPS counter: off");
     setFPSVisible(false);
   }
+  else if (cmd == "profile")
+  {
+    print("Profiler overlay: on");
+    _profilerOverlay->show();
+  }
+  else if (cmd == "noprofile")
+  {
+    print("Profiler overlay: off");
+    _profilerOverlay->hide();
+  }
+  else if (cmd == "profdump")
+  {
+    string fileName = "profile.csv";
+    s >> fileName;
+
+    stringstream p;
+    if (Profiler::instance()->dump(fileName))
+      p << "Times of the last " << min(Profiler::instance()->frameCount(), (int)Profiler::FRAMES)
+        << " frames written to " << fileName;
+    else
+      p << "Could not write " << fileName;
+    print(p.str());
+  }
+  else if (cmd == "trace")
+  {
+    string action, fileName = "trace.json";
+    s >> action >> fileName;
+
+    stringstream p;
+    if (action == "start")
+    {
+      Trace::instance()->start();
+      p << "Trace recording started";
+    }
+    else if (action == "stop")
+    {
+      Trace::instance()->stop();
+      p << "Trace of " << Trace::instance()->eventCount() << " events ";
+      if (Trace::instance()->save(fileName))
+        p << "written to " << fileName;
+      else
+        p << "could not be written to " << fileName;
+    }
+    else
+    {
+      p << "Usage: trace start | trace stop [file]";
+    }
+    print(p.str());
+  }
+  else if (cmd == "sim")
+  {
+    string args;
+    getline(s, args);
+    _simulation->consoleCommand(args);
+  }
   else if (cmd == "help")
   {
     print("Available commands:");
     print("  exit, quit");
     print("  fps, nofps");
+    print("  profile, noprofile - overlay with the times of parts of frames");
+    print("  profdump [file] - writes the times of the last frames as CSV");
+    print("  trace start, trace stop [file] - records a timeline in the Chrome trace format");
     print("  sim ...");
   }
   else if ((cmd == "quit") || (cmd == "exit"))
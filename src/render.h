@@ -23,6 +23,7 @@ class GameDialog;
 class Simulation;
 class SettingsDialog;
 class Console;
+class ProfilerOverlay;
 
 class Render : public Widget
 {
@@ -47,6 +48,10 @@ class Render : public Widget
     void loadSettings();
 
     virtual void init();
+
+    // Shows the simulation replaying the recorded flight
+    bool replay(const std::string &fileName);
+
     virtual void render();
     virtual void update();
 
@@ -67,6 +72,7 @@ class Render : public Widget
     SettingsDialog *_settingsDialog;
 
     Console *_console;
+    ProfilerOverlay *_profilerOverlay;
     std::vector<int> _consoleSaveEvents;
 
     Widget *_childEventSender;
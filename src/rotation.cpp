@@ -275,6 +275,23 @@ void Rotation::reverseToGLMatrix(float (&matrix)[16]) const
   r.toGLMatrix(matrix);
 }
 
+Rotation Rotation::interpolate(const Rotation &from, const Rotation &to, float t)
+{
+  const Quaternion &q1 = from._quaternion;
+  Quaternion q2 = to._quaternion;
+
+  // q and -q are the same rotation
+  if (q1.w * q2.w + q1.x * q2.x + q1.y * q2.y + q1.z * q2.z < 0.0f)
+    q2 = -q2;
+
+  // Normalized linear interpolation is close enough for the small angles of a single step
+  Rotation result;
+  result._quaternion = q1 * (1.0f - t) + q2 * t;
+  result._quaternion.normalize();
+  result.update();
+  return result;
+}
+
 void Rotation::update()
 {
   // Determining the local axes from rotation matrix
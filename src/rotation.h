@@ -81,6 +81,9 @@ class Rotation
 
     void reverseToGLMatrix(float (&matrix)[16]) const;
 
+    // Rotation between from (t = 0) and to (t = 1), along the shorter arc
+    static Rotation interpolate(const Rotation &from, const Rotation &to, float t);
+
   private:
     Quaternion _quaternion;
     Vector3D _mainAxis, _upAxis, _sideAxis;
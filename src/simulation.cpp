@@ -19,6 +19,7 @@
 #include "bindings.h"
 #include "model.h"
 #include "settings.h"
+#include "profiler.h"
 
 #include <sstream>
 #include <iomanip>
@@ -31,6 +32,7 @@
 using namespace std;
 
 const float Simulation::VISIBLE_RANGE = 10000.0f;
+const float Simulation::PIXEL_ERRORS[4] = { 16.0f, 8.0f, 4.0f, 2.0f };
 const float Simulation::RADAR_RANGE = 5000.0f;
 
 
@@ -43,7 +45,9 @@ Simulation::Simulation(Widget* pParent,
   _map = new Map(&_fractal, name() + "_Map");
   _map->setScale(Vector3D(20.0f, 800.0f, 20.0f));
 
-  _player = new Player(_map);
+  _world = new World(_map, name() + "_World");
+
+  _player = _world->player();
   _player->setTeam(Player::Team_Blue);
   _player->setControlType(Player::Control_AngularVelocity);
   _player->setAI(false);
@@ -51,7 +55,9 @@ Simulation::Simulation(Widget* pParent,
 
   _hudMode = Hud_Full;
 
-  _updateTimer.setIntervalMsec(5);
+  _updateTimer.setInterval(0);
+
+  _replaying = _replayReported = false;
 
   _messageTimer.setIntervalMsec(50);
 
@@ -87,6 +93,15 @@ Simulation::Simulation(Widget* pParent,
   s->registerSetting<string>("PlayerName", _player->name());
   s->registerSetting<int>("DisplayQuality", Quality_Medium);
   s->registerSetting<float>("FOV", 45.0f);
+  s->registerSetting<bool>("TerrainCache", true);
+  s->registerSetting<int>("TerrainMemory", 40);
+  s->registerSetting<bool>("OcclusionCulling", true);
+  s->registerSetting<int>("ViewRadius", 2);
+  s->registerSetting<int>("TerrainTriangles", Map::DEFAULT_TRIANGLE_BUDGET);
+  s->registerSetting<int>("PhysicsRate", World::DEFAULT_PHYSICS_RATE);
+
+  FileManager::instance()->registerFile("TerrainCache", "data/cache");
+  _map->setCacheDirectory(FileManager::instance()->fileName("TerrainCache"));
 }
 
 Simulation::~Simulation()
@@ -96,46 +111,62 @@ Simulation::~Simulation()
   _collisionLabel = NULL;
   _messageLabel = NULL;
 
-  delete _player;
   _player = NULL;
-
-  deleteEnemyPlayers();
-
-  deleteBullets();
+  delete _world;
+  _world = NULL;
 
   delete _map;
   _map = NULL;
 }
 
-void Simulation::deleteEnemyPlayers()
-{
-  for (list<Player*>::iterator it = _enemyPlayers.begin();
-       it != _enemyPlayers.end(); ++it)
-  {
-    delete *it;
-  }
-  _enemyPlayers.clear();
-}
-
-void Simulation::deleteBullets()
-{
-  for (list<Bullet*>::iterator it = _bullets.begin();
-       it != _bullets.end(); ++it)
-  {
-    delete *it;
-  }
-  _bullets.clear();
-}
-
 void Simulation::loadSettings()
 {
   Settings *s = Settings::instance();
   _player->setName(s->setting<string>("PlayerName"));
   _displayQuality = (DisplayQuality)s->setting<int>("DisplayQuality");
   _fov = s->setting<float>("FOV");
+  _map->setCacheEnabled(s->setting<bool>("TerrainCache"));
+  _map->setMemoryBudget(s->setting<int>("TerrainMemory"));
+  _map->setOcclusionCulling(s->setting<bool>("OcclusionCulling"));
+  _map->setVisibleRing(s->setting<int>("ViewRadius"));
+  _map->setTriangleBudget(s->setting<int>("TerrainTriangles"));
 }
 
 void Simulation::reset()
+{
+  _replaying = false;
+  _world->setReplay(NULL);
+
+  _setup.seed = (unsigned int)Time::nanoseconds();
+  _setup.physicsRate = Settings::instance()->setting<int>("PhysicsRate");
+
+  restart();
+
+  _world->setRecording(&_recording);
+}
+
+void Simulation::replay(const Recording &pRecording)
+{
+  _replayed = pRecording;
+
+  const Recording::Setup &setup = _replayed.setup();
+  setFractalOptions(setup.fractalOptions);
+  setScale(setup.scale);
+  setType(setup.game ? Simulation_Game : Simulation_Normal);
+
+  _setup = setup;
+  restart();
+
+  _replaying = true;
+  _world->setRecording(NULL);
+  _world->setReplay(&_replayed);
+
+  setPlayerAmmo(setup.playerAmmo);
+  if (setup.game)
+    addEnemies(setup.enemyCount, setup.enemyActions);
+}
+
+void Simulation::restart()
 {
   _map->clear();
 
@@ -147,10 +178,16 @@ void Simulation::reset()
 
   _updateTimer.setEnabled(true);
 
-  _player->reset();
-
-  deleteEnemyPlayers();
+  // The physics rate is changed only between flights, for the sake of recordings
+  _world->setSeed(_setup.seed);
+  _world->setPhysicsRate(_setup.physicsRate);
+  _world->reset();
   _enemiesDestroyed = false;
+  _replayReported = false;
+
+  _recording.clear();
+  _setup.playerAmmo = _player->ammo();
+  _setup.enemyCount = _setup.enemyActions = 0;
 
   _fog = true;
   _viewMode = View_Cockpit;
@@ -161,57 +198,32 @@ void Simulation::reset()
     _outsideViewZoom = 2.5f * _player->model()->boundingBoxDiagonal();
 
   loadSettings();
-
-  deleteBullets();
 }
 
 void Simulation::resetTimers()
 {
   _updateTimer.reset();
-  _player->resetTimers();
-  if (_simulationType == Simulation_Game)
-  {
-    for (list<Player*>::iterator it = _enemyPlayers.begin();
-         it != _enemyPlayers.end();
-         ++it)
-    {
-      (*it)->resetTimers();
-    }
-  }
+  _world->resetClock();
 }
 
-void Simulation::addEnemies(int count, int aiActions)
+void Simulation::setPlayerAmmo(int ammo)
 {
-  for (int i = 1; i <= count; ++i)
-  {
-    Player *enemy = new Player(_map);
-    enemy->setTeam(Player::Team_Red);
-    enemy->setName(string(_("Computer ")) + toString<int>(i));
-    enemy->setAI(true);
-    enemy->setAIActions(aiActions);
-
-    int mapPosX = 1 + rand() % 2;
-    if (rand() % 2 == 0)
-      mapPosX *= -1;
-
-    int mapPosZ = 1 + rand() % 2;
-    if (rand() % 2 == 0)
-      mapPosZ *= -1;
-
-    enemy->setMapPosition(mapPosX, mapPosZ);
-
-    Vector3D pos;
-    pos.x= -0.5f * _map->quadSize().x + rand() % ((int)_map->quadSize().x);
-    pos.y = _player->height();
-    pos.z = -0.5f * _map->quadSize().z + rand() % ((int)_map->quadSize().z);
-
-    enemy->setPositionOffset(pos);
+  _player->setAmmo(ammo);
+  _setup.playerAmmo = ammo;
+}
 
-    float heading = rand() % 360;
-    enemy->setHeading(heading);
+void Simulation::addEnemies(int count, int aiActions)
+{
+  _world->addEnemies(count, aiActions);
+  _setup.enemyCount += count;
+  _setup.enemyActions = aiActions;
+}
 
-    _enemyPlayers.push_back(enemy);
-  }
+bool Simulation::saveRecording(const std::string &fileName)
+{
+  _recording.setSetup(_setup);
+  _recording.finish(_world->stepCount(), _world->checksum());
+  return _recording.save(fileName);
 }
 
 void Simulation::init()
@@ -248,7 +260,7 @@ void Simulation::init()
   reset();
 
 
-  _map->createWorkerThread();
+  _map->createWorkerThreads();
 
   float lightAmbient[] = { 0.4f, 0.4f, 0.4f, 1.0f };
   float lightDiffuse[] = { 1.0f, 1.0f, 1.0f, 1.0f };
@@ -280,7 +292,12 @@ void Simulation::render()
     return;
   }
 
-  Render::instance()->begin3D(_fov, 0.1f, VISIBLE_RANGE);
+  // The far plane is beyond the farthest corner of the visible quads
+  Vector3D s = _map->quadSize();
+  float visibleSize = (_map->visibleRing() + 1) * max(s.x, s.z);
+  float farPlane = max(VISIBLE_RANGE, sqrt(2.0f * visibleSize * visibleSize));
+
+  Render::instance()->begin3D(_fov, 0.1f, farPlane);
 
   glLoadIdentity();
 
@@ -307,13 +324,12 @@ void Simulation::render()
 
   // Rotation inverse to the player ("ground" turns the opposite direction to the player)
   float rotationMatrix[16] = { 0.0f };
-  _player->rotation().toGLMatrix(rotationMatrix);
+  _player->renderRotation().toGLMatrix(rotationMatrix);
   glMultMatrixf(rotationMatrix);
 
-  // Player translation
-  glTranslatef(-_player->positionOffset().x,
-               -_player->positionOffset().y,
-               -_player->positionOffset().z);
+  // Player translation (between the last two steps of the simulation)
+  Vector3D viewerOffset = _player->renderPositionOffset();
+  glTranslatef(-viewerOffset.x, -viewerOffset.y, -viewerOffset.z);
 
   glColor3f(1.0f, 1.0f, 1.0f);
 
@@ -334,10 +350,13 @@ void Simulation::render()
 
   if (_fog)
   {
-    float f = min(_map->quadSize().x, _map->quadSize().z);
-    float h = _player->height() - _map->quadSize().y;
-    float fogMin = sqrt(0.25f * f*f + h*h);
-    float fogMax = 2.0f * f;
+    // Fog ends at the outer edge of the visible ring, wherever the player is in the center quad
+    float f = min(s.x, s.z);
+    float h = viewerOffset.y - s.y;
+    float r = max(0.0f, _map->visibleRing() - 1.5f);
+    float fogMax = _map->visibleRing() * f;
+    // Small rings or high flights would put the start beyond the end
+    float fogMin = min(sqrt(r*r * f*f + h*h), 0.9f * fogMax);
 
     glFogf(GL_FOG_MODE, GL_LINEAR);
     glFogf(GL_FOG_START, fogMin);
@@ -346,7 +365,8 @@ void Simulation::render()
     glEnable(GL_FOG);
   }
 
-  /* Only 25 fields of the map are rendered:
+  /* Only the fields within the visible ring of the map are rendered
+     (ViewRadius setting), e.g. 25 fields for ring 2:
 
       2 2 2 2 2
       2 1 1 1 2
@@ -355,69 +375,23 @@ void Simulation::render()
       2 2 2 2 2
 
       0 - "zero" field
-   */
-
 
-  // Field coordinates to be drawn:
-
-  // Level "1"
-  const int LEVEL_1[][2] =
-  {
-    { 1, 0}, { 1,  1}, {0,  1}, {-1,  1},
-    {-1, 0}, {-1, -1}, {0, -1}, { 1, -1},
-  };
-  const int LEVEL_1_SIZE = sizeof(LEVEL_1) / sizeof(*LEVEL_1);
-
-  // Level "2"
-  const int LEVEL_2[][2] =
-  {
-    { 2,  0}, { 2,  1}, { 2,  2}, { 1,  2},
-    { 0,  2}, {-1,  2}, {-2,  2}, {-2,  1},
-    {-2,  0}, {-2, -1}, {-2, -2}, {-1, -2},
-    { 0, -2}, { 1, -2}, { 2, -2}, { 2, -1}
-  };
-  const int LEVEL_2_SIZE = sizeof(LEVEL_2) / sizeof(*LEVEL_2);
-
-
-  Map::DetailLevel level0Detail = Map::DetailHigh;
-  if (_displayQuality == Quality_Low)
-    level0Detail = Map::DetailMedium;
-
-  _map->renderQuad(_player->mapPositionX(), _player->mapPositionZ(), level0Detail);
-
-
-  Vector3D s = _map->quadSize();
+     The detail of each part of a field depends on its distance and the
+     display quality. */
 
-  Map::DetailLevel level1Detail = Map::DetailMedium;
-  if ((_displayQuality == Quality_High) ||
-      (_displayQuality == Quality_VeryHigh))
-    level1Detail = Map::DetailHigh;
+  _map->setLodParameters(_fov, (int)geometry().h, PIXEL_ERRORS[_displayQuality]);
+  _map->resetRenderStats();
 
-  for (int i = 0; i < LEVEL_1_SIZE; ++i)
-  {
-    glPushMatrix();
-    {
-      glTranslatef(s.x * LEVEL_1[i][0], 0.0f, s.z * LEVEL_1[i][1]);
-      _map->renderQuad(_player->mapPositionX() + LEVEL_1[i][0],
-                       _player->mapPositionZ() + LEVEL_1[i][1], level1Detail);
-    }
-    glPopMatrix();
-  }
+  // Frustum of the camera (placed by the player's rotation and position above)
+  float projectionMatrix[16], modelviewMatrix[16];
+  glGetFloatv(GL_PROJECTION_MATRIX, projectionMatrix);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelviewMatrix);
 
-  Map::DetailLevel level2Detail = Map::DetailLow;
-  if (_displayQuality == Quality_VeryHigh)
-    level2Detail = Map::DetailHigh;
+  Frustum frustum;
+  frustum.setMatrices(projectionMatrix, modelviewMatrix);
 
-  for (int i = 0; i < LEVEL_2_SIZE; ++i)
-  {
-    glPushMatrix();
-    {
-      glTranslatef(s.x * LEVEL_2[i][0], 0.0f, s.z * LEVEL_2[i][1]);
-      _map->renderQuad(_player->mapPositionX() + LEVEL_2[i][0],
-                       _player->mapPositionZ() + LEVEL_2[i][1], level2Detail);
-    }
-    glPopMatrix();
-  }
+  _map->render(_player->mapPositionX(), _player->mapPositionZ(),
+               viewerOffset, frustum);
 
   if (_fog)
     glDisable(GL_FOG);
@@ -438,24 +412,23 @@ void Simulation::render()
     // Enemies and bullets
     if (_simulationType == Simulation_Game)
     {
-      for (list<Player*>::iterator it = _enemyPlayers.begin();
-           it != _enemyPlayers.end(); ++it)
+      const list<Player*> &enemies = _world->enemyPlayers();
+      for (list<Player*>::const_iterator it = enemies.begin();
+           it != enemies.end(); ++it)
       {
-        Vector3D deltaPos = (*it)->actualPosition() - _player->actualPosition();
+        Vector3D deltaPos = (*it)->renderPosition() - _player->renderPosition();
         if (deltaPos.length() < VISIBLE_RANGE)
         {
-          (*it)->render(-(*it)->rotation().heading() + _player->rotation().heading());
+          (*it)->render(-(*it)->renderRotation().heading() + _player->renderRotation().heading());
         }
       }
 
       glDisable(GL_LIGHT1);
       glDisable(GL_LIGHTING);
 
-      for (list<Bullet*>::iterator it = _bullets.begin();
-           it != _bullets.end(); ++it)
-      {
-        (*it)->render();
-      }
+      const EntityStore &entities = _world->entities();
+      for (unsigned int i = 0; i < entities.bulletCount(); ++i)
+        entities.bullet(i).render();
 
     }
   }
@@ -687,12 +660,12 @@ void Simulation::renderHud()
     {
       Vector3D qs = _map->quadSize();
 
-      Vector3D offset = _player->positionOffset() * (radarSize / RADAR_RANGE);
+      Vector3D offset = _player->renderPositionOffset() * (radarSize / RADAR_RANGE);
 
       // Grid
       glPushMatrix();
       {
-        glRotatef(-_player->rotation().heading(), 0.0f, 0.0f, 1.0f);
+        glRotatef(-_player->renderRotation().heading(), 0.0f, 0.0f, 1.0f);
         glTranslatef(-offset.x, offset.z, 0.0f);
 
         int nGrids = 1 + (int)max(1.5f * ceil(RADAR_RANGE / qs.x),
@@ -731,12 +704,13 @@ void Simulation::renderHud()
       // Enemy positions
       glPushMatrix();
       {
-        for (list<Player*>::iterator it = _enemyPlayers.begin();
-           it != _enemyPlayers.end(); ++it)
+        const list<Player*> &enemies = _world->enemyPlayers();
+        for (list<Player*>::const_iterator it = enemies.begin();
+           it != enemies.end(); ++it)
         {
-          Vector3D deltaPos = (*it)->actualPosition() - _player->actualPosition();
+          Vector3D deltaPos = (*it)->renderPosition() - _player->renderPosition();
           deltaPos.y = 0.0f;
-          deltaPos.rotate(-_player->rotation().heading(), Vector3D(0.0f, 1.0f, 0.0f));
+          deltaPos.rotate(-_player->renderRotation().heading(), Vector3D(0.0f, 1.0f, 0.0f));
 
           glColor3fv((*it)->color());
 
@@ -789,6 +763,8 @@ void Simulation::renderHud()
 
 void Simulation::update()
 {
+  ProfileScope scope("Simulation::update");
+
   if (_initializing)
   {
     if (_map->init())
@@ -804,107 +780,80 @@ void Simulation::update()
   if ((_initializing) || (!_updateTimer.enabled()))
     return;
 
-  _player->update();
+  // Real time since the previous frame, simulated in fixed steps
+  _updateTimer.checkTimeout();
+  float delta = _updateTimer.timeoutDifference() / 1e9f;
 
-  // Update of enemies
-  if (_simulationType == Simulation_Game)
   {
-    for (list<Player*>::iterator it = _enemyPlayers.begin();
-          it != _enemyPlayers.end();
-          ++it)
-    {
-      (*it)->update();
-    }
+    ProfileScope physicsScope("Physics");
+    _world->advance(delta);
   }
 
-  if (_updateTimer.checkTimeout())
-  {
-    float delta = _updateTimer.timeoutDifference() / 1e9f;
+  _map->setViewer(_player->mapPositionX(), _player->mapPositionZ(),
+                  _player->positionOffset(), _player->velocityVector());
+  _map->prefetch();
 
-    stringstream hs;
-    hs << "H: " << fixed << setprecision(2) << _player->height();
-    _heightString = hs.str();
+  stringstream hs;
+  hs << "H: " << fixed << setprecision(2) << _player->height();
+  _heightString = hs.str();
 
-    stringstream as;
-    as << "A: " << fixed << setprecision(2) << _player->altitude();
-    _altitudeString = as.str();
+  stringstream as;
+  as << "A: " << fixed << setprecision(2) << _player->altitude();
+  _altitudeString = as.str();
 
-    stringstream vs;
-    vs << "V: " << fixed << setprecision(2) << _player->velocity();
-    _velocityString = vs.str();
+  stringstream vs;
+  vs << "V: " << fixed << setprecision(2) << _player->velocity();
+  _velocityString = vs.str();
 
-    if (_simulationType == Simulation_Game)
-    {
-      stringstream amms;
-      amms << "Am: ";
-      if (_player->ammo() == -1)
-        amms << "inf.";
-      else
-        amms << _player->ammo();
-      _ammoString = amms.str();
-    }
+  if (_simulationType == Simulation_Game)
+  {
+    stringstream amms;
+    amms << "Am: ";
+    if (_player->ammo() == -1)
+      amms << "inf.";
+    else
+      amms << _player->ammo();
+    _ammoString = amms.str();
+  }
 
-    // Update of view angles
-    _outsideViewAngles += delta * _outsideViewAnglesAcc;
+  // Update of view angles
+  _outsideViewAngles += delta * _outsideViewAnglesAcc;
 
-    // Collision detection
-    if (_player->height() <= _map->quadSize().y)
-    {
-      if (_player->altitude() <= 0.0f)
-      {
-        _collisionLabel->show();
-        _menu->show();
-        _updateTimer.setEnabled(false);
-      }
-    }
+  // Collision with the ground stops the simulation
+  if (_world->crashed())
+  {
+    _collisionLabel->show();
+    _menu->show();
+    _updateTimer.setEnabled(false);
+  }
 
-    if (_simulationType == Simulation_Game)
-    {
-      // Adding new bullets
-      vector<Bullet*> newBullets = _player->createdBullets();
-      for (unsigned int i = 0; i < newBullets.size(); ++i)
-        _bullets.push_back(newBullets[i]);
-
-      // Update of bullets
-      for (list<Bullet*>::iterator it = _bullets.begin();
-           it != _bullets.end(); ++it)
-      {
-        if ((*it)->decayed())
-        {
-          delete *it;
-          it = _bullets.erase(it);
-        }
-        else
-        {
-          (*it)->update(delta);
-          _player->checkHit(*it);
+  if (_replaying && _world->replayFinished() && (!_replayReported))
+  {
+    _replayReported = true;
 
-          for (list<Player*>::iterator jt = _enemyPlayers.begin();
-               jt != _enemyPlayers.end(); ++jt)
-          {
-            (*jt)->checkHit(*it);
-          }
-        }
-      }
+    string message;
+    if (_world->checksum() == _replayed.checksum())
+      message = _("Replay finished: the flight was the same as recorded");
+    else
+      message = _("Replay finished: the flight differed from the recording!");
 
-      // Update of enemy destruction
-      for (list<Player*>::iterator jt = _enemyPlayers.begin();
-          jt != _enemyPlayers.end(); ++jt)
-      {
-        if ((*jt)->destroyed())
-        {
-          displayMessage(replace(string(_("Enemy %1 shot down!")), "%1", (*jt)->name()));
+    print(message);
+    displayMessage(message);
 
-          delete *jt;
-          jt = _enemyPlayers.erase(jt);
-        }
-      }
+    _menu->show();
+    _updateTimer.setEnabled(false);
+  }
 
-      if (_enemyPlayers.empty() && (!_enemiesDestroyed))
-      {
-        _enemiesDestroyed = true;
-        displayMessage(_("You have eliminated all enemies. Congratulations!"));
-      }
+  if (_simulationType == Simulation_Game)
+  {
+    vector<string> destroyed = _world->destroyedEnemies();
+    for (unsigned int i = 0; i < destroyed.size(); ++i)
+      displayMessage(replace(string(_("Enemy %1 shot down!")), "%1", destroyed[i]));
+
+    if (_world->enemyPlayers().empty() && (!_enemiesDestroyed))
+    {
+      _enemiesDestroyed = true;
+      displayMessage(_("You have eliminated all enemies. Congratulations!"));
     }
   }
 
@@ -1272,6 +1221,126 @@ void Simulation::settingsDialogFinished()
   resetTimers();
 }
 
+void Simulation::printLodStats()
+{
+  const char *NAMES[4] = { "Low", "Medium", "High", "Very high" };
+
+  // Triangles of the fixed detail levels used before: rings 0, 1 and 2 at each quality
+  const int HIGH = 2 * 128 * 128, MEDIUM = 2 * 64 * 64, LOW = 2 * 32 * 32;
+  const int FIXED[4][3] =
+  {
+    { MEDIUM, MEDIUM, LOW },
+    { HIGH, MEDIUM, LOW },
+    { HIGH, HIGH, LOW },
+    { HIGH, HIGH, HIGH }
+  };
+
+  Vector3D s = _map->quadSize();
+  const int ring = _map->visibleRing();
+
+  stringstream p;
+  p << "Triangles in the last frame: " << _map->renderStats().triangles;
+  print(p.str());
+
+  for (int quality = 0; quality < 4; ++quality)
+  {
+    int triangles = 0, fixed = 0;
+
+    for (int dx = -ring; dx <= ring; ++dx)
+    {
+      for (int dz = -ring; dz <= ring; ++dz)
+      {
+        Vector3D viewer = _player->positionOffset() - Vector3D(s.x * dx, 0.0f, s.z * dz);
+        triangles += _map->quadTriangles(_player->mapPositionX() + dx,
+                                         _player->mapPositionZ() + dz,
+                                         viewer, PIXEL_ERRORS[quality]);
+        fixed += FIXED[quality][min(max(abs(dx), abs(dz)), 2)];
+      }
+    }
+
+    p.str("");
+    p << "  " << NAMES[quality] << " (" << PIXEL_ERRORS[quality] << " px): "
+      << triangles << " triangles (fixed levels: " << fixed << ")";
+    print(p.str());
+  }
+}
+
+void Simulation::consoleCommand(const std::string &command)
+{
+  stringstream s;
+  s.str(command);
+
+  string cmd;
+  s >> cmd;
+
+  if (cmd == "mem")
+  {
+    _map->printMemoryUsage();
+  }
+  else if (cmd == "prefetch")
+  {
+    _map->printPrefetchStats();
+  }
+  else if (cmd == "tasks")
+  {
+    _map->printTaskStats();
+  }
+  else if (cmd == "eviction")
+  {
+    _map->printEvictionStats();
+  }
+  else if (cmd == "lod")
+  {
+    printLodStats();
+  }
+  else if (cmd == "cull")
+  {
+    const Map::RenderStats &stats = _map->renderStats();
+
+    stringstream p;
+    p << "Last frame: quads " << stats.quadsDrawn << " drawn, " << stats.quadsCulled << " culled; "
+      << "patches " << stats.patchesDrawn << " drawn, " << stats.patchesCulled << " culled, "
+      << stats.patchesOccluded << " occluded; "
+      << stats.triangles << " triangles at " << stats.pixelError << " px";
+    print(p.str());
+  }
+  else if (cmd == "bullets")
+  {
+    EntityStore::BulletPoolStats stats = _world->entities().bulletPoolStats();
+
+    stringstream p;
+    p << "Bullet pool: " << stats.live << " of " << stats.capacity << " in flight, high-water mark "
+      << stats.highWater << "; " << stats.allocations << " allocations (" << stats.recycled
+      << " recycled), " << stats.dropped << " dropped";
+    print(p.str());
+  }
+  else if (cmd == "record")
+  {
+    string fileName = "flight.rec";
+    s >> fileName;
+
+    stringstream p;
+    if (saveRecording(fileName))
+      p << "Flight of " << _world->stepCount() << " steps (" << _recording.eventCount()
+        << " changes of controls) written to " << fileName;
+    else
+      p << "Could not write " << fileName;
+    print(p.str());
+  }
+  else
+  {
+    print("Available sim commands:");
+    print("  mem - memory usage of map quads");
+    print("  prefetch - statistics of quad prefetching");
+    print("  tasks - state of the quad generation tasks");
+    print("  eviction - statistics of quad eviction");
+    print("  lod - triangles rendered at each display quality");
+    print("  cull - terrain drawn, culled by the view frustum and occluded");
+    print("  bullets - usage of the bullet pool");
+    print("  record [file] - saves the current flight, to be replayed with -replay");
+  }
+}
+
 void Simulation::childEvent(Widget *sender, int parameter)
 {
   if (sender == _menu)
@@ -16,6 +16,7 @@
 #include "fractal.h"
 #include "bullet.h"
 #include "player.h"
+#include "world.h"
 
 #include <list>
 
@@ -65,30 +66,46 @@ class Simulation : public Widget
     virtual ~Simulation();
 
     inline void setFractalOptions(const FractalOptions &pOptions)
-      { _fractal.setOptions(pOptions); }
+      { _fractal.setOptions(pOptions); _setup.fractalOptions = pOptions; }
 
     inline void setScale(const Vector3D &pScale)
-      { _map->setScale(pScale); }
+      { _map->setScale(pScale); _setup.scale = pScale; }
 
     inline void setType(SimulationType pType)
-      { _simulationType = pType; }
+    {
+      _simulationType = pType;
+      _world->setGame(pType == Simulation_Game);
+      _setup.game = (pType == Simulation_Game);
+    }
     inline SimulationType type() const
       { return _simulationType; }
 
-    inline void setPlayerAmmo(int ammo)
-      { _player->setAmmo(ammo); }
+    void setPlayerAmmo(int ammo);
 
     void loadSettings();
+
+    // Starts a new flight, with a new seed, recorded from the beginning
     void reset();
 
     void addEnemies(int count, int aiActions);
 
+    // Starts the flight of the recording, driving the player by its controls
+    void replay(const Recording &pRecording);
+
+    inline bool replaying() const
+      { return _replaying; }
+
+    // Saves the current flight, up to the last step made
+    bool saveRecording(const std::string &fileName);
+
     virtual void init();
     virtual void render();
     virtual void update();
 
     void settingsDialogFinished();
 
+    void consoleCommand(const std::string &command);
+
   protected:
     virtual void resizeEvent();
     virtual void showEvent();
@@ -110,12 +127,19 @@ class Simulation : public Widget
     bool _initializing;
 
     SimulationType _simulationType;
+    World *_world;
+    // Owned by the world
     Player* _player;
-    std::list<Player*> _enemyPlayers;
     bool _enemiesDestroyed;
-    std::list<Bullet*> _bullets;
+    // Measures the real time passed between updates
     Timer _updateTimer;
 
+    // Setup of the current flight, its recording and the replayed one
+    Recording::Setup _setup;
+    Recording _recording;
+    Recording _replayed;
+    bool _replaying, _replayReported;
+
     DisplayQuality _displayQuality;
     ViewMode _viewMode;
     float _fov;
@@ -142,11 +166,13 @@ class Simulation : public Widget
     Timer _messageTimer;
 
     static const float VISIBLE_RANGE;
+    // Allowed error of the terrain on screen [px] at each DisplayQuality
+    static const float PIXEL_ERRORS[4];
     static const float RADAR_RANGE;
 
+    void restart();
     void displayMessage(const std::string &message);
-    void deleteEnemyPlayers();
-    void deleteBullets();
     void resetTimers();
     void renderHud();
+    void printLodStats();
 };
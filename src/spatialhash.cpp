@@ -0,0 +1,147 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* spatialhash.cpp
+    Contains the implementation of the SpatialHash class. */
+
+#include "spatialhash.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// Smallest size of the hash table
+static const unsigned int MIN_SLOTS = 64;
+
+
+SpatialHash::SpatialHash()
+{
+  _build = 1;
+  _mask = MIN_SLOTS - 1;
+
+  _slotX.assign(MIN_SLOTS, 0);
+  _slotZ.assign(MIN_SLOTS, 0);
+  _slotBegin.assign(MIN_SLOTS, 0);
+  _slotCount.assign(MIN_SLOTS, 0);
+  _slotBuild.assign(MIN_SLOTS, 0);
+
+  setQuadSize(Vector3D(1.0f, 1.0f, 1.0f));
+}
+
+void SpatialHash::setQuadSize(const Vector3D &quadSize)
+{
+  _quadSize = quadSize;
+  _cellSize = min(quadSize.x, quadSize.z) / CELLS_PER_QUAD;
+}
+
+unsigned int SpatialHash::hashCell(int x, int z)
+{
+  unsigned int h = ((unsigned int)x * 0x9e3779b1u) ^ ((unsigned int)z * 0x85ebca6bu);
+  return h ^ (h >> 15);
+}
+
+unsigned int SpatialHash::slot(int x, int z) const
+{
+  // The slot of the cell, or the empty one where it would be put
+  unsigned int s = hashCell(x, z) & _mask;
+  while ((_slotBuild[s] == _build) && ((_slotX[s] != x) || (_slotZ[s] != z)))
+    s = (s + 1) & _mask;
+  return s;
+}
+
+void SpatialHash::cell(const Vector3D &position, int &x, int &z) const
+{
+  // Quad as in Player (quad 0 spans [-size/2, size/2]), then the cell in it
+  int quadX = (int)floor(position.x / _quadSize.x + 0.5f);
+  int quadZ = (int)floor(position.z / _quadSize.z + 0.5f);
+
+  float localX = position.x - (quadX - 0.5f) * _quadSize.x;
+  float localZ = position.z - (quadZ - 0.5f) * _quadSize.z;
+
+  int cellX = (int)floor(localX * CELLS_PER_QUAD / _quadSize.x);
+  int cellZ = (int)floor(localZ * CELLS_PER_QUAD / _quadSize.z);
+  cellX = max(0, min(cellX, CELLS_PER_QUAD - 1));
+  cellZ = max(0, min(cellZ, CELLS_PER_QUAD - 1));
+
+  x = quadX * CELLS_PER_QUAD + cellX;
+  z = quadZ * CELLS_PER_QUAD + cellZ;
+}
+
+void SpatialHash::build(const Vector3D *points, unsigned int count)
+{
+  // At most half of the table is used, so that probing stays short
+  unsigned int size = _mask + 1;
+  if (size < 2 * count)
+  {
+    while (size < 2 * count)
+      size *= 2;
+
+    _slotX.assign(size, 0);
+    _slotZ.assign(size, 0);
+    _slotBegin.assign(size, 0);
+    _slotCount.assign(size, 0);
+    _slotBuild.assign(size, 0);
+    _mask = size - 1;
+  }
+
+  ++_build;
+  if (_build == 0)
+  {
+    _slotBuild.assign(size, 0);
+    _build = 1;
+  }
+
+  _usedSlots.clear();
+  _pointSlots.resize(count);
+  _indexes.resize(count);
+
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    int x = 0, z = 0;
+    cell(points[i], x, z);
+
+    unsigned int s = slot(x, z);
+    if (_slotBuild[s] != _build)
+    {
+      _slotBuild[s] = _build;
+      _slotX[s] = x;
+      _slotZ[s] = z;
+      _slotCount[s] = 0;
+      _usedSlots.push_back(s);
+    }
+
+    ++_slotCount[s];
+    _pointSlots[i] = s;
+  }
+
+  // Ranges of the cells one after another, then the points put into them in order
+  unsigned int begin = 0;
+  for (unsigned int i = 0; i < _usedSlots.size(); ++i)
+  {
+    unsigned int s = _usedSlots[i];
+    _slotBegin[s] = begin;
+    begin += _slotCount[s];
+    _slotCount[s] = 0;
+  }
+
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    unsigned int s = _pointSlots[i];
+    _indexes[_slotBegin[s] + _slotCount[s]] = i;
+    ++_slotCount[s];
+  }
+}
+
+bool SpatialHash::find(int x, int z, unsigned int &begin, unsigned int &end) const
+{
+  unsigned int s = slot(x, z);
+  if (_slotBuild[s] != _build)
+    return false;
+
+  begin = _slotBegin[s];
+  end = begin + _slotCount[s];
+  return true;
+}
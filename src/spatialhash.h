@@ -0,0 +1,70 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* spatialhash.h
+    Contains the SpatialHash class, which finds the points near a given
+    position without testing all of them. */
+
+#pragma once
+
+#include "config.h"
+
+#include "common.h"
+
+#include <vector>
+
+/* Points are put into columns of the world (cells): each quad of the map is
+   divided into CELLS_PER_QUAD x CELLS_PER_QUAD of them, so a cell is named
+   by the coordinates of its quad and its place in the quad. Only the cells
+   holding points take room, in a hash table rebuilt with build() for every
+   set of points (e.g. the planes in each step). Memory is kept between the
+   builds, so after the first few nothing is allocated. */
+class SpatialHash
+{
+  public:
+    static const int CELLS_PER_QUAD = 32;
+
+  public:
+    SpatialHash();
+
+    // Size of the cells from the size of a quad of the map
+    void setQuadSize(const Vector3D &quadSize);
+
+    inline float cellSize() const
+      { return _cellSize; }
+
+    // Distinct cells holding points after the last build()
+    inline unsigned int cellCount() const
+      { return _usedSlots.size(); }
+
+    // Puts the points into cells; the previous ones are forgotten
+    void build(const Vector3D *points, unsigned int count);
+
+    // Cell of the position; cells of neighbors differ by 1 also across quads
+    void cell(const Vector3D &position, int &x, int &z) const;
+
+    /* Range of indexes() holding the indexes of the points in the cell (in
+       increasing order); returns false if the cell is empty */
+    bool find(int x, int z, unsigned int &begin, unsigned int &end) const;
+
+    inline unsigned int index(unsigned int i) const
+      { return _indexes[i]; }
+
+  private:
+    Vector3D _quadSize;
+    float _cellSize;
+
+    // Open addressing table of the cells; entries of older builds are empty
+    std::vector<int> _slotX, _slotZ;
+    std::vector<unsigned int> _slotBegin, _slotCount, _slotBuild;
+    unsigned int _build;
+    unsigned int _mask;
+
+    std::vector<unsigned int> _usedSlots, _pointSlots;
+    std::vector<unsigned int> _indexes;
+
+    static unsigned int hashCell(int x, int z);
+    unsigned int slot(int x, int z) const;
+};
@@ -0,0 +1,518 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* terrain.cpp
+    Contains the implementation of the TerrainQuad class. */
+
+#include "terrain.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+void TerrainQuad::filterValues(float v0, float &v1, float &v2, float &v3, float v4)
+{
+  float dv = v4 - v0;
+  v1 = v0 + 0.25f * dv;
+  v2 = v0 + 0.50f * dv;
+  v3 = v0 + 0.75f * dv;
+}
+
+/* Seed of the corner (kind 0), or of the edge along x (1) or z (2)
+   starting at the corner (x, z) */
+static int sharedSeed(int x, int z, unsigned int kind)
+{
+  unsigned int h = ((unsigned int)x * 0x9e3779b1u) ^ ((unsigned int)z * 0x85ebca6bu) ^
+                   ((kind + 1) * 0xc2b2ae35u);
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  h ^= h >> 12;
+  return (int)h;
+}
+
+void TerrainQuad::generateEdge(Fractal *fractal, int seed, float *line)
+{
+  fractal->generateLine(seed, line);
+
+  // Smoothing of the edges
+  for (int i = 0; i+4 < 1+SIZE; i += 4)
+    filterValues(line[i], line[i+1], line[i+2], line[i+3], line[i+4]);
+}
+
+void TerrainQuad::generate(const Vector3D &scale, Fractal *fractal)
+{
+  /* Corners and edges are drawn from seeds of their own positions, so they
+     are the same in all quads sharing them, whichever is created first;
+     the inside of the quad is drawn from its seed */
+
+  float corners[2][2];
+  for (int a = 0; a < 2; ++a)
+  {
+    for (int b = 0; b < 2; ++b)
+      corners[a][b] = fractal->randomValue(sharedSeed(_x + a, _z + b, 0));
+  }
+
+  fractal->clear();
+
+  float line[1+SIZE];
+
+  // Edges at z and z+1, along x
+  for (int b = 0; b < 2; ++b)
+  {
+    line[0] = corners[0][b];
+    line[SIZE] = corners[1][b];
+    generateEdge(fractal, sharedSeed(_x, _z + b, 1), line);
+
+    for (int i = 0; i < 1+SIZE; ++i)
+      fractal->setValue(i, b * SIZE, line[i]);
+  }
+
+  // Edges at x and x+1, along z
+  for (int a = 0; a < 2; ++a)
+  {
+    line[0] = corners[a][0];
+    line[SIZE] = corners[a][1];
+    generateEdge(fractal, sharedSeed(_x + a, _z, 2), line);
+
+    for (int i = 0; i < 1+SIZE; ++i)
+      fractal->setValue(a * SIZE, i, line[i]);
+  }
+
+  fractal->generate(seed());
+
+  assert(fractal->size() == 1+SIZE);
+
+  for (int x = 0; x < 1+SIZE; ++x)
+  {
+    for (int z = 0; z < 1+SIZE; ++z)
+    {
+      _values[x][z] = fractal->value(x, z);
+    }
+  }
+
+  // Heights as stored in the cache, so that the terrain is the same without it
+  QuadCache::quantize(&_values[0][0], (1+SIZE) * (1+SIZE));
+
+  _scale = scale;
+}
+
+float TerrainQuad::paddedHeight(TerrainQuad* neighbors[4], int px, int pz) const
+{
+  const int sH = SIZE;
+
+  bool borderX = (px == 0) || (px == sH+2);
+  bool borderZ = (pz == 0) || (pz == sH+2);
+
+  // Corners belong to diagonal neighbors, which are not known here
+  if (borderX && borderZ)
+  {
+    int ix = (px == 0) ? 1 : sH+1;
+    int iz = (pz == 0) ? 1 : sH+1;
+    return paddedHeight(neighbors, px, iz) + paddedHeight(neighbors, ix, pz) -
+           paddedHeight(neighbors, ix, iz);
+  }
+
+  int x = px - 1;
+  int z = pz - 1;
+
+  // Without a neighbor, the border is extrapolated linearly
+
+  if (pz == 0)
+    return (neighbors[0] != NULL) ? neighbors[0]->_values[x][sH-1] : 2.0f * _values[x][0] - _values[x][1];
+
+  if (pz == sH+2)
+    return (neighbors[2] != NULL) ? neighbors[2]->_values[x][1] : 2.0f * _values[x][sH] - _values[x][sH-1];
+
+  if (px == 0)
+    return (neighbors[3] != NULL) ? neighbors[3]->_values[sH-1][z] : 2.0f * _values[0][z] - _values[1][z];
+
+  if (px == sH+2)
+    return (neighbors[1] != NULL) ? neighbors[1]->_values[1][z] : 2.0f * _values[sH][z] - _values[sH-1][z];
+
+  return _values[x][z];
+}
+
+void TerrainQuad::paddedHeights(TerrainQuad* neighbors[4], float *heights) const
+{
+  const int sH = SIZE;
+  const int stride = 3 + sH;
+
+  for (int x = 0; x < 1+sH; ++x)
+    memcpy(&heights[(x+1) * stride + 1], _values[x], (1+sH) * sizeof(float));
+
+  for (int i = 0; i < 3+sH; ++i)
+  {
+    heights[i] = paddedHeight(neighbors, 0, i);
+    heights[(sH+2) * stride + i] = paddedHeight(neighbors, sH+2, i);
+  }
+
+  for (int x = 1; x < 2+sH; ++x)
+  {
+    heights[x * stride] = paddedHeight(neighbors, x, 0);
+    heights[x * stride + sH+2] = paddedHeight(neighbors, x, sH+2);
+  }
+}
+
+void TerrainQuad::calculateNormals(TerrainQuad* neighbors[4], const Vector3D &scale)
+{
+  const int sH = SIZE;
+
+  // Height field with a border of one vertex taken from the neighbors
+  float heights[(3+sH) * (3+sH)];
+  paddedHeights(neighbors, heights);
+
+  ::calculateNormals(heights, 1+sH, scale.x, scale.y, scale.z, &_normals[0][0]);
+}
+
+void TerrainQuad::calculateEdgeNormals(TerrainQuad* neighbors[4], const Vector3D &scale, int side)
+{
+  const int sH = SIZE;
+
+  // Only the three lines of the padded height field around the edge are needed
+  float lines[3][3+sH];
+
+  if ((side == 1) || (side == 3))
+  {
+    // Rows of constant x are continuous
+    int x = (side == 3) ? 0 : sH;
+
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int z = 0; z < 3+sH; ++z)
+        lines[i][z] = paddedHeight(neighbors, x+i, z);
+    }
+
+    calculateNormalsRow(&lines[0][1], &lines[1][1], &lines[2][1], 1+sH,
+                        scale.x, scale.y, scale.z, _normals[x]);
+  }
+  else
+  {
+    /* Columns of constant z are taken as rows; normals of the transposed
+       field are the same with x and z swapped */
+    int z = (side == 0) ? 0 : sH;
+
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int x = 0; x < 3+sH; ++x)
+        lines[i][x] = paddedHeight(neighbors, x, z+i);
+    }
+
+    PackedNormal normals[1+sH];
+    calculateNormalsRow(&lines[0][1], &lines[1][1], &lines[2][1], 1+sH,
+                        scale.z, scale.y, scale.x, normals);
+
+    for (int x = 0; x < 1+sH; ++x)
+    {
+      _normals[x][z].x = normals[x].z;
+      _normals[x][z].y = normals[x].y;
+      _normals[x][z].z = normals[x].x;
+      _normals[x][z].w = 0;
+    }
+  }
+}
+
+void TerrainQuad::calculatePatchErrors()
+{
+  _heights.build(&_values[0][0], SIZE, OCCLUDER_SIZE, _scale.y);
+
+  float maxError = 0.0f;
+
+  for (int px = 0; px < PATCH_COUNT; ++px)
+  {
+    for (int pz = 0; pz < PATCH_COUNT; ++pz)
+    {
+      int x0 = px * PATCH_SIZE;
+      int z0 = pz * PATCH_SIZE;
+
+      _patchErrors[px][pz][0] = 0.0f;
+
+      /* Largest difference between the heights and the triangles of the
+         level, split along the same diagonal as in buildIndices() */
+      for (int level = 1; level < LOD_COUNT; ++level)
+      {
+        int step = 1 << level;
+        float error = 0.0f;
+
+        for (int cx = x0; cx < x0 + PATCH_SIZE; cx += step)
+        {
+          for (int cz = z0; cz < z0 + PATCH_SIZE; cz += step)
+          {
+            float h00 = _values[cx][cz];
+            float h10 = _values[cx+step][cz];
+            float h11 = _values[cx+step][cz+step];
+            float h01 = _values[cx][cz+step];
+
+            for (int i = 0; i <= step; ++i)
+            {
+              for (int j = 0; j <= step; ++j)
+              {
+                float u = (float)i / step;
+                float v = (float)j / step;
+
+                float h = 0.0f;
+                if (u >= v)
+                  h = h00 + u * (h10 - h00) + v * (h11 - h10);
+                else
+                  h = h00 + v * (h01 - h00) + u * (h11 - h01);
+
+                error = max(error, fabs(h - _values[cx+i][cz+j]));
+              }
+            }
+          }
+        }
+
+        // Coarser levels never look better than finer ones
+        _patchErrors[px][pz][level] = max(_scale.y * error, _patchErrors[px][pz][level-1]);
+      }
+
+      maxError = max(maxError, _patchErrors[px][pz][LOD_COUNT-1]);
+    }
+  }
+
+  // Cracks between levels (also of adjacent quads) are at most twice as deep
+  _skirtDepth = 2.0f * maxError + 0.01f * _scale.y;
+}
+
+void TerrainQuad::bounds(Vector3D &minValues, Vector3D &maxValues) const
+{
+  const int sH = SIZE;
+  const int top = _heights.levelCount() - 1;
+
+  minValues = Vector3D(-0.5f * sH * _scale.x, _heights.minHeight(top, 0, 0) - _skirtDepth,
+                       -0.5f * sH * _scale.z);
+  maxValues = Vector3D(0.5f * sH * _scale.x, _heights.maxHeight(top, 0, 0),
+                       0.5f * sH * _scale.z);
+}
+
+void TerrainQuad::patchBounds(int px, int pz, Vector3D &minValues, Vector3D &maxValues) const
+{
+  const int sH = SIZE;
+
+  minValues.x = _scale.x * (px * PATCH_SIZE - 0.5f * sH);
+  minValues.y = _heights.minHeight(PATCH_LEVEL, px, pz) - _skirtDepth;
+  minValues.z = _scale.z * (pz * PATCH_SIZE - 0.5f * sH);
+
+  maxValues.x = minValues.x + _scale.x * PATCH_SIZE;
+  maxValues.y = _heights.maxHeight(PATCH_LEVEL, px, pz);
+  maxValues.z = minValues.z + _scale.z * PATCH_SIZE;
+}
+
+bool TerrainQuad::load(const QuadCache &cache, const Vector3D &scale)
+{
+  _scale = scale;
+  return cache.load(_x, _z, 1+SIZE, &_values[0][0], &_normals[0][0]);
+}
+
+void TerrainQuad::save(const QuadCache &cache) const
+{
+  cache.save(_x, _z, 1+SIZE, &_values[0][0], &_normals[0][0]);
+}
+
+float TerrainQuad::value(int x, int z) const
+{
+  if ((x < 0) || (z < 0) || (x > SIZE) || (z > SIZE))
+    return 0.0f;
+  return _values[x][z];
+}
+
+void TerrainQuad::surface(float x, float z, float &height, Vector3D &normal) const
+{
+  int cx = min(max((int)floor(x), 0), SIZE - 1);
+  int cz = min(max((int)floor(z), 0), SIZE - 1);
+  float u = min(max(x - cx, 0.0f), 1.0f);
+  float v = min(max(z - cz, 0.0f), 1.0f);
+
+  float h00 = _values[cx][cz];
+  float h10 = _values[cx+1][cz];
+  float h11 = _values[cx+1][cz+1];
+  float h01 = _values[cx][cz+1];
+
+  // Split along the same diagonal as in buildIndices()
+  float dx = 0.0f, dz = 0.0f;
+  if (u >= v)
+  {
+    dx = h10 - h00;
+    dz = h11 - h10;
+  }
+  else
+  {
+    dx = h11 - h01;
+    dz = h01 - h00;
+  }
+
+  height = _scale.y * (h00 + u * dx + v * dz);
+  normal = Vector3D::normalize(Vector3D(-dx * _scale.y / _scale.x, 1.0f,
+                                        -dz * _scale.y / _scale.z));
+}
+
+void TerrainQuad::vertexData(Vector3D *vertices, PackedNormal *normals) const
+{
+  const int sH = SIZE;
+
+  float dx = -0.5f * _scale.x * sH;
+  float dz = -0.5f * _scale.z * sH;
+
+  for (int x = 0; x < 1+sH; ++x)
+  {
+    for (int z = 0; z < 1+sH; ++z)
+    {
+      int index = vertexIndex(x, z);
+      vertices[index] = Vector3D(dx + _scale.x * x,
+                                 _scale.y * _values[x][z],
+                                 dz + _scale.z * z);
+      normals[index] = _normals[x][z];
+
+      if ((x % PATCH_SIZE == 0) || (z % PATCH_SIZE == 0))
+      {
+        index = skirtIndex(x, z);
+        vertices[index] = Vector3D(dx + _scale.x * x,
+                                   _scale.y * _values[x][z] - _skirtDepth,
+                                   dz + _scale.z * z);
+        normals[index] = _normals[x][z];
+      }
+    }
+  }
+}
+
+void TerrainQuad::buildIndices(vector<unsigned short> &indices,
+                               IndexRange ranges[PATCH_COUNT][PATCH_COUNT][LOD_COUNT])
+{
+  // Triangles and skirts of the finest level of a patch
+  const int maxPatchIndices = 6 * PATCH_SIZE * PATCH_SIZE + 4 * 6 * PATCH_SIZE;
+
+  indices.clear();
+  indices.reserve(PATCH_COUNT * PATCH_COUNT * 2 * maxPatchIndices);
+
+  for (int px = 0; px < PATCH_COUNT; ++px)
+  {
+    for (int pz = 0; pz < PATCH_COUNT; ++pz)
+    {
+      int x0 = px * PATCH_SIZE, x1 = x0 + PATCH_SIZE;
+      int z0 = pz * PATCH_SIZE, z1 = z0 + PATCH_SIZE;
+
+      for (int level = 0; level < LOD_COUNT; ++level)
+      {
+        // Step in the 129x129 vertex grid between adjacent vertices of this level
+        int step = 1 << level;
+
+        ranges[px][pz][level].offset = indices.size();
+
+        for (int x = x0; x < x1; x += step)
+        {
+          for (int z = z0; z < z1; z += step)
+          {
+            unsigned short v1 = vertexIndex(x,      z     );
+            unsigned short v2 = vertexIndex(x+step, z     );
+            unsigned short v3 = vertexIndex(x+step, z+step);
+            unsigned short v4 = vertexIndex(x,      z+step);
+
+            indices.push_back(v1); indices.push_back(v2); indices.push_back(v3);
+            indices.push_back(v3); indices.push_back(v4); indices.push_back(v1);
+          }
+        }
+
+        // Skirts: vertical strips from each edge down to the skirt vertices
+        for (int i = 0; i < PATCH_SIZE; i += step)
+        {
+          const int EDGES[4][4] =
+          {
+            { x0 + i, z0, x0 + i + step, z0 },
+            { x0 + i, z1, x0 + i + step, z1 },
+            { x0, z0 + i, x0, z0 + i + step },
+            { x1, z0 + i, x1, z0 + i + step }
+          };
+
+          for (int e = 0; e < 4; ++e)
+          {
+            unsigned short t1 = vertexIndex(EDGES[e][0], EDGES[e][1]);
+            unsigned short t2 = vertexIndex(EDGES[e][2], EDGES[e][3]);
+            unsigned short b1 = skirtIndex(EDGES[e][0], EDGES[e][1]);
+            unsigned short b2 = skirtIndex(EDGES[e][2], EDGES[e][3]);
+
+            indices.push_back(t1); indices.push_back(b1); indices.push_back(b2);
+            indices.push_back(b2); indices.push_back(t2); indices.push_back(t1);
+          }
+        }
+
+        ranges[px][pz][level].count = indices.size() - ranges[px][pz][level].offset;
+      }
+    }
+  }
+}
+
+int TerrainQuad::vertexIndex(int x, int z)
+{
+  const int sH = SIZE;
+
+  // Edges of constant z (with the corners), then edges of constant x, then the inside
+  if (z == 0)
+    return x;
+  if (z == sH)
+    return (1+sH) + x;
+  if (x == 0)
+    return 2 * (1+sH) + (z-1);
+  if (x == sH)
+    return 2 * (1+sH) + (sH-1) + (z-1);
+  return 2 * (1+sH) + 2 * (sH-1) + (x-1) * (sH-1) + (z-1);
+}
+
+int TerrainQuad::skirtIndex(int x, int z)
+{
+  const int sH = SIZE;
+  const int base = (1+sH) * (1+sH);
+
+  // Rows of constant z (with the corners of patches), then columns of constant x
+  if (z % PATCH_SIZE == 0)
+    return base + (z / PATCH_SIZE) * (1+sH) + x;
+
+  const int columnSize = sH - PATCH_COUNT;
+  return base + (PATCH_COUNT+1) * (1+sH) +
+         (x / PATCH_SIZE) * columnSize + (z - 1 - z / PATCH_SIZE);
+}
+
+int TerrainQuad::vertexCount()
+{
+  const int sH = SIZE;
+  return (1+sH) * (1+sH) + (PATCH_COUNT+1) * (1+sH) + (PATCH_COUNT+1) * (sH - PATCH_COUNT);
+}
+
+int TerrainQuad::selectLods(const Vector3D &viewer, float lodScale,
+                             int lods[PATCH_COUNT][PATCH_COUNT]) const
+{
+  int triangles = 0;
+
+  for (int px = 0; px < PATCH_COUNT; ++px)
+  {
+    for (int pz = 0; pz < PATCH_COUNT; ++pz)
+    {
+      // Distance to the bounding box of the patch
+      Vector3D minValues, maxValues;
+      patchBounds(px, pz, minValues, maxValues);
+
+      float dx = max(0.0f, max(minValues.x - viewer.x, viewer.x - maxValues.x));
+      float dy = max(0.0f, max(minValues.y - viewer.y, viewer.y - maxValues.y));
+      float dz = max(0.0f, max(minValues.z - viewer.z, viewer.z - maxValues.z));
+      float distance = sqrt(dx * dx + dy * dy + dz * dz);
+
+      int level = LOD_COUNT - 1;
+      while ((level > 0) && (_patchErrors[px][pz][level] * lodScale > distance))
+        --level;
+
+      lods[px][pz] = level;
+      triangles += patchTriangles(level);
+    }
+  }
+
+  return triangles;
+}
+
+unsigned int TerrainQuad::memoryUsage() const
+{
+  return sizeof(TerrainQuad) + _heights.memoryUsage();
+}
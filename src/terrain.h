@@ -0,0 +1,148 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* terrain.h
+    Contains the TerrainQuad class, the height field of a single quad of the
+    map together with its normals and level of detail data. It does not use
+    OpenGL: it is a part of the terrain library, shared by the game (which
+    only uploads the prepared geometry) and the benchmark. */
+
+#pragma once
+
+#include "config.h"
+
+#include "common.h"
+#include "fractal.h"
+#include "normals.h"
+#include "quadcache.h"
+#include "occlusion.h"
+
+#include <vector>
+
+/* Neighbors of a quad are given in the order of sides: 0 is at z-1,
+   1 at x+1, 2 at z+1 and 3 at x-1; missing ones are NULL. */
+class TerrainQuad
+{
+  public:
+    // Tiles along each side of a quad: 2^SIZE_POW
+    static const int SIZE_POW = 7;
+    static const int SIZE = 1 << SIZE_POW;
+
+    /* Quads are rendered in PATCH_COUNT x PATCH_COUNT patches, each of them
+       at one of LOD_COUNT levels (every 1st, 2nd, 4th, ... vertex), with
+       skirts hanging from their edges to hide the cracks between levels */
+    static const int PATCH_SIZE = 32;
+    static const int PATCH_COUNT = SIZE / PATCH_SIZE;
+    static const int LOD_COUNT = 4;
+
+    // Smallest cells of the height pyramid (used as occluders), in tiles
+    static const int OCCLUDER_SIZE = 8;
+    // Level of the height pyramid with the cells of patches
+    static const int PATCH_LEVEL = 2;
+
+    // Part of the index array with the triangles of a patch at some level
+    struct IndexRange
+    {
+      int offset, count;
+    };
+
+  public:
+    TerrainQuad(int x, int z) : _x(x), _z(z), _skirtDepth(0.0f) {}
+    virtual ~TerrainQuad() {}
+
+    inline int x() const
+      { return _x; }
+    inline int z() const
+      { return _z; }
+
+    inline int seed() const
+      { return (_x * 0x1f1f1f1f) ^ _z; }
+
+    /* fractal must be set to SIZE_POW; the heights depend only on the
+       position of the quad, not on its neighbors */
+    void generate(const Vector3D &scale, Fractal *fractal);
+
+    void calculateNormals(TerrainQuad* neighbors[4], const Vector3D &scale);
+
+    // Recalculates normals only of the edge shared with neighbors[side]
+    void calculateEdgeNormals(TerrainQuad* neighbors[4], const Vector3D &scale, int side);
+
+    bool load(const QuadCache &cache, const Vector3D &scale);
+    void save(const QuadCache &cache) const;
+
+    // Bounds and errors of the patches at each level, needed to render
+    void calculatePatchErrors();
+
+    // Height error [world units] of the patch drawn at the given level
+    inline float patchError(int px, int pz, int level) const
+      { return _patchErrors[px][pz][level]; }
+
+    /* Chooses the level of each patch (coarsest with error * lodScale
+       below the distance to viewer); returns the number of triangles */
+    int selectLods(const Vector3D &viewer, float lodScale,
+                   int lods[PATCH_COUNT][PATCH_COUNT]) const;
+
+    // Triangles of a patch at the given level, including the skirts
+    inline static int patchTriangles(int level)
+      { return 2 * (PATCH_SIZE >> level) * ((PATCH_SIZE >> level) + 4); }
+
+    inline const HeightPyramid& heights() const
+      { return _heights; }
+
+    // Bounding boxes of the quad and of its patches, including the skirts
+    void bounds(Vector3D &minValues, Vector3D &maxValues) const;
+    void patchBounds(int px, int pz, Vector3D &minValues, Vector3D &maxValues) const;
+
+    // Height of vertex (x, z), from 0 to SIZE, before scaling (0 outside)
+    float value(int x, int z) const;
+
+    /* Height [world units] and normal of the surface at (x, z), in tiles
+       from the corner of the quad, on the triangles of the finest level;
+       points outside are clamped to the quad */
+    void surface(float x, float z, float &height, Vector3D &normal) const;
+
+    /* Vertices and normals of the quad and of its skirts, placed as given
+       by vertexIndex() and skirtIndex(); both arrays have vertexCount()
+       elements */
+    void vertexData(Vector3D *vertices, PackedNormal *normals) const;
+
+    // Triangles of all patches at all levels, the same for each quad
+    static void buildIndices(std::vector<unsigned short> &indices,
+                             IndexRange ranges[PATCH_COUNT][PATCH_COUNT][LOD_COUNT]);
+
+    // Position of vertex (x, z) in the vertex arrays
+    static int vertexIndex(int x, int z);
+
+    // Position of the skirt vertex below (x, z), on the edges of patches
+    static int skirtIndex(int x, int z);
+
+    static int vertexCount();
+
+    // Memory [bytes] taken by the quad, with its height pyramid
+    unsigned int memoryUsage() const;
+
+  protected:
+    const int _x, _z;
+
+    Vector3D _scale;
+
+    float _values[1+SIZE][1+SIZE];
+
+    PackedNormal _normals[1+SIZE][1+SIZE];
+
+    // Height errors [world units] of the patches at each level
+    float _patchErrors[PATCH_COUNT][PATCH_COUNT][LOD_COUNT];
+    // Minimum and maximum heights [world units] of parts of the quad
+    HeightPyramid _heights;
+    float _skirtDepth;
+
+  private:
+    // Height at (px, pz) of the field with a border of one vertex around the quad
+    float paddedHeight(TerrainQuad* neighbors[4], int px, int pz) const;
+    void paddedHeights(TerrainQuad* neighbors[4], float *heights) const;
+
+    void filterValues(float v0, float &v1, float &v2, float &v3, float v4);
+    void generateEdge(Fractal *fractal, int seed, float *line);
+};
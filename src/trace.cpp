@@ -0,0 +1,195 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* trace.cpp
+    Contains the implementation of the Trace class. */
+
+#include "trace.h"
+
+#include <cassert>
+#include <cstdio>
+
+#include <SDL/SDL_thread.h>
+
+using namespace std;
+
+
+Trace* Trace::_instance = NULL;
+
+Trace::Trace() : Object("Trace")
+{
+  assert(_instance == NULL);
+  _instance = this;
+
+  _enabled = 0;
+  _mutex = SDL_CreateMutex();
+  _startTime = 0;
+}
+
+Trace::~Trace()
+{
+  _instance = NULL;
+
+  SDL_DestroyMutex(_mutex);
+  _mutex = NULL;
+}
+
+void Trace::start()
+{
+  SDL_mutexP(_mutex);
+  {
+    _events.clear();
+    _startTime = Time::nanoseconds();
+    atomicStore(&_enabled, 1);
+  }
+  SDL_mutexV(_mutex);
+}
+
+void Trace::stop()
+{
+  atomicStore(&_enabled, 0);
+}
+
+void Trace::setThreadName(const string &name)
+{
+  if (_instance == NULL)
+    return;
+
+  SDL_mutexP(_instance->_mutex);
+  {
+    map< Uint32, pair<int, string> > &threads = _instance->_threads;
+    Uint32 id = SDL_ThreadID();
+
+    if (threads.find(id) == threads.end())
+      threads[id] = make_pair((int)threads.size(), name);
+    else
+      threads[id].second = name;
+  }
+  SDL_mutexV(_instance->_mutex);
+}
+
+void Trace::record(Event &event)
+{
+  long long now = Time::nanoseconds();
+
+  SDL_mutexP(_mutex);
+  {
+    // Checked again, as the recording may have been stopped meanwhile
+    if (atomicLoad(&_enabled) != 0)
+    {
+      Uint32 id = SDL_ThreadID();
+      map< Uint32, pair<int, string> >::iterator it = _threads.find(id);
+      if (it == _threads.end())
+        it = _threads.insert(make_pair(id, make_pair((int)_threads.size(), string("Thread")))).first;
+
+      event.thread = it->second.first;
+      event.time = now - _startTime;
+      _events.push_back(event);
+
+      if ((int)_events.size() >= MAX_EVENTS)
+        atomicStore(&_enabled, 0);
+    }
+  }
+  SDL_mutexV(_mutex);
+}
+
+void Trace::add(const char *name, char phase, bool hasPosition, int x, int z, unsigned int id)
+{
+  if (!recording())
+    return;
+
+  Event e;
+  e.name = name;
+  e.phase = phase;
+  e.hasPosition = hasPosition;
+  e.x = x;
+  e.z = z;
+  e.id = id;
+  _instance->record(e);
+}
+
+void Trace::begin(const char *name)
+{
+  add(name, 'B', false, 0, 0, 0);
+}
+
+void Trace::begin(const char *name, int x, int z)
+{
+  add(name, 'B', true, x, z, 0);
+}
+
+void Trace::end()
+{
+  add("", 'E', false, 0, 0, 0);
+}
+
+void Trace::instant(const char *name)
+{
+  add(name, 'i', false, 0, 0, 0);
+}
+
+void Trace::instant(const char *name, int x, int z)
+{
+  add(name, 'i', true, x, z, 0);
+}
+
+void Trace::flowStart(const char *name, unsigned int id)
+{
+  add(name, 's', false, 0, 0, id);
+}
+
+void Trace::flowEnd(const char *name, unsigned int id)
+{
+  add(name, 'f', false, 0, 0, id);
+}
+
+bool Trace::save(const string &fileName)
+{
+  FILE *file = fopen(fileName.c_str(), "w");
+  if (file == NULL)
+    return false;
+
+  SDL_mutexP(_mutex);
+  {
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    bool first = true;
+    for (map< Uint32, pair<int, string> >::const_iterator it = _threads.begin();
+         it != _threads.end(); ++it)
+    {
+      fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                    "\"args\":{\"name\":\"%s\"}}",
+              first ? "" : ",\n", it->second.first, it->second.second.c_str());
+      first = false;
+    }
+
+    for (unsigned int i = 0; i < _events.size(); ++i)
+    {
+      const Event &e = _events[i];
+
+      // Microseconds
+      fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"flightsim\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+              first ? "" : ",\n", e.name, e.phase, e.thread, 1e-3 * e.time);
+      first = false;
+
+      if (e.phase == 'i')
+        fprintf(file, ",\"s\":\"t\"");
+      else if (e.phase == 's')
+        fprintf(file, ",\"id\":%u", e.id);
+      else if (e.phase == 'f')
+        fprintf(file, ",\"id\":%u,\"bp\":\"e\"", e.id);
+
+      if (e.hasPosition)
+        fprintf(file, ",\"args\":{\"x\":%d,\"z\":%d}", e.x, e.z);
+
+      fprintf(file, "}");
+    }
+
+    fprintf(file, "\n]}\n");
+  }
+  SDL_mutexV(_mutex);
+
+  return fclose(file) == 0;
+}
@@ -0,0 +1,113 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* trace.h
+    Contains the Trace class, which records a timeline of the main loop and
+    of the worker threads in the Chrome trace format (loadable in Perfetto
+    or chrome://tracing). */
+
+#pragma once
+
+#include "config.h"
+
+#include "object.h"
+#include "common.h"
+#include "atomic.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <SDL/SDL_mutex.h>
+
+/* Events may be recorded by any thread. When recording is off, each call
+   costs a single load of the enabled flag. */
+class Trace : public Object
+{
+  public:
+    // Events recorded at most, after which the recording stops
+    static const int MAX_EVENTS = 500000;
+
+  public:
+    Trace();
+    virtual ~Trace();
+
+    inline static Trace* instance()
+      { return _instance; }
+
+    inline static bool recording()
+      { return (_instance != NULL) && (atomicLoad(&_instance->_enabled) != 0); }
+
+    // Clears the recorded events and starts recording
+    void start();
+    void stop();
+
+    inline int eventCount() const
+      { return _events.size(); }
+
+    // Writes the recorded events as JSON
+    bool save(const std::string &fileName);
+
+    // Name of the calling thread on the timeline
+    static void setThreadName(const std::string &name);
+
+    // Slices on the calling thread; names must stay valid (e.g. string literals)
+    static void begin(const char *name);
+    static void begin(const char *name, int x, int z);
+    static void end();
+
+    // Point in time, with optional quad coordinates
+    static void instant(const char *name);
+    static void instant(const char *name, int x, int z);
+
+    /* Arrows between threads: flowStart() and flowEnd() with the same id
+       must be called within slices */
+    static void flowStart(const char *name, unsigned int id);
+    static void flowEnd(const char *name, unsigned int id);
+
+  private:
+    struct Event
+    {
+      const char *name;
+      char phase;
+      bool hasPosition;
+      int thread;
+      int x, z;
+      unsigned int id;
+      long long time;
+    };
+
+    static Trace *_instance;
+    int _enabled;
+    SDL_mutex *_mutex;
+    std::vector<Event> _events;
+    long long _startTime;
+    // Index and name of each thread, by SDL thread ID
+    std::map< Uint32, std::pair<int, std::string> > _threads;
+
+    void record(Event &event);
+    static void add(const char *name, char phase, bool hasPosition, int x, int z, unsigned int id);
+};
+
+// Slice on the timeline until the end of the enclosing block
+class TraceScope
+{
+  public:
+    explicit TraceScope(const char *name)
+    {
+      _recording = Trace::recording();
+      if (_recording)
+        Trace::begin(name);
+    }
+
+    ~TraceScope()
+    {
+      if (_recording)
+        Trace::end();
+    }
+
+  private:
+    bool _recording;
+};
@@ -0,0 +1,497 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* world.cpp
+    Contains the implementation of the World class. */
+
+#include "world.h"
+
+#include "map.h"
+#include "model.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+const float World::MAX_ADVANCE = 0.25f;
+const float World::FIRING_RANGE = 1500.0f;
+const float World::FIRING_ANGLE = 3.0f;
+
+
+World::World(Map *pMap, const string &pName)
+  : Object(pName.empty() ? genericName("World") : pName)
+{
+  _map = pMap;
+
+  _seed = 1;
+  _player = new Player(_map, &_random);
+  _player->setHandle(_entities.addAircraft(_player));
+
+  _game = false;
+  _broadPhase = true;
+  _crashed = false;
+  _physicsRate = DEFAULT_PHYSICS_RATE;
+  _stepCount = 0;
+  _accumulator = 0.0f;
+  _interpolation = 0.0f;
+  _recording = NULL;
+  _replay = NULL;
+}
+
+World::~World()
+{
+  delete _player;
+  _player = NULL;
+
+  deleteEnemyPlayers();
+
+  _map = NULL;
+}
+
+void World::deleteEnemyPlayers()
+{
+  for (list<Player*>::iterator it = _enemyPlayers.begin();
+       it != _enemyPlayers.end(); ++it)
+  {
+    delete *it;
+  }
+  _enemyPlayers.clear();
+}
+
+
+void World::setPhysicsRate(int pRate)
+{
+  _physicsRate = max(1, min(pRate, (int)MAX_PHYSICS_RATE));
+}
+
+void World::reset()
+{
+  _random.seed(_seed);
+
+  _player->reset();
+
+  deleteEnemyPlayers();
+  _destroyedEnemies.clear();
+
+  _entities.clear();
+  _player->setHandle(_entities.addAircraft(_player));
+
+  _crashed = false;
+  _stepCount = 0;
+  _stats = Stats();
+  resetClock();
+}
+
+Player* World::addAIPlayer(Player::Team team, const std::string &name, int aiActions)
+{
+  Player *player = new Player(_map, &_random);
+  player->setTeam(team);
+  player->setName(name);
+  player->setAI(true);
+  player->setAIActions(aiActions);
+  player->setHandle(_entities.addAircraft(player));
+
+  _enemyPlayers.push_back(player);
+
+  return player;
+}
+
+void World::addEnemies(int count, int aiActions)
+{
+  for (int i = 1; i <= count; ++i)
+  {
+    Player *enemy = addAIPlayer(Player::Team_Red, string(_("Computer ")) + toString<int>(i),
+                                aiActions);
+
+    int mapPosX = 1 + _random.integer(2);
+    if (_random.integer(2) == 0)
+      mapPosX *= -1;
+
+    int mapPosZ = 1 + _random.integer(2);
+    if (_random.integer(2) == 0)
+      mapPosZ *= -1;
+
+    enemy->setMapPosition(mapPosX, mapPosZ);
+
+    Vector3D pos;
+    pos.x= -0.5f * _map->quadSize().x + _random.integer((int)_map->quadSize().x);
+    pos.y = _player->height();
+    pos.z = -0.5f * _map->quadSize().z + _random.integer((int)_map->quadSize().z);
+
+    enemy->setPositionOffset(pos);
+
+    float heading = _random.integer(360);
+    enemy->setHeading(heading);
+
+    enemy->resetInterpolation();
+  }
+}
+
+void World::resetClock()
+{
+  _accumulator = 0.0f;
+  _interpolation = 0.0f;
+  interpolate();
+}
+
+int World::advance(float seconds)
+{
+  const float length = stepLength();
+
+  _crashed = false;
+  _accumulator += min(seconds, MAX_ADVANCE);
+
+  int steps = 0;
+  while ((_accumulator >= length) && (!_crashed) && (!replayFinished()))
+  {
+    // The time spent waiting for the terrain is not simulated later
+    if (!terrainReady())
+    {
+      _accumulator = length;
+      break;
+    }
+
+    step();
+    _accumulator -= length;
+    ++steps;
+  }
+
+  if (_crashed)
+    _accumulator = 0.0f;
+
+  _interpolation = _accumulator / length;
+  interpolate();
+
+  return steps;
+}
+
+bool World::terrainReady()
+{
+  _requiredQuads.clear();
+
+  requireTerrain(_player);
+
+  if (_game)
+  {
+    for (list<Player*>::const_iterator it = _enemyPlayers.begin();
+         it != _enemyPlayers.end(); ++it)
+    {
+      if ((*it)->hp() > 0)
+        requireTerrain(*it);
+    }
+  }
+
+  return _map->requireQuads(_requiredQuads);
+}
+
+void World::requireTerrain(const Player *player)
+{
+  Vector3D qs = _map->quadSize();
+
+  // Farthest a plane gets in a step, with a margin
+  const float reach = 2.0f * Player::MAX_VELOCITY * stepLength();
+
+  // Above the highest terrain, the ground is not tested
+  if (player->height() > qs.y + reach)
+    return;
+
+  // Quads which the plane may be over after the step
+  const Vector3D &pos = player->positionOffset();
+  int x0 = (int)floor((pos.x - reach) / qs.x + 0.5f);
+  int x1 = (int)floor((pos.x + reach) / qs.x + 0.5f);
+  int z0 = (int)floor((pos.z - reach) / qs.z + 0.5f);
+  int z1 = (int)floor((pos.z + reach) / qs.z + 0.5f);
+
+  for (int x = x0; x <= x1; ++x)
+  {
+    for (int z = z0; z <= z1; ++z)
+      _requiredQuads.push_back(make_pair(player->mapPositionX() + x, player->mapPositionZ() + z));
+  }
+}
+
+void World::step()
+{
+  const float delta = stepLength();
+
+  if (_replay != NULL)
+  {
+    Recording::Controls controls = _replay->controls(_stepCount);
+    _player->setControl(controls.acceleration, controls.angular);
+    _player->setFiring(controls.firing);
+  }
+  else if (_recording != NULL)
+  {
+    Recording::Controls controls;
+    controls.acceleration = _player->accelerationControl();
+    controls.angular = _player->angularControl();
+    controls.firing = _player->firing();
+    _recording->addControls(_stepCount, controls);
+  }
+
+  _player->step(delta);
+
+  if (_game)
+  {
+    for (list<Player*>::iterator it = _enemyPlayers.begin();
+         it != _enemyPlayers.end(); ++it)
+    {
+      (*it)->step(delta);
+    }
+  }
+
+  ++_stepCount;
+
+  // Collision with the ground
+  if ((_player->height() <= _map->quadSize().y) && (_player->altitude() <= 0.0f))
+  {
+    _crashed = true;
+
+    // In the game the player is destroyed like the AI players: no target, no firing
+    if (_game && (_player->hp() > 0))
+    {
+      _player->crash();
+      ++_stats.groundCollisions;
+    }
+  }
+
+  if (!_game)
+    return;
+
+  // AI players are destroyed by the ground
+  for (list<Player*>::iterator it = _enemyPlayers.begin();
+       it != _enemyPlayers.end(); ++it)
+  {
+    Player *p = *it;
+    if ((p->hp() > 0) && (p->height() <= _map->quadSize().y) && (p->altitude() <= 0.0f))
+    {
+      p->crash();
+      ++_stats.groundCollisions;
+    }
+  }
+
+  _entities.syncAircraft();
+
+  addBullets(_player);
+  for (list<Player*>::iterator it = _enemyPlayers.begin();
+       it != _enemyPlayers.end(); ++it)
+  {
+    addBullets(*it);
+  }
+
+  _entities.updateBullets(delta);
+  checkHits();
+  _entities.removeDecayedBullets();
+
+  list<Player*>::iterator jt = _enemyPlayers.begin();
+  while (jt != _enemyPlayers.end())
+  {
+    if ((*jt)->destroyed())
+    {
+      _destroyedEnemies.push_back((*jt)->name());
+
+      _entities.removeAircraft((*jt)->handle());
+      delete *jt;
+      jt = _enemyPlayers.erase(jt);
+      continue;
+    }
+
+    ++jt;
+  }
+
+  // Firing in the next step
+  aim();
+}
+
+void World::addBullets(Player *player)
+{
+  const vector<Bullet> &created = player->createdBullets();
+  if (created.empty())
+    return;
+
+  _entities.addBullets(created);
+  _stats.bulletsFired += created.size();
+  player->clearCreatedBullets();
+}
+
+void World::checkHits()
+{
+  Vector3D bbMin = Player::model()->boundingBoxMin();
+  Vector3D bbMax = Player::model()->boundingBoxMax();
+  const unsigned int aircraftCount = _entities.aircraftCount();
+
+  if ((aircraftCount == 0) || (_entities.bulletCount() == 0))
+    return;
+
+  if ((!_broadPhase) || (aircraftCount < BROAD_PHASE_MIN_AIRCRAFT))
+  {
+    for (unsigned int b = 0; b < _entities.bulletCount(); ++b)
+    {
+      if (_entities.bulletDecayed(b))
+        continue;
+
+      const Vector3D &pos = _entities.bulletPosition(b);
+
+      for (unsigned int a = 0; a < aircraftCount; ++a)
+      {
+        if (_entities.aircraftHp(a) == 0)
+          continue;
+
+        ++_stats.hitTests;
+        Vector3D d = pos - _entities.aircraftPosition(a);
+        if (d.between(bbMin, bbMax))
+        {
+          hit(b, a);
+          break;
+        }
+      }
+    }
+
+    return;
+  }
+
+  _grid.setQuadSize(_map->quadSize());
+  _grid.build(&_entities.aircraftPosition(0), aircraftCount);
+
+  // Cells around a bullet which may hold a plane hit by it
+  float extent = max(max(fabs(bbMin.x), fabs(bbMax.x)), max(fabs(bbMin.z), fabs(bbMax.z)));
+  int reach = (int)ceil(extent / _grid.cellSize());
+
+  for (unsigned int b = 0; b < _entities.bulletCount(); ++b)
+  {
+    if (_entities.bulletDecayed(b))
+      continue;
+
+    const Vector3D &pos = _entities.bulletPosition(b);
+    int x = 0, z = 0;
+    _grid.cell(pos, x, z);
+
+    // The first plane in the store is hit, as when testing all of them
+    unsigned int hitIndex = aircraftCount;
+
+    for (int dx = -reach; dx <= reach; ++dx)
+    {
+      for (int dz = -reach; dz <= reach; ++dz)
+      {
+        unsigned int begin = 0, end = 0;
+        if (!_grid.find(x + dx, z + dz, begin, end))
+          continue;
+
+        for (unsigned int i = begin; i < end; ++i)
+        {
+          unsigned int a = _grid.index(i);
+          if (a >= hitIndex)
+            break;
+
+          if (_entities.aircraftHp(a) == 0)
+            continue;
+
+          ++_stats.hitTests;
+          Vector3D d = pos - _entities.aircraftPosition(a);
+          if (d.between(bbMin, bbMax))
+          {
+            hitIndex = a;
+            break;
+          }
+        }
+      }
+    }
+
+    if (hitIndex < aircraftCount)
+      hit(b, hitIndex);
+  }
+}
+
+void World::hit(unsigned int bullet, unsigned int aircraft)
+{
+  _entities.damageAircraft(aircraft);
+  _entities.aircraftPlayer(aircraft)->hit();
+  _entities.decayBullet(bullet);
+  ++_stats.hits;
+}
+
+void World::aim()
+{
+  const float cosAngle = cos(FIRING_ANGLE * PI_180);
+  const float range2 = FIRING_RANGE * FIRING_RANGE;
+  const unsigned int count = _entities.aircraftCount();
+
+  for (unsigned int s = 0; s < count; ++s)
+  {
+    Player *shooter = _entities.aircraftPlayer(s);
+    if ((!shooter->ai()) || ((shooter->aiActions() & Player::AI_Firing) == 0))
+      continue;
+
+    bool fire = false;
+
+    if (_entities.aircraftHp(s) > 0)
+    {
+      const Vector3D &pos = _entities.aircraftPosition(s);
+      const Vector3D &dir = _entities.aircraftDirection(s);
+      int team = _entities.aircraftTeam(s);
+
+      // Any living opponent in range, ahead
+      for (unsigned int t = 0; (!fire) && (t < count); ++t)
+      {
+        if ((_entities.aircraftTeam(t) == team) || (_entities.aircraftHp(t) == 0))
+          continue;
+
+        Vector3D d = _entities.aircraftPosition(t) - pos;
+        float distance2 = d.dotProduct(d);
+        if (distance2 > range2)
+          continue;
+
+        fire = d.dotProduct(dir) >= cosAngle * sqrt(distance2);
+      }
+    }
+
+    shooter->setFiring(fire);
+  }
+}
+
+void World::interpolate()
+{
+  _player->interpolate(_interpolation);
+
+  for (list<Player*>::iterator it = _enemyPlayers.begin();
+       it != _enemyPlayers.end(); ++it)
+  {
+    (*it)->interpolate(_interpolation);
+  }
+}
+
+vector<string> World::destroyedEnemies()
+{
+  vector<string> result = _destroyedEnemies;
+  _destroyedEnemies.clear();
+  return result;
+}
+
+unsigned long long World::checksum() const
+{
+  Hash hash;
+  hash.add(_stepCount);
+  hash.add(_random.state());
+
+  list<Player*> players(_enemyPlayers);
+  players.push_front(_player);
+
+  for (list<Player*>::const_iterator it = players.begin(); it != players.end(); ++it)
+  {
+    const Player *p = *it;
+    hash.add(p->mapPositionX());
+    hash.add(p->mapPositionZ());
+    hash.add(p->positionOffset());
+    hash.add(p->velocityVector());
+    hash.add(p->rotation().quaternion());
+    hash.add(p->hp());
+    hash.add(p->ammo());
+  }
+
+  for (unsigned int i = 0; i < _entities.bulletCount(); ++i)
+    hash.add(_entities.bulletPosition(i));
+
+  return hash.value();
+}
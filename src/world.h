@@ -0,0 +1,196 @@
+/***************************************************************************
+ *   Copyright (C) 2011-2012 by Piotr Dziwinski                            *
+ *   piotrdz@gmail.com                                                     *
+ ***************************************************************************/
+
+ /* world.h
+    Contains the World class, which holds the players and bullets of a
+    flight and advances them in steps of fixed length. */
+
+#pragma once
+
+#include "config.h"
+
+#include "object.h"
+#include "common.h"
+#include "player.h"
+#include "entitystore.h"
+#include "spatialhash.h"
+#include "recording.h"
+
+#include <list>
+#include <string>
+#include <vector>
+
+class Map;
+
+/* Physics runs at a fixed rate, whatever the frame rate: advance() adds the
+   real time that passed to an accumulator and makes as many whole steps as
+   fit in it, so the results do not depend on the timing of frames. Players
+   are drawn between their states of the last two steps, the rest of the
+   accumulator telling how far. All random decisions are drawn from the
+   seed given to reset(), so a flight is repeated by the same seed and the
+   same controls of the player (see Recording). Bullets, hit tests and
+   aiming work on the packed arrays of an EntityStore. No OpenGL is used
+   here. */
+class World : public Object
+{
+  public:
+    // Steps per second by default and at most
+    static const int DEFAULT_PHYSICS_RATE = 500;
+    static const int MAX_PHYSICS_RATE = 2000;
+    // Longest time [s] simulated by one advance(); the rest is dropped, e.g. after a stall
+    static const float MAX_ADVANCE;
+    // AI players with AI_Firing fire at opponents nearer than the range [world units],
+    // within the angle [degrees] from their heading
+    static const float FIRING_RANGE;
+    static const float FIRING_ANGLE;
+    // Planes needed to use the spatial hash for hit tests
+    static const unsigned int BROAD_PHASE_MIN_AIRCRAFT = 16;
+
+    // Counts since reset()
+    struct Stats
+    {
+      unsigned int bulletsFired, hits, groundCollisions;
+      // Bullet and plane pairs tested for hits
+      unsigned long long hitTests;
+
+      Stats() : bulletsFired(0), hits(0), groundCollisions(0), hitTests(0) {}
+    };
+
+  public:
+    World(Map *pMap, const std::string &pName = "");
+    virtual ~World();
+
+    void setPhysicsRate(int pRate);
+    inline int physicsRate() const
+      { return _physicsRate; }
+
+    // Length of a step [s]
+    inline float stepLength() const
+      { return 1.0f / _physicsRate; }
+
+    // Enemies and bullets take part only in the game
+    inline void setGame(bool pGame)
+      { _game = pGame; }
+    inline bool game() const
+      { return _game; }
+
+    inline Player* player() const
+      { return _player; }
+
+    // AI players: the enemies of the player, or both sides of a headless battle
+    inline const std::list<Player*>& enemyPlayers() const
+      { return _enemyPlayers; }
+
+    // Positions of the planes in the last step and the bullets in flight
+    inline const EntityStore& entities() const
+      { return _entities; }
+
+    /* Bullets are tested only against the planes in the neighboring cells
+       of a SpatialHash of the planes (on by default), or against all; with
+       fewer than BROAD_PHASE_MIN_AIRCRAFT planes, testing all is faster */
+    inline void setBroadPhase(bool pBroadPhase)
+      { _broadPhase = pBroadPhase; }
+    inline bool broadPhase() const
+      { return _broadPhase; }
+
+    // Size of the pool of bullets; new bullets are dropped when it is full
+    inline void setBulletCapacity(unsigned int pCapacity)
+      { _entities.setBulletCapacity(pCapacity); }
+
+    // Seed of the random decisions, used from the next reset()
+    inline void setSeed(unsigned int pSeed)
+      { _seed = pSeed; }
+    inline unsigned int seed() const
+      { return _seed; }
+
+    // Starts a new flight: resets the player and removes enemies and bullets
+    void reset();
+
+    // Places enemies in random quads around the player
+    void addEnemies(int count, int aiActions);
+
+    // Adds an AI player, which is to be placed by the caller
+    Player* addAIPlayer(Player::Team team, const std::string &name, int aiActions);
+
+    // Forgets the time not simulated yet, e.g. after a pause
+    void resetClock();
+
+    // Simulates the given real time [s]; returns the number of steps made
+    int advance(float seconds);
+
+    /* Requests the quads under the planes which may hit the ground in the
+       next step, wherever they are; returns true if all of them are created.
+       A step without them would miss collisions, so the flight would depend
+       on the streaming of the map. advance() waits for them by itself. */
+    bool terrainReady();
+
+    // Makes a single step of stepLength(); terrainReady() must be true
+    void step();
+
+    // Steps made since reset()
+    inline unsigned int stepCount() const
+      { return _stepCount; }
+
+    // Fraction of a step simulated after the drawn state
+    inline float interpolation() const
+      { return _interpolation; }
+
+    // The player has hit the ground in the last advance(), which stopped there
+    inline bool crashed() const
+      { return _crashed; }
+
+    // Names of the enemies shot down since the previous call
+    std::vector<std::string> destroyedEnemies();
+
+    inline const Stats& stats() const
+      { return _stats; }
+
+    // Stores the controls of the player in each step in pRecording (NULL stops)
+    inline void setRecording(Recording *pRecording)
+      { _recording = pRecording; }
+
+    /* Takes the controls of the player from pReplay in each step, instead
+       of those set from the input (NULL stops); no steps are made after
+       the end of the recording */
+    inline void setReplay(const Recording *pReplay)
+      { _replay = pReplay; }
+    inline const Recording* replay() const
+      { return _replay; }
+
+    inline bool replayFinished() const
+      { return (_replay != NULL) && (_stepCount >= _replay->steps()); }
+
+    // Hash of the state of all players and bullets, bit by bit
+    unsigned long long checksum() const;
+
+  private:
+    Map *_map;
+    Random _random;
+    unsigned int _seed;
+    Player *_player;
+    std::list<Player*> _enemyPlayers;
+    EntityStore _entities;
+    SpatialHash _grid;
+    std::vector<std::string> _destroyedEnemies;
+    bool _game;
+    bool _broadPhase;
+    bool _crashed;
+    int _physicsRate;
+    unsigned int _stepCount;
+    float _accumulator;
+    float _interpolation;
+    Recording *_recording;
+    const Recording *_replay;
+    Stats _stats;
+    std::vector< std::pair<int, int> > _requiredQuads;
+
+    void deleteEnemyPlayers();
+    void interpolate();
+    void requireTerrain(const Player *player);
+    void addBullets(Player *player);
+    void checkHits();
+    void hit(unsigned int bullet, unsigned int aircraft);
+    void aim();
+};